@@ -0,0 +1,196 @@
+/*
+  ==============================================================================
+
+    BruteForceSearch.cpp
+    Created: 16 Oct 2026 6:22:02pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#include "BruteForceSearch.h"
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+
+ // GCC and Clang only emit AVX2 instructions in functions marked for it. MSVC always can.
+ #if JUCE_GCC || JUCE_CLANG
+  #define PALETTE_AVX2_FUNCTION __attribute__((target("avx2")))
+ #else
+  #define PALETTE_AVX2_FUNCTION
+ #endif
+#endif
+
+namespace Palette
+{
+	namespace
+	{
+		// Grains whose distances are accumulated before being compared. 1kb, so it stays in L1.
+		constexpr int blockSize = 256;
+
+		// distances[i] += weight * (column[i] - target)^2 for numGrains grains.
+		using AccumulateFunction = void (*)(float* distances, const float* column, float target, float weight, int numGrains);
+
+		void accumulateScalar(float* distances, const float* column, const float target, const float weight, const int numGrains) noexcept
+		{
+			for (auto i = 0; i < numGrains; i++)
+			{
+				const auto difference = column[i] - target;
+				distances[i] += weight * difference * difference;
+			}
+		}
+
+	   #if JUCE_INTEL
+		void accumulateSSE(float* distances, const float* column, const float target, const float weight, const int numGrains) noexcept
+		{
+			const auto targets = _mm_set1_ps(target);
+			const auto weights = _mm_set1_ps(weight);
+			auto i = 0;
+
+			for (; i + 4 <= numGrains; i += 4)
+			{
+				const auto difference = _mm_sub_ps(_mm_loadu_ps(column + i), targets);
+				const auto weighted = _mm_mul_ps(weights, _mm_mul_ps(difference, difference));
+				_mm_store_ps(distances + i, _mm_add_ps(_mm_load_ps(distances + i), weighted));
+			}
+
+			accumulateScalar(distances + i, column + i, target, weight, numGrains - i);
+		}
+
+		PALETTE_AVX2_FUNCTION void accumulateAVX2(float* distances, const float* column, const float target, const float weight, const int numGrains) noexcept
+		{
+			const auto targets = _mm256_set1_ps(target);
+			const auto weights = _mm256_set1_ps(weight);
+			auto i = 0;
+
+			for (; i + 8 <= numGrains; i += 8)
+			{
+				const auto difference = _mm256_sub_ps(_mm256_loadu_ps(column + i), targets);
+				const auto weighted = _mm256_mul_ps(weights, _mm256_mul_ps(difference, difference));
+				_mm256_store_ps(distances + i, _mm256_add_ps(_mm256_load_ps(distances + i), weighted));
+			}
+
+			accumulateScalar(distances + i, column + i, target, weight, numGrains - i);
+		}
+	   #endif
+
+		AccumulateFunction getAccumulateFunction(const BruteForceKernel kernel) noexcept
+		{
+		   #if JUCE_INTEL
+			switch (kernel)
+			{
+			case BruteForceKernel::best:
+				return juce::SystemStats::hasAVX2() ? accumulateAVX2 : accumulateSSE;
+			case BruteForceKernel::avx2:
+				return accumulateAVX2;
+			case BruteForceKernel::sse:
+				return accumulateSSE;
+			case BruteForceKernel::scalar:
+				break;
+			}
+		   #else
+			juce::ignoreUnused(kernel);
+		   #endif
+
+			return accumulateScalar;
+		}
+
+		// Inserts a grain into the sorted results, dropping the furthest if there are already k.
+		void insertNeighbour(Neighbour* results, const int k, int& numFound, const int grain, const float distance) noexcept
+		{
+			auto position = numFound < k ? numFound++ : k - 1;
+
+			while (position > 0 && results[position - 1].distanceSquared > distance)
+			{
+				results[position] = results[position - 1];
+				position--;
+			}
+
+			results[position] = { grain, distance };
+		}
+
+		/*
+		 * Offers every grain of a block to the results. Most grains of a big corpus are further
+		 * away than the current k-th best, so four distances at a time are compared against it
+		 * and groups where none are closer are skipped without any branching per grain.
+		 */
+		void collectNearest(const float* distances, const int firstGrain, const int numGrains, const int k, Neighbour* results, int& numFound) noexcept
+		{
+			auto i = 0;
+
+		   #if JUCE_INTEL
+			for (; i + 4 <= numGrains; i += 4)
+			{
+				const auto worst = numFound == k ? results[k - 1].distanceSquared : std::numeric_limits<float>::max();
+				auto closer = _mm_movemask_ps(_mm_cmplt_ps(_mm_load_ps(distances + i), _mm_set1_ps(worst)));
+
+				for (auto lane = 0; closer != 0; lane++, closer >>= 1)
+					if ((closer & 1) != 0 && (numFound < k || distances[i + lane] < results[k - 1].distanceSquared))
+						insertNeighbour(results, k, numFound, firstGrain + i + lane, distances[i + lane]);
+			}
+		   #endif
+
+			for (; i < numGrains; i++)
+				if (numFound < k || distances[i] < results[k - 1].distanceSquared)
+					insertNeighbour(results, k, numFound, firstGrain + i, distances[i]);
+		}
+	}
+
+	bool isBruteForceKernelAvailable(const BruteForceKernel kernel) noexcept
+	{
+		switch (kernel)
+		{
+		case BruteForceKernel::best:
+		case BruteForceKernel::scalar:
+			return true;
+		case BruteForceKernel::sse:
+		   #if JUCE_INTEL
+			return juce::SystemStats::hasSSE2();
+		   #else
+			return false;
+		   #endif
+		case BruteForceKernel::avx2:
+		   #if JUCE_INTEL
+			return juce::SystemStats::hasAVX2();
+		   #else
+			return false;
+		   #endif
+		}
+
+		return false;
+	}
+
+	int findNearestBruteForce(const DescriptorTable& descriptors, const float* target, const float* weights, const int k, Neighbour* results,
+		const BruteForceKernel kernel) noexcept
+	{
+		const auto numGrains = static_cast<int>(descriptors.getNumGrains());
+		const auto numDimensions = descriptors.getNumDimensions();
+
+		if (numGrains == 0 || k <= 0)
+			return 0;
+
+		const auto accumulate = getAccumulateFunction(kernel);
+
+		alignas(32) float distances[blockSize];
+		auto numFound = 0;
+
+		for (auto blockStart = 0; blockStart < numGrains; blockStart += blockSize)
+		{
+			const auto blockLength = juce::jmin(blockSize, numGrains - blockStart);
+
+			std::fill(distances, distances + blockLength, 0.0f);
+
+			for (auto dimension = 0; dimension < numDimensions; dimension++)
+			{
+				const auto weight = weights != nullptr ? weights[dimension] : 1.0f;
+
+				if (weight != 0.0f)
+					accumulate(distances, descriptors.getColumn(dimension) + blockStart, target[dimension], weight, blockLength);
+			}
+
+			collectNearest(distances, blockStart, blockLength, k, results, numFound);
+		}
+
+		return numFound;
+	}
+}
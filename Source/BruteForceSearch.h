@@ -0,0 +1,133 @@
+/*
+  ==============================================================================
+
+    BruteForceSearch.h
+    Created: 16 Oct 2026 6:22:02pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+#include "Descriptors.h"
+
+namespace Palette
+{
+	/*
+	 * The instruction set a brute force scan is computed with. best picks the widest one
+	 * the CPU running the code supports; the others exist so they can be compared.
+	 */
+	enum class BruteForceKernel
+	{
+		best,
+		scalar,
+		sse,
+		avx2
+	};
+
+	// Whether kernel can run on this CPU (best and scalar always can).
+	bool isBruteForceKernelAvailable(BruteForceKernel kernel) noexcept;
+
+	/*
+	 * findNearestBruteForce measures the weighted squared euclidean distance from target to
+	 * every row of descriptors and keeps the k nearest. It needs no index, so it's the
+	 * baseline the tree and graph indexes are measured against, and is often the quickest
+	 * choice for small corpora or many dimensions.
+	 *
+	 * Grains are scanned in blocks: for each block the distances are accumulated one
+	 * descriptor column at a time with SIMD (reading the structure of arrays table linearly),
+	 * then compared against the current k-th best with SIMD so only grains which make the
+	 * cut are inserted into results.
+	 *
+	 * target and weights (which may be nullptr for equal weights) hold one value per
+	 * dimension. results must have room for k neighbours and is filled nearest first.
+	 * Never allocates. Returns how many neighbours were written.
+	 */
+	int findNearestBruteForce(const DescriptorTable& descriptors, const float* target, const float* weights, int k, Neighbour* results,
+		BruteForceKernel kernel = BruteForceKernel::best) noexcept;
+}
+
+TEST_CASE("BruteForceSearch")
+{
+	const auto dimensions = 7;
+	// Not a multiple of any vector width, so the tail of the last block is exercised.
+	const auto numGrains = 1013;
+
+	Palette::DescriptorTable table(dimensions, numGrains);
+	juce::Random random(5);
+
+	for (size_t grain = 0; grain < numGrains; grain++)
+		for (auto dimension = 0; dimension < dimensions; dimension++)
+			table.setValue(grain, dimension, random.nextFloat());
+
+	const float weights[dimensions] = { 1.0f, 2.0f, 0.5f, 0.0f, 1.0f, 3.0f, 1.0f };
+
+	const auto exactDistances = [&](const float* target) {
+		std::vector<float> distances;
+		for (size_t grain = 0; grain < numGrains; grain++)
+		{
+			auto distance = 0.0f;
+			for (auto dimension = 0; dimension < dimensions; dimension++)
+			{
+				const auto difference = table.getValue(grain, dimension) - target[dimension];
+				distance += weights[dimension] * difference * difference;
+			}
+			distances.push_back(distance);
+		}
+		return distances;
+	};
+
+	SUBCASE("Every kernel finds the true k nearest")
+	{
+		for (const auto kernel : { Palette::BruteForceKernel::best, Palette::BruteForceKernel::scalar,
+								   Palette::BruteForceKernel::sse, Palette::BruteForceKernel::avx2 })
+		{
+			if (! Palette::isBruteForceKernelAvailable(kernel))
+				continue;
+
+			for (auto query = 0; query < 20; query++)
+			{
+				float target[dimensions];
+				for (auto& value : target)
+					value = random.nextFloat();
+
+				auto expected = exactDistances(target);
+				std::vector<float> sorted(expected);
+				std::sort(sorted.begin(), sorted.end());
+
+				Palette::Neighbour results[8];
+				REQUIRE(Palette::findNearestBruteForce(table, target, weights, 8, results, kernel) == 8);
+
+				for (auto i = 0; i < 8; i++)
+				{
+					CHECK(results[i].distanceSquared == doctest::Approx(sorted[(size_t)i]));
+					CHECK(expected[(size_t)results[i].grain] == doctest::Approx(results[i].distanceSquared));
+				}
+			}
+		}
+	}
+
+	SUBCASE("Without weights every dimension counts equally")
+	{
+		float target[dimensions];
+		table.getRow(500, target);
+
+		Palette::Neighbour nearest;
+		REQUIRE(Palette::findNearestBruteForce(table, target, nullptr, 1, &nearest) == 1);
+		CHECK(nearest.grain == 500);
+		CHECK(nearest.distanceSquared == 0.0f);
+	}
+
+	SUBCASE("Asking for more grains than there are returns them all")
+	{
+		Palette::DescriptorTable small(dimensions, 3);
+		const float target[dimensions] = {};
+		Palette::Neighbour results[10];
+
+		CHECK(Palette::findNearestBruteForce(small, target, nullptr, 10, results) == 3);
+	}
+}
@@ -9,3 +9,236 @@
 */
 
 #include "ConcatenativeSynthesizer.h"
+
+void ConcatenativeSynthesizer::setDescriptors(const Palette::DescriptorTable& descriptors, juce::ThreadPool* pool)
+{
+	descriptorTable = descriptors;
+	successorGraph.clear();
+
+	statistics = Palette::DescriptorStatistics::measure(descriptorTable);
+	standardWeights.resize(static_cast<size_t>(getNumDimensions()));
+	statistics.getStandardWeights(standardWeights.data());
+
+	buildIndex(pool);
+}
+
+void ConcatenativeSynthesizer::getSelectionWeights(const float* descriptorWeights, float* selectionWeights) const noexcept
+{
+	for (size_t dimension = 0; dimension < standardWeights.size(); dimension++)
+		selectionWeights[dimension] = descriptorWeights[dimension] * standardWeights[dimension];
+}
+
+void ConcatenativeSynthesizer::setSuccessors(Palette::SuccessorGraph successors)
+{
+	jassert(successors.isEmpty() || successors.getNumGrains() == getNumGrains());
+	successorGraph = std::move(successors);
+}
+
+void ConcatenativeSynthesizer::setSelectionStrategy(const SelectionStrategy newStrategy, juce::ThreadPool* pool)
+{
+	if (newStrategy == strategy)
+		return;
+
+	strategy = newStrategy;
+	buildIndex(pool);
+}
+
+void ConcatenativeSynthesizer::setApproximateParameters(const Palette::HnswIndex::Parameters& parameters)
+{
+	approximateParameters = parameters;
+	approximateIndex.setSearchBreadth(parameters.searchBreadth);
+}
+
+void ConcatenativeSynthesizer::buildIndex(juce::ThreadPool* pool)
+{
+	// Only the index in use is kept, the others are emptied to save memory.
+	kdTree.build(strategy == SelectionStrategy::kdTree ? descriptorTable : Palette::DescriptorTable(), getStandardWeights());
+
+	if (strategy == SelectionStrategy::approximate)
+		approximateIndex.build(descriptorTable, approximateParameters, pool, getStandardWeights());
+	else
+		approximateIndex.build({}, approximateParameters);
+}
+
+int ConcatenativeSynthesizer::selectGrain(const float* target, const float* weights) const noexcept
+{
+	Palette::Neighbour nearest;
+	return selectGrains(target, 1, &nearest, weights) == 1 ? nearest.grain : -1;
+}
+
+int ConcatenativeSynthesizer::selectGrains(const float* target, const int k, Palette::Neighbour* results, const float* weights) const noexcept
+{
+	switch (strategy)
+	{
+	case SelectionStrategy::kdTree:
+		return kdTree.findNearest(target, k, results, getWeights(weights));
+	case SelectionStrategy::approximate:
+		return approximateIndex.findNearest(target, k, results, getWeights(weights));
+	case SelectionStrategy::bruteForce:
+		return Palette::findNearestBruteForce(descriptorTable, target, getWeights(weights), k, results);
+	}
+
+	return 0;
+}
+
+int ConcatenativeSynthesizer::selectGrainsWithinRadius(const float* target, const float radius, Palette::Neighbour* results, const int maxResults,
+	const float* weights) const noexcept
+{
+	return kdTree.findWithinRadius(target, radius, results, maxResults, getWeights(weights));
+}
+
+void ConcatenativeSynthesizer::PathLattice::prepare(const PathParameters& newParameters, const int dimensions)
+{
+	parameters = newParameters;
+	parameters.windowLength = juce::jmax(1, parameters.windowLength);
+	parameters.numCandidates = juce::jmax(1, parameters.numCandidates);
+	parameters.beamWidth = juce::jlimit(1, parameters.numCandidates, parameters.beamWidth);
+	parameters.numSuccessorCandidates = juce::jmax(0, parameters.numSuccessorCandidates);
+
+	numDimensions = dimensions;
+	maxCandidates = parameters.numCandidates + parameters.beamWidth * parameters.numSuccessorCandidates;
+
+	states.assign(static_cast<size_t>(parameters.windowLength * maxCandidates), {});
+	columnSizes.assign(static_cast<size_t>(parameters.windowLength), 0);
+	candidates.assign(static_cast<size_t>(maxCandidates), {});
+	candidateRows.assign(static_cast<size_t>(maxCandidates * dimensions), 0.0f);
+	successorRows.assign(static_cast<size_t>(parameters.beamWidth * dimensions), 0.0f);
+}
+
+int ConcatenativeSynthesizer::selectPath(const float* targets, const int numTargets, int previousGrain, PathLattice& lattice, int* path,
+	const float* weights) const noexcept
+{
+	if (getNumGrains() == 0 || numTargets <= 0)
+		return 0;
+
+	jassert(lattice.getNumDimensions() == getNumDimensions() && previousGrain < getNumGrains());
+
+	const auto windowLength = lattice.parameters.windowLength;
+	const auto dimensions = static_cast<size_t>(getNumDimensions());
+
+	for (auto windowStart = 0; windowStart < numTargets; windowStart += windowLength)
+	{
+		const auto length = juce::jmin(windowLength, numTargets - windowStart);
+
+		selectWindow(targets + static_cast<size_t>(windowStart) * dimensions, length, previousGrain, lattice, path + windowStart, getWeights(weights));
+		previousGrain = path[windowStart + length - 1];
+	}
+
+	return numTargets;
+}
+
+void ConcatenativeSynthesizer::selectWindow(const float* targets, const int numTargets, const int previousGrain, PathLattice& lattice,
+	int* path, const float* weights) const noexcept
+{
+	const auto& parameters = lattice.parameters;
+	const auto dimensions = getNumDimensions();
+	const auto offerSuccessors = ! successorGraph.isEmpty();
+
+	for (auto target = 0; target < numTargets; target++)
+	{
+		auto* column = lattice.getColumn(target);
+		const auto* previousColumn = target > 0 ? lattice.getColumn(target - 1) : nullptr;
+
+		// What each path so far would naturally carry on with, to cost the joins against.
+		const auto numPredecessors = target > 0 ? lattice.columnSizes[static_cast<size_t>(target - 1)] : (previousGrain >= 0 ? 1 : 0);
+
+		const auto getPredecessorGrain = [&](const int predecessor) { return target > 0 ? previousColumn[predecessor].grain : previousGrain; };
+
+		for (auto predecessor = 0; predecessor < numPredecessors; predecessor++)
+			getSuccessorRow(getPredecessorGrain(predecessor), lattice.successorRows.data() + static_cast<size_t>(predecessor * dimensions));
+
+		const auto* targetRow = targets + static_cast<size_t>(target * dimensions);
+		const auto numNearest = selectGrains(targetRow, parameters.numCandidates, lattice.candidates.data(), weights);
+		jassert(numNearest > 0);
+
+		// Each path's smoothest successors are candidates too, in case a good join is a little further from the target.
+		auto numCandidates = numNearest;
+
+		if (offerSuccessors)
+		{
+			for (auto predecessor = 0; predecessor < numPredecessors; predecessor++)
+			{
+				const auto grain = getPredecessorGrain(predecessor);
+				const auto* successors = successorGraph.getSuccessors(grain);
+				const auto numSuccessors = juce::jmin(successorGraph.getNumSuccessors(grain), parameters.numSuccessorCandidates);
+
+				for (auto i = 0; i < numSuccessors; i++)
+				{
+					const auto* first = lattice.candidates.data();
+
+					if (std::none_of(first, first + numCandidates, [&](const Palette::Neighbour& candidate) { return candidate.grain == successors[i]; }))
+						lattice.candidates[static_cast<size_t>(numCandidates++)] = { successors[i], 0.0f };
+				}
+			}
+		}
+
+		for (auto candidate = 0; candidate < numCandidates; candidate++)
+		{
+			auto& neighbour = lattice.candidates[static_cast<size_t>(candidate)];
+			auto* row = lattice.candidateRows.data() + static_cast<size_t>(candidate * dimensions);
+
+			descriptorTable.getRow(static_cast<size_t>(neighbour.grain), row);
+
+			// Successors weren't found by their distance from the target, so it's measured here.
+			if (candidate >= numNearest)
+			{
+				for (auto dimension = 0; dimension < dimensions; dimension++)
+					neighbour.distanceSquared += weights[dimension] * (row[dimension] - targetRow[dimension]) * (row[dimension] - targetRow[dimension]);
+			}
+
+			auto cheapest = numPredecessors > 0 ? std::numeric_limits<float>::max() : 0.0f;
+			auto cheapestPredecessor = -1;
+
+			for (auto predecessor = 0; predecessor < numPredecessors; predecessor++)
+			{
+				// Every join is measured with the same weights as the match, listed in the graph or not.
+				const auto* successor = lattice.successorRows.data() + static_cast<size_t>(predecessor * dimensions);
+				auto joinDistance = 0.0f;
+
+				for (auto dimension = 0; dimension < dimensions; dimension++)
+					joinDistance += weights[dimension] * (row[dimension] - successor[dimension]) * (row[dimension] - successor[dimension]);
+
+				const auto cost = (target > 0 ? previousColumn[predecessor].cost : 0.0f) + parameters.concatenationWeight * joinDistance;
+
+				if (cost < cheapest)
+				{
+					cheapest = cost;
+					cheapestPredecessor = predecessor;
+				}
+			}
+
+			column[candidate] = { neighbour.grain, neighbour.distanceSquared + cheapest, target > 0 ? cheapestPredecessor : -1 };
+		}
+
+		// Prune to the beam: only the cheapest paths go on to the next target.
+		auto columnSize = numCandidates;
+
+		if (columnSize > parameters.beamWidth)
+		{
+			std::nth_element(column, column + parameters.beamWidth - 1, column + columnSize,
+				[](const PathLattice::State& a, const PathLattice::State& b) { return a.cost < b.cost; });
+
+			columnSize = parameters.beamWidth;
+		}
+
+		lattice.columnSizes[static_cast<size_t>(target)] = columnSize;
+	}
+
+	// Trace the cheapest path back from the last target.
+	const auto* lastColumn = lattice.getColumn(numTargets - 1);
+	const auto lastSize = lattice.columnSizes[static_cast<size_t>(numTargets - 1)];
+	auto state = static_cast<int>(std::min_element(lastColumn, lastColumn + lastSize,
+		[](const PathLattice::State& a, const PathLattice::State& b) { return a.cost < b.cost; }) - lastColumn);
+
+	for (auto target = numTargets - 1; target >= 0; target--)
+	{
+		const auto& chosen = lattice.getColumn(target)[state];
+		path[target] = chosen.grain;
+		state = chosen.previous;
+	}
+}
+
+void ConcatenativeSynthesizer::getSuccessorRow(const int grain, float* row) const noexcept
+{
+	descriptorTable.getRow(static_cast<size_t>(juce::jmin(grain + 1, getNumGrains() - 1)), row);
+}
@@ -10,9 +10,487 @@
 
 #pragma once
 
+#include "doctest.h"
 #include "JuceHeader.h"
 
+#include "BruteForceSearch.h"
+#include "Descriptors.h"
+#include "HnswIndex.h"
+#include "KDTree.h"
+#include "SuccessorGraph.h"
+
+/*
+ * ConcatenativeSynthesizer chooses which grains of a corpus to play by finding the
+ * grains whose descriptors are nearest to a target descriptor vector (unit selection).
+ *
+ * Distances are measured in standard deviations of each descriptor across the corpus, so
+ * no descriptor outweighs the others just for its units. That's done with weights in the
+ * distance kernel rather than by rescaling the indexes, so selections can be weighted
+ * differently again every block without rebuilding anything. Every select function takes
+ * optional weights, one per dimension, as made by getSelectionWeights; without them every
+ * descriptor counts alike.
+ *
+ * Grains can be chosen one target at a time, or as a path through a sequence of targets
+ * which also weighs how smoothly each grain follows the last (see selectPath).
+ *
+ * setDescriptors and setSelectionStrategy build the selection index and must not run at the
+ * same time as a selection. Every select function is allocation free and safe to call from
+ * processBlock, but only from one thread at a time.
+ */
 class ConcatenativeSynthesizer
 {
+public:
+	/*
+	 * How grains are found. The k-d tree is exact and fastest with few descriptors.
+	 * The approximate (HNSW) graph keeps large, high dimensional corpora fast but may
+	 * occasionally miss the true nearest grain. Brute force needs no index and scans every
+	 * grain with SIMD, which is often quickest for small corpora.
+	 */
+	enum class SelectionStrategy
+	{
+		kdTree,
+		approximate,
+		bruteForce
+	};
+
+	/*
+	 * How selectPath searches. Each target is given numCandidates grains to choose from, the
+	 * nearest to it, and only the beamWidth cheapest paths so far are extended to the next.
+	 * With a successor graph, each of those paths also offers up to numSuccessorCandidates
+	 * of the grains listed as following it most smoothly.
+	 */
+	struct PathParameters
+	{
+		// The most targets whose grains are chosen together. Longer sequences are split into windows this long.
+		int windowLength = 16;
+		int numCandidates = 16;
+		int beamWidth = 8;
+		int numSuccessorCandidates = 4;
+		// How much a rough join costs relative to a poor match to the target.
+		float concatenationWeight = 0.5f;
+	};
+
+	/*
+	 * The Viterbi lattice selectPath searches in: the candidates of every target of a window,
+	 * with the cost of the cheapest path to each and where it came from. Prepare one ahead of
+	 * time for each thread which selects paths.
+	 */
+	class PathLattice
+	{
+	public:
+		PathLattice() = default;
+
+		// Allocates for windows of parameters.windowLength targets of numDimensions descriptors.
+		void prepare(const PathParameters& parameters, int numDimensions);
+
+		const PathParameters& getParameters() const noexcept { return parameters; }
+		int getNumDimensions() const noexcept { return numDimensions; }
+
+	private:
+		friend class ConcatenativeSynthesizer;
+
+		struct State
+		{
+			int grain;
+			float cost;
+			// The state of the previous target's column this path came from, or -1 for none.
+			int previous;
+		};
+
+		// Each target's column of states, one column after another, with room for every candidate.
+		State* getColumn(const int target) noexcept { return states.data() + static_cast<size_t>(target * maxCandidates); }
+
+		PathParameters parameters;
+		int numDimensions = 0;
+		// The nearest grains plus every successor the beam may offer.
+		int maxCandidates = 0;
+
+		std::vector<State> states;
+		std::vector<int> columnSizes;
+
+		// The current target's candidates, and their descriptors one row after another.
+		std::vector<Palette::Neighbour> candidates;
+		std::vector<float> candidateRows;
+		// The descriptors of the grain after each state of the previous column.
+		std::vector<float> successorRows;
+	};
+
+	ConcatenativeSynthesizer() = default;
+
+	/*
+	 * Builds the selection index over descriptors, which should have a row per grain of the
+	 * corpus being played. Targets must then have descriptors.getNumDimensions() values.
+	 * Their statistics are measured here, once. If pool is given, indexes which can be built
+	 * in parallel use it. Any successor graph is dropped, as it no longer matches.
+	 */
+	void setDescriptors(const Palette::DescriptorTable& descriptors, juce::ThreadPool* pool = nullptr);
+
+	/*
+	 * Gives selectPath a successor graph built over the current descriptors, whose listed
+	 * successors are added to each target's candidates so smooth joins are found even when
+	 * they aren't among the grains nearest the target. The graph only chooses candidates:
+	 * every join is still measured with the selection's weights, so its costs never need
+	 * to be on the same scale. An empty graph goes back to the nearest grains alone.
+	 */
+	void setSuccessors(Palette::SuccessorGraph successors);
+	const Palette::SuccessorGraph& getSuccessors() const noexcept { return successorGraph; }
+
+	// Switches strategy, building the new index over the current descriptors.
+	void setSelectionStrategy(SelectionStrategy strategy, juce::ThreadPool* pool = nullptr);
+	SelectionStrategy getSelectionStrategy() const noexcept { return strategy; }
+
+	/*
+	 * Tunes the approximate index: a larger search breadth finds the true nearest grains
+	 * more often at the cost of longer selections. Changes to anything but the search
+	 * breadth take effect the next time the index is built.
+	 */
+	void setApproximateParameters(const Palette::HnswIndex::Parameters& parameters);
+
+	int getNumDimensions() const noexcept { return descriptorTable.getNumDimensions(); }
+	int getNumGrains() const noexcept { return static_cast<int>(descriptorTable.getNumGrains()); }
+
+	const Palette::DescriptorStatistics& getStatistics() const noexcept { return statistics; }
+
+	// One weight per dimension which measures distances in standard deviations, or nullptr if there are no descriptors.
+	const float* getStandardWeights() const noexcept { return standardWeights.empty() ? nullptr : standardWeights.data(); }
+
+	/*
+	 * Combines descriptorWeights, one per dimension saying how much each descriptor matters,
+	 * with the standard weights into the selectionWeights the select functions take. In
+	 * selectPath they weigh every join just as they weigh every match, so turning all of
+	 * them up or down together never changes the path chosen. Allocation free, so weights
+	 * can follow automation from processBlock.
+	 */
+	void getSelectionWeights(const float* descriptorWeights, float* selectionWeights) const noexcept;
+
+	// The grain nearest to target, or -1 if there are no grains.
+	int selectGrain(const float* target, const float* weights = nullptr) const noexcept;
+
+	/*
+	 * Writes the k grains nearest to target into results, nearest first.
+	 * Returns how many were written.
+	 */
+	int selectGrains(const float* target, int k, Palette::Neighbour* results, const float* weights = nullptr) const noexcept;
+
+	/*
+	 * Writes up to maxResults grains within radius of target into results. The radius is in
+	 * the same weighted units as the distances. Always uses the k-d tree, so it is only
+	 * available with the kdTree strategy. Returns how many were written.
+	 */
+	int selectGrainsWithinRadius(const float* target, float radius, Palette::Neighbour* results, int maxResults,
+		const float* weights = nullptr) const noexcept;
+
+	/*
+	 * Chooses a grain for each of numTargets targets, stored one after another, into path.
+	 *
+	 * Rather than the nearest grain to each target on its own, this finds the sequence with the
+	 * lowest total cost: each grain's squared distance from its target, plus a concatenation cost
+	 * for each join of concatenationWeight times the squared distance between a grain and the
+	 * one after its predecessor. The grain after another is whatever comes next in the
+	 * descriptor table, which for a segmented corpus is what followed it in the recording,
+	 * so carrying on through the corpus is free and jumping to a dissimilar grain is not.
+	 * With a successor graph (see setSuccessors) each path's smoothest successors are
+	 * candidates for the next target too.
+	 *
+	 * The search is a Viterbi search pruned to a beam, over one window of targets at a time.
+	 * previousGrain, if not -1, is the grain played before the first target, which the first
+	 * join is costed against; each later window carries on from the last. Returns how many
+	 * grains were chosen, which is numTargets or 0 if there are no grains. Joins are weighted
+	 * like the matches to the targets.
+	 */
+	int selectPath(const float* targets, int numTargets, int previousGrain, PathLattice& lattice, int* path,
+		const float* weights = nullptr) const noexcept;
+
+private:
+	void buildIndex(juce::ThreadPool* pool);
+
+	// The weights to select with: those given, or the standard weights.
+	const float* getWeights(const float* weights) const noexcept { return weights != nullptr ? weights : getStandardWeights(); }
+
+	// Chooses the path through one window of targets, at most lattice.parameters.windowLength long.
+	void selectWindow(const float* targets, int numTargets, int previousGrain, PathLattice& lattice, int* path,
+		const float* weights) const noexcept;
+
+	// Gathers the descriptors of the grain after grain, or of grain itself if it's the last.
+	void getSuccessorRow(int grain, float* row) const noexcept;
+
+	SelectionStrategy strategy = SelectionStrategy::kdTree;
+
+	Palette::DescriptorTable descriptorTable;
+	Palette::DescriptorStatistics statistics;
+	std::vector<float> standardWeights;
+	Palette::SuccessorGraph successorGraph;
+
+	Palette::KDTree kdTree;
+	Palette::HnswIndex approximateIndex;
+	Palette::HnswIndex::Parameters approximateParameters;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ConcatenativeSynthesizer)
+};
+
+TEST_CASE("ConcatenativeSynthesizer")
+{
+	const auto dimensions = 4;
+	const auto numGrains = 500;
+
+	Palette::DescriptorTable table(dimensions, numGrains);
+	juce::Random random(3);
+
+	for (size_t grain = 0; grain < numGrains; grain++)
+		for (auto dimension = 0; dimension < dimensions; dimension++)
+			table.setValue(grain, dimension, random.nextFloat());
+
+	ConcatenativeSynthesizer synthesizer;
+	synthesizer.setDescriptors(table);
+
+	// Targeting a grain's own descriptors must select that grain.
+	const auto selectsEveryGrain = [&]() {
+		for (size_t grain = 0; grain < numGrains; grain += 7)
+		{
+			float target[dimensions];
+			table.getRow(grain, target);
+
+			if (synthesizer.selectGrain(target) != (int)grain)
+				return false;
+		}
+
+		return true;
+	};
+
+	SUBCASE("The k-d tree selects exact matches")
+	{
+		CHECK(synthesizer.getNumGrains() == numGrains);
+		CHECK(selectsEveryGrain());
+	}
+
+	SUBCASE("The approximate index selects exact matches")
+	{
+		synthesizer.setSelectionStrategy(ConcatenativeSynthesizer::SelectionStrategy::approximate);
+		CHECK(selectsEveryGrain());
+	}
+
+	SUBCASE("Brute force selects exact matches")
+	{
+		synthesizer.setSelectionStrategy(ConcatenativeSynthesizer::SelectionStrategy::bruteForce);
+		CHECK(selectsEveryGrain());
+	}
+
+	SUBCASE("Weights choose which descriptors matter without rebuilding")
+	{
+		// With only the first descriptor weighted, the grain nearest in it alone is selected.
+		const float descriptorWeights[dimensions] = { 1.0f, 0.0f, 0.0f, 0.0f };
+		float weights[dimensions];
+		synthesizer.getSelectionWeights(descriptorWeights, weights);
+
+		const float target[dimensions] = { 0.5f, 0.0f, 0.0f, 0.0f };
+		const auto* column = table.getColumn(0);
+		const auto expected = static_cast<int>(std::min_element(column, column + numGrains,
+			[](const float a, const float b) { return std::abs(a - 0.5f) < std::abs(b - 0.5f); }) - column);
+
+		CHECK(synthesizer.selectGrain(target) != expected);
+		CHECK(synthesizer.selectGrain(target, weights) == expected);
+
+		synthesizer.setSelectionStrategy(ConcatenativeSynthesizer::SelectionStrategy::bruteForce);
+		CHECK(synthesizer.selectGrain(target, weights) == expected);
+	}
+
+	SUBCASE("Nothing is selected without descriptors")
+	{
+		ConcatenativeSynthesizer empty;
+		const float target[dimensions] = {};
+
+		CHECK(empty.selectGrain(target) == -1);
+
+		ConcatenativeSynthesizer::PathLattice lattice;
+		lattice.prepare({}, dimensions);
+		int path[1] = { -1 };
+
+		CHECK(empty.selectPath(target, 1, -1, lattice, path) == 0);
+	}
+}
+
+TEST_CASE("ConcatenativeSynthesizer paths")
+{
+	/*
+	 * Two takes of the same rising line, one a hair above the other, one grain per step. The
+	 * targets follow the line but wobble to just nearer the second take every other step, so
+	 * the nearest grain hops back and forth while a path should stay with one take.
+	 */
+	const auto numSteps = 40;
+	Palette::DescriptorTable table(1, numSteps * 2);
+
+	for (auto step = 0; step < numSteps; step++)
+	{
+		table.setValue(static_cast<size_t>(step), 0, static_cast<float>(step));
+		table.setValue(static_cast<size_t>(numSteps + step), 0, step + 0.02f);
+	}
+
+	std::vector<float> targets(static_cast<size_t>(numSteps));
+	for (auto step = 0; step < numSteps; step++)
+		targets[static_cast<size_t>(step)] = step + (step % 2 == 0 ? 0.0f : 0.012f);
+
+	ConcatenativeSynthesizer synthesizer;
+	synthesizer.setDescriptors(table);
+
+	ConcatenativeSynthesizer::PathParameters parameters;
+	parameters.windowLength = 8;
+
+	ConcatenativeSynthesizer::PathLattice lattice;
+	lattice.prepare(parameters, 1);
+
+	std::vector<int> path(static_cast<size_t>(numSteps));
+	REQUIRE(synthesizer.selectPath(targets.data(), numSteps, -1, lattice, path.data()) == numSteps);
+
+	const auto countTakeChanges = [](const std::vector<int>& grains) {
+		auto changes = 0;
+		for (size_t i = 1; i < grains.size(); i++)
+			changes += (grains[i - 1] < numSteps) != (grains[i] < numSteps) ? 1 : 0;
+		return changes;
+	};
+
+	SUBCASE("Nearest grains hop between the takes")
+	{
+		std::vector<int> nearest(static_cast<size_t>(numSteps));
+		for (auto step = 0; step < numSteps; step++)
+			nearest[static_cast<size_t>(step)] = synthesizer.selectGrain(targets.data() + step);
+
+		CHECK(countTakeChanges(nearest) == numSteps - 1);
+	}
+
+	SUBCASE("A path follows one take through every window")
+	{
+		CHECK(countTakeChanges(path) == 0);
+
+		for (auto step = 0; step < numSteps; step++)
+			CHECK(path[static_cast<size_t>(step)] % numSteps == step);
+	}
+
+	SUBCASE("The first join is costed against the grain played before")
+	{
+		int grain = -1;
+
+		// On its own the second take is nearer, but the first carries on from grain 4.
+		const auto target = 5.012f;
+		REQUIRE(synthesizer.selectGrain(&target) == numSteps + 5);
+
+		synthesizer.selectPath(&target, 1, 4, lattice, &grain);
+		CHECK(grain == 5);
+	}
+
+	SUBCASE("A successor graph only adds candidates")
+	{
+		// Each take's next step is already among the nearest grains, so offering it again changes nothing.
+		Palette::SuccessorGraph graph;
+		graph.build(table, 3, nullptr, synthesizer.getStandardWeights());
+		synthesizer.setSuccessors(std::move(graph));
+
+		std::vector<int> lookedUp(static_cast<size_t>(numSteps));
+		synthesizer.selectPath(targets.data(), numSteps, -1, lattice, lookedUp.data());
+
+		CHECK(lookedUp == path);
+
+		// And new descriptors leave it behind.
+		synthesizer.setDescriptors(table);
+		CHECK(synthesizer.getSuccessors().isEmpty());
+	}
+
+	SUBCASE("Listed and unlisted joins are weighed alike")
+	{
+		// Three descriptors weighted far above their standard deviations, so the graph's costs would undercut measured ones.
+		const auto numGrains = 10;
+		const auto numTargets = 3;
+		Palette::DescriptorTable grains(3, numGrains);
+		juce::Random random(11);
+
+		for (auto grain = 0; grain < numGrains; grain++)
+			for (auto dimension = 0; dimension < 3; dimension++)
+				grains.setValue(static_cast<size_t>(grain), dimension, random.nextFloat() * static_cast<float>(dimension + 1));
+
+		std::vector<float> pathTargets(static_cast<size_t>(numTargets * 3));
+
+		const float weights[3] = { 240.0f, 60.0f, 30.0f };
+
+		ConcatenativeSynthesizer weighted;
+		weighted.setDescriptors(grains);
+
+		Palette::SuccessorGraph graph;
+		graph.build(grains, 2, nullptr, weighted.getStandardWeights());
+		weighted.setSuccessors(std::move(graph));
+
+		const auto distance = [&](const float* a, const float* b) {
+			auto sum = 0.0f;
+			for (auto dimension = 0; dimension < 3; dimension++)
+				sum += weights[dimension] * (a[dimension] - b[dimension]) * (a[dimension] - b[dimension]);
+			return sum;
+		};
+
+		const auto getCost = [&](const int* grainsChosen) {
+			float row[3], successor[3];
+			auto cost = 0.0f;
+
+			for (auto target = 0; target < numTargets; target++)
+			{
+				grains.getRow(static_cast<size_t>(grainsChosen[target]), row);
+				cost += distance(row, pathTargets.data() + target * 3);
+
+				if (target > 0)
+				{
+					grains.getRow(static_cast<size_t>(juce::jmin(grainsChosen[target - 1] + 1, numGrains - 1)), successor);
+					cost += parameters.concatenationWeight * distance(row, successor);
+				}
+			}
+
+			return cost;
+		};
+
+		// Every grain is a candidate and every path stays in the beam, so the search is exact.
+		parameters.numCandidates = numGrains;
+		parameters.beamWidth = numGrains;
+		parameters.concatenationWeight = 4.0f;
+		lattice.prepare(parameters, 3);
+
+		for (auto trial = 0; trial < 20; trial++)
+		{
+			for (auto& value : pathTargets)
+				value = random.nextFloat() * 2.0f;
+
+			int chosen[numTargets];
+			REQUIRE(weighted.selectPath(pathTargets.data(), numTargets, -1, lattice, chosen, weights) == numTargets);
+
+			auto cheapest = std::numeric_limits<float>::max();
+			for (auto a = 0; a < numGrains; a++)
+				for (auto b = 0; b < numGrains; b++)
+					for (auto c = 0; c < numGrains; c++)
+					{
+						const int each[numTargets] = { a, b, c };
+						cheapest = juce::jmin(cheapest, getCost(each));
+					}
+
+			CHECK(getCost(chosen) == doctest::Approx(cheapest));
+
+			// However the descriptors are weighted overall, joins weigh the same against matches, so the path stays put.
+			float quiet[3], loud[3];
+			const float quietDescriptors[3] = { 0.1f, 0.1f, 0.1f };
+			const float loudDescriptors[3] = { 30.0f, 30.0f, 30.0f };
+			weighted.getSelectionWeights(quietDescriptors, quiet);
+			weighted.getSelectionWeights(loudDescriptors, loud);
+
+			int quietPath[numTargets], loudPath[numTargets];
+			weighted.selectPath(pathTargets.data(), numTargets, -1, lattice, quietPath, quiet);
+			weighted.selectPath(pathTargets.data(), numTargets, -1, lattice, loudPath, loud);
+
+			CHECK(std::equal(quietPath, quietPath + numTargets, loudPath));
+		}
+	}
+
+	SUBCASE("A beam of one is still a path")
+	{
+		parameters.beamWidth = 1;
+		lattice.prepare(parameters, 1);
+
+		std::vector<int> narrow(static_cast<size_t>(numSteps));
+		synthesizer.selectPath(targets.data(), numSteps, -1, lattice, narrow.data());
 
-};
\ No newline at end of file
+		CHECK(countTakeChanges(narrow) == 0);
+	}
+}
@@ -0,0 +1,256 @@
+/*
+  ==============================================================================
+
+    Corpus.h
+    Created: 16 Oct 2026 6:09:13pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+#include "ConcatenativeSynthesizer.h"
+#include "Descriptors.h"
+#include "Grain.h"
+#include "OnsetSegmenter.h"
+
+namespace Palette
+{
+	/*
+	 * A Corpus is the body of sound a concatenative synthesizer selects from.
+	 * It holds one contiguous buffer of audio which is never reallocated after construction,
+	 * and the grains segmented from it are views into that buffer rather than copies.
+	 *
+	 * Because grains point at the buffer a Corpus can't be copied or moved once built,
+	 * so it should live behind a pointer (e.g. std::shared_ptr) for as long as it's used.
+	 */
+	template <typename SampleType>
+	class Corpus
+	{
+	public:
+		Corpus(juce::AudioBuffer<SampleType>&& audioData, double audioSampleRate)
+			: Corpus(std::make_shared<const juce::AudioBuffer<SampleType>>(std::move(audioData)), audioSampleRate) { }
+
+		/*
+		 * Makes a corpus of audio which may be shared with other corpora, such as the
+		 * snapshots CorpusLoader hands out while a file is still loading.
+		 */
+		Corpus(std::shared_ptr<const juce::AudioBuffer<SampleType>> sharedAudio, double audioSampleRate)
+			: audio(std::move(sharedAudio)), sampleRate(audioSampleRate)
+		{
+			jassert(audio != nullptr);
+		}
+
+		/*
+		 * Splits the corpus audio into grains of grainLength miliseconds.
+		 * Replaces any grains (and their descriptors) from a previous call. This doesn't touch
+		 * the audio so it is cheap enough to call again whenever the grain length changes.
+		 */
+		void segment(const double grainLength)
+		{
+			grains = createGrains(*audio, grainLength, sampleRate);
+			clearDescriptors();
+		}
+
+		/*
+		 * Splits the corpus audio into overlapping, windowed grains of grainLength miliseconds
+		 * which start hopLength miliseconds apart.
+		 */
+		void segment(const double grainLength, const double hopLength, const WindowType windowType)
+		{
+			grains = createGrains(*audio, grainLength, sampleRate, hopLength, windowType);
+			clearDescriptors();
+		}
+
+		/*
+		 * Splits the corpus audio into variable length grains which each start at an onset.
+		 */
+		void segmentAtOnsets(const OnsetSegmenter::Parameters& parameters = {})
+		{
+			grains = createGrainsAtOnsets(*audio, sampleRate, parameters);
+			clearDescriptors();
+		}
+
+		/*
+		 * Replaces the grains with ones segmented elsewhere, which must all be views into getAudio().
+		 */
+		void setGrains(std::vector<Grain<SampleType>> newGrains)
+		{
+			jassert(std::all_of(newGrains.begin(), newGrains.end(), [this](const auto& grain) { return grain.source == audio.get(); }));
+
+			grains = std::move(newGrains);
+			clearDescriptors();
+		}
+
+		/*
+		 * Computes the descriptors of every grain from the last segment call, and builds
+		 * getSelection() over them, so there's something for unit selection to choose grains
+		 * by, along with the graph of each grain's smoothest successors, costed in standard
+		 * deviations like the selection. The work is shared between the threads of pool and
+		 * the calling thread.
+		 *
+		 * shouldStop, if given, is polled as the grains are analysed. If it returns true the
+		 * analysis is abandoned, leaving no descriptors, and this returns false.
+		 */
+		bool analyse(juce::ThreadPool& pool, const std::function<bool()>& shouldStop = nullptr)
+		{
+			const auto stopped = [&shouldStop] { return shouldStop != nullptr && shouldStop(); };
+
+			descriptors = analyseGrains(grains, sampleRate, pool, 64, shouldStop);
+
+			if (! stopped())
+			{
+				selection.setDescriptors(descriptors, &pool);
+
+				SuccessorGraph successors;
+				successors.build(descriptors, successorsPerGrain, &pool, selection.getStandardWeights(), shouldStop);
+				selection.setSuccessors(std::move(successors));
+			}
+
+			if (stopped())
+			{
+				clearDescriptors();
+				return false;
+			}
+
+			return true;
+		}
+
+		// analyse() on a temporary pool with a thread for every CPU.
+		bool analyse(const std::function<bool()>& shouldStop = nullptr)
+		{
+			juce::ThreadPool pool(juce::SystemStats::getNumCpus());
+			return analyse(pool, shouldStop);
+		}
+
+		/*
+		 * Sets descriptors and a successor graph computed elsewhere, such as ones loaded from a
+		 * CorpusCache. Both must cover every grain.
+		 */
+		void setDescriptors(DescriptorTable newDescriptors, SuccessorGraph successors)
+		{
+			jassert(newDescriptors.getNumGrains() == grains.size());
+			descriptors = std::move(newDescriptors);
+			selection.setDescriptors(descriptors);
+			selection.setSuccessors(std::move(successors));
+		}
+
+		const juce::AudioBuffer<SampleType>& getAudio() const noexcept { return *audio; }
+		const std::shared_ptr<const juce::AudioBuffer<SampleType>>& getSharedAudio() const noexcept { return audio; }
+		const std::vector<Grain<SampleType>>& getGrains() const noexcept { return grains; }
+		// One row per grain, in the same order as getGrains(). Empty until analyse() is called.
+		const DescriptorTable& getDescriptors() const noexcept { return descriptors; }
+		/*
+		 * Selects grains by their descriptors. Selecting is read only, but it isn't safe from
+		 * more than one thread at a time, so only the audio thread should use it.
+		 */
+		const ConcatenativeSynthesizer& getSelection() const noexcept { return selection; }
+		// Each grain's smoothest successors, for choosing paths through the corpus. Empty until analyse() is called.
+		const SuccessorGraph& getSuccessors() const noexcept { return selection.getSuccessors(); }
+		double getSampleRate() const noexcept { return sampleRate; }
+
+		// How many successors analyse() lists for each grain.
+		static constexpr int successorsPerGrain = 16;
+
+	private:
+		void clearDescriptors()
+		{
+			descriptors = {};
+			selection.setDescriptors(descriptors);
+		}
+
+		// The audio every grain refers to. It is const so it can never be reallocated under a grain.
+		const std::shared_ptr<const juce::AudioBuffer<SampleType>> audio;
+		const double sampleRate;
+
+		std::vector<Grain<SampleType>> grains;
+		DescriptorTable descriptors;
+		ConcatenativeSynthesizer selection;
+
+		JUCE_DECLARE_NON_COPYABLE(Corpus)
+	};
+}
+
+TEST_CASE("Corpus")
+{
+	const auto sampleRate = 1000.0;
+
+	// 2 channels of 2500 samples, where each sample holds its own index.
+	juce::AudioBuffer<float> audio(2, 2500);
+	for (auto ch = 0; ch < audio.getNumChannels(); ch++)
+		for (auto i = 0; i < audio.getNumSamples(); i++)
+			audio.setSample(ch, i, (float)i);
+
+	auto corpus = std::make_shared<Palette::Corpus<float>>(std::move(audio), sampleRate);
+
+	SUBCASE("Segmenting views the corpus buffer without copying")
+	{
+		corpus->segment(1000);
+
+		const auto& grains = corpus->getGrains();
+		REQUIRE(grains.size() == 3);
+
+		for (const auto& grain : grains)
+		{
+			CHECK(grain.source == &corpus->getAudio());
+			CHECK(grain.getNumChannels() == 2);
+			CHECK(grain.getReadPointer(1)[0] == (float)grain.startSample);
+		}
+
+		CHECK(grains[1].getReadPointer(0) == corpus->getAudio().getReadPointer(0, 1000));
+		CHECK(grains[2].getNumSamples() == 500);
+	}
+
+	SUBCASE("Audio which divides evenly into grains has no short grain")
+	{
+		corpus->segment(500);
+
+		CHECK(corpus->getGrains().size() == 5);
+		CHECK(corpus->getGrains().back().getNumSamples() == 500);
+	}
+
+	SUBCASE("Re-segmenting replaces the previous grains")
+	{
+		corpus->segment(1000);
+		corpus->segment(0);
+
+		CHECK(corpus->getGrains().empty());
+	}
+
+	SUBCASE("Corpora can share audio and be given grains segmented elsewhere")
+	{
+		auto snapshot = std::make_shared<Palette::Corpus<float>>(corpus->getSharedAudio(), sampleRate);
+		snapshot->setGrains(Palette::createGrains(snapshot->getAudio(), 500, sampleRate));
+
+		CHECK(&snapshot->getAudio() == &corpus->getAudio());
+		CHECK(snapshot->getGrains().size() == 5);
+	}
+
+	SUBCASE("Analysing gives every grain a row of descriptors")
+	{
+		corpus->segment(1000);
+		corpus->analyse();
+
+		CHECK(corpus->getDescriptors().getNumGrains() == corpus->getGrains().size());
+		CHECK(corpus->getDescriptors().getNumDimensions() == Palette::numDescriptors);
+		CHECK(corpus->getSuccessors().getNumGrains() == static_cast<int>(corpus->getGrains().size()));
+
+		// Every grain is the one selected for its own descriptors.
+		std::array<float, Palette::numDescriptors> row;
+		for (size_t grain = 0; grain < corpus->getGrains().size(); grain++)
+		{
+			corpus->getDescriptors().getRow(grain, row.data());
+			CHECK(corpus->getSelection().selectGrain(row.data()) == static_cast<int>(grain));
+		}
+
+		// Re-segmenting throws away descriptors which no longer match the grains.
+		corpus->segment(500);
+		CHECK(corpus->getDescriptors().getNumGrains() == 0);
+		CHECK(corpus->getSelection().selectGrain(row.data()) == -1);
+		CHECK(corpus->getSuccessors().isEmpty());
+	}
+}
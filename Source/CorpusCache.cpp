@@ -0,0 +1,412 @@
+/*
+  ==============================================================================
+
+    CorpusCache.cpp
+    Created: 16 Oct 2026 6:41:54pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#include "CorpusCache.h"
+
+namespace Palette
+{
+	namespace
+	{
+		constexpr char magic[8] = { 'P', 'A', 'L', 'E', 'T', 'T', 'E', 'C' };
+		constexpr juce::int64 sectionAlignment = 64;
+
+		constexpr char fileExtension[] = ".palettecorpus";
+
+		// How much is written or hashed between checks for stopping.
+		constexpr juce::int64 samplesPerWrite = 1 << 20;
+		constexpr size_t bytesPerHash = 1 << 22;
+
+		constexpr juce::uint32 hasAudioFlag = 1;
+		constexpr juce::uint32 hasSuccessorsFlag = 2;
+
+		struct Header
+		{
+			char magic[8];
+			juce::uint32 version;
+			juce::uint32 flags;
+			juce::uint64 sourceHash;
+			juce::uint64 settingsHash;
+			double sampleRate;
+			juce::int64 numSamples;
+			juce::int32 numChannels;
+			juce::int32 numDimensions;
+			juce::int64 numGrains;
+			juce::int64 grainTableOffset;
+			juce::int64 descriptorOffset;
+			// Floats between the start of one descriptor column and the next.
+			juce::int64 columnStride;
+			// The successor graph's offsets, then its successors and costs, each in a section of its own.
+			juce::int64 successorOffset;
+			juce::int64 numEdges;
+			juce::int64 audioOffset;
+			// Floats between the start of one audio channel and the next.
+			juce::int64 channelStride;
+			juce::int64 fileSize;
+		};
+
+		struct GrainRecord
+		{
+			juce::int32 startSample;
+			juce::int32 numSamples;
+			juce::int32 startChannel;
+			juce::int32 numChannels;
+			juce::int32 windowType;
+			juce::int32 windowLength;
+		};
+
+		constexpr juce::int64 alignUp(const juce::int64 value, const juce::int64 alignment) noexcept
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		bool writePadding(juce::OutputStream& stream, const juce::int64 alignment)
+		{
+			const char zeros[sectionAlignment] = {};
+			const auto position = stream.getPosition();
+			return stream.write(zeros, static_cast<size_t>(alignUp(position, alignment) - position));
+		}
+
+		// The bytes a section of numValues 4 byte values takes up, padding included.
+		constexpr juce::int64 getSectionSize(const juce::int64 numValues) noexcept
+		{
+			return alignUp(numValues * 4, sectionAlignment);
+		}
+
+		// Keeps a cache's mapping alive alongside the buffer which refers to its audio.
+		struct MappedCacheAudio
+		{
+			std::unique_ptr<juce::MemoryMappedFile> mapping;
+			std::vector<float*> channels;
+			std::unique_ptr<const juce::AudioBuffer<float>> audio;
+		};
+	}
+
+	CorpusCache::CorpusCache(const juce::File& cacheDirectory)
+		: directory(cacheDirectory) { }
+
+	juce::File CorpusCache::getFile(const Key& key) const
+	{
+		return directory.getChildFile(juce::String::toHexString(static_cast<juce::int64>(key.source)) + "_"
+			+ juce::String::toHexString(static_cast<juce::int64>(key.settings)) + fileExtension);
+	}
+
+	bool CorpusCache::store(const Key& key, const Corpus<float>& corpus, const bool includeAudio, const std::function<bool()>& shouldStop) const
+	{
+		// The file is written as this machine holds it in memory, so must be little endian to match the format.
+	   #if JUCE_BIG_ENDIAN
+		return false;
+	   #endif
+
+		const auto& audio = corpus.getAudio();
+		const auto& grains = corpus.getGrains();
+		const auto& descriptors = corpus.getDescriptors();
+		const auto& successors = corpus.getSuccessors();
+		const auto hasSuccessors = ! grains.empty() && successors.getNumGrains() == static_cast<int>(grains.size());
+
+		Header header {};
+		std::copy(std::begin(magic), std::end(magic), header.magic);
+		header.version = formatVersion;
+		header.flags = (includeAudio ? hasAudioFlag : 0) | (hasSuccessors ? hasSuccessorsFlag : 0);
+		header.sourceHash = key.source;
+		header.settingsHash = key.settings;
+		header.sampleRate = corpus.getSampleRate();
+		header.numSamples = audio.getNumSamples();
+		header.numChannels = audio.getNumChannels();
+		header.numDimensions = descriptors.getNumDimensions();
+		header.numGrains = static_cast<juce::int64>(grains.size());
+
+		header.grainTableOffset = alignUp(sizeof(Header), sectionAlignment);
+		header.descriptorOffset = alignUp(header.grainTableOffset + header.numGrains * static_cast<juce::int64>(sizeof(GrainRecord)), sectionAlignment);
+		header.columnStride = alignUp(static_cast<juce::int64>(descriptors.getNumGrains()), sectionAlignment / static_cast<juce::int64>(sizeof(float)));
+		header.successorOffset = alignUp(header.descriptorOffset + header.numDimensions * header.columnStride * static_cast<juce::int64>(sizeof(float)), sectionAlignment);
+		header.numEdges = hasSuccessors ? successors.getNumEdges() : 0;
+		header.audioOffset = header.successorOffset + (hasSuccessors ? getSectionSize(header.numGrains + 1) + 2 * getSectionSize(header.numEdges) : 0);
+		header.channelStride = includeAudio ? alignUp(header.numSamples, sectionAlignment / static_cast<juce::int64>(sizeof(float))) : 0;
+		header.fileSize = header.audioOffset + header.numChannels * header.channelStride * static_cast<juce::int64>(sizeof(float));
+
+		if (! directory.createDirectory())
+			return false;
+
+		const auto file = getFile(key);
+		const auto partialFile = file.getSiblingFile(file.getFileName() + ".partial");
+		partialFile.deleteFile();
+
+		{
+			juce::FileOutputStream stream(partialFile);
+
+			if (! stream.openedOk())
+				return false;
+
+			auto ok = stream.write(&header, sizeof(Header)) && writePadding(stream, sectionAlignment);
+
+			// Windows are stored by what they are rather than where, since a pointer means nothing in a file.
+			const float* lastWindow = nullptr;
+			auto windowType = WindowType::rectangular;
+			auto windowLength = 0;
+
+			for (const auto& grain : grains)
+			{
+				if (grain.window != lastWindow && ! findWindowTable(grain.window, windowType, windowLength))
+					ok = false;
+
+				lastWindow = grain.window;
+
+				const GrainRecord record { grain.startSample, grain.numSamples, grain.startChannel, grain.numChannels,
+					static_cast<juce::int32>(windowType), windowLength };
+				ok = ok && stream.write(&record, sizeof(GrainRecord));
+			}
+
+			ok = ok && writePadding(stream, sectionAlignment);
+
+			for (auto dimension = 0; dimension < header.numDimensions; dimension++)
+			{
+				ok = ok && stream.write(descriptors.getColumn(dimension), descriptors.getNumGrains() * sizeof(float));
+				ok = ok && writePadding(stream, sectionAlignment);
+			}
+
+			if (hasSuccessors)
+			{
+				static_assert(sizeof(int) == 4 && sizeof(float) == 4, "The successor graph is stored as 4 byte values");
+
+				ok = ok && stream.write(successors.getOffsets().data(), successors.getOffsets().size() * sizeof(int)) && writePadding(stream, sectionAlignment);
+				ok = ok && stream.write(successors.getSuccessorArray().data(), successors.getSuccessorArray().size() * sizeof(int)) && writePadding(stream, sectionAlignment);
+				ok = ok && stream.write(successors.getCostArray().data(), successors.getCostArray().size() * sizeof(float)) && writePadding(stream, sectionAlignment);
+			}
+
+			// Audio is by far the biggest section, so it's written a piece at a time to check for stopping between.
+			if (includeAudio)
+			{
+				for (auto channel = 0; channel < header.numChannels; channel++)
+				{
+					for (juce::int64 start = 0; ok && start < header.numSamples; start += samplesPerWrite)
+					{
+						ok = (shouldStop == nullptr || ! shouldStop())
+							&& stream.write(audio.getReadPointer(channel, static_cast<int>(start)),
+								static_cast<size_t>(juce::jmin(samplesPerWrite, header.numSamples - start)) * sizeof(float));
+					}
+
+					ok = ok && writePadding(stream, sectionAlignment);
+				}
+			}
+
+			stream.flush();
+
+			if (! ok || stream.getPosition() != header.fileSize)
+			{
+				partialFile.deleteFile();
+				return false;
+			}
+		}
+
+		return partialFile.moveFileTo(file);
+	}
+
+	std::shared_ptr<Corpus<float>> CorpusCache::load(const Key& key, const double maxGrainLength, std::shared_ptr<const juce::AudioBuffer<float>> audio) const
+	{
+	   #if JUCE_BIG_ENDIAN
+		return nullptr;
+	   #endif
+
+		const auto file = getFile(key);
+
+		if (! file.existsAsFile())
+			return nullptr;
+
+		auto mapping = std::make_unique<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readOnly);
+		const auto* data = static_cast<const char*>(mapping->getData());
+		const auto size = static_cast<juce::int64>(mapping->getSize());
+
+		if (data == nullptr || size < static_cast<juce::int64>(sizeof(Header)))
+			return nullptr;
+
+		Header header;
+		std::memcpy(&header, data, sizeof(Header));
+
+		if (! std::equal(std::begin(magic), std::end(magic), header.magic)
+			|| header.version != formatVersion
+			|| header.sourceHash != key.source
+			|| header.settingsHash != key.settings
+			|| header.fileSize != size
+			|| header.numSamples < 0 || header.numSamples > std::numeric_limits<int>::max()
+			|| header.numChannels < 0 || header.numDimensions < 0 || header.numGrains < 0
+			|| header.grainTableOffset + header.numGrains * static_cast<juce::int64>(sizeof(GrainRecord)) > size
+			|| header.descriptorOffset + header.numDimensions * header.columnStride * static_cast<juce::int64>(sizeof(float)) > size
+			|| header.numEdges < 0 || header.numEdges > std::numeric_limits<int>::max()
+			|| ((header.flags & hasSuccessorsFlag) != 0
+				&& header.successorOffset + getSectionSize(header.numGrains + 1) + 2 * getSectionSize(header.numEdges) > size)
+			|| (header.numDimensions > 0 && header.columnStride < header.numGrains))
+			return nullptr;
+
+		const auto hasAudio = (header.flags & hasAudioFlag) != 0;
+
+		if (hasAudio)
+		{
+			if (header.channelStride < header.numSamples
+				|| header.audioOffset + header.numChannels * header.channelStride * static_cast<juce::int64>(sizeof(float)) > size)
+				return nullptr;
+
+			auto mapped = std::make_shared<MappedCacheAudio>();
+
+			for (auto channel = 0; channel < header.numChannels; channel++)
+			{
+				auto* samples = reinterpret_cast<float*>(const_cast<char*>(data + header.audioOffset)) + channel * header.channelStride;
+				mapped->channels.push_back(samples);
+
+				// Fault every page in now, so the audio thread never has to.
+				for (juce::int64 sample = 0; sample < header.numSamples; sample += 1024)
+				{
+					const auto touched = *static_cast<volatile const float*>(samples + sample);
+					juce::ignoreUnused(touched);
+				}
+			}
+
+			mapped->audio = std::make_unique<const juce::AudioBuffer<float>>(mapped->channels.data(), header.numChannels, static_cast<int>(header.numSamples));
+
+			// The descriptors and grain table are read below through data, which this keeps mapped too.
+			mapped->mapping = std::move(mapping);
+			audio = std::shared_ptr<const juce::AudioBuffer<float>>(mapped, mapped->audio.get());
+		}
+		else if (audio == nullptr || audio->getNumSamples() != header.numSamples || audio->getNumChannels() != header.numChannels)
+		{
+			return nullptr;
+		}
+
+		auto corpus = std::make_shared<Corpus<float>>(audio, header.sampleRate);
+
+		const auto* records = reinterpret_cast<const GrainRecord*>(data + header.grainTableOffset);
+		const auto maxGrainSamples = static_cast<juce::int64>(std::ceil(header.sampleRate * maxGrainLength / 1000.0));
+		std::vector<Grain<float>> grains;
+		grains.reserve(static_cast<size_t>(header.numGrains));
+
+		for (juce::int64 i = 0; i < header.numGrains; i++)
+		{
+			const auto& record = records[i];
+
+			if (record.startSample < 0 || record.numSamples < 0 || record.startSample > header.numSamples - record.numSamples
+				|| record.startChannel < 0 || record.numChannels < 0 || record.startChannel > header.numChannels - record.numChannels
+				|| record.windowType < 0 || record.windowType > static_cast<juce::int32>(WindowType::tukey)
+				|| record.numSamples > maxGrainSamples
+				|| (record.windowType != static_cast<juce::int32>(WindowType::rectangular)
+					&& (record.windowLength < record.numSamples || record.windowLength > maxGrainSamples)))
+				return nullptr;
+
+			const auto* window = getWindowTable<float>(static_cast<WindowType>(record.windowType), record.windowLength);
+			grains.emplace_back(*audio, record.startSample, record.numSamples, record.startChannel, record.numChannels, window);
+		}
+
+		corpus->setGrains(std::move(grains));
+
+		// Corpora which weren't analysed were stored without descriptors.
+		if (header.numDimensions > 0)
+		{
+			DescriptorTable descriptors(header.numDimensions, static_cast<size_t>(header.numGrains));
+			const auto* columns = reinterpret_cast<const float*>(data + header.descriptorOffset);
+
+			for (auto dimension = 0; dimension < header.numDimensions; dimension++)
+				std::copy_n(columns + dimension * header.columnStride, header.numGrains, descriptors.getColumn(dimension));
+
+			SuccessorGraph successors;
+
+			if ((header.flags & hasSuccessorsFlag) != 0)
+			{
+				const auto* offsets = reinterpret_cast<const int*>(data + header.successorOffset);
+				const auto* successorArray = reinterpret_cast<const int*>(data + header.successorOffset + getSectionSize(header.numGrains + 1));
+				const auto* costArray = reinterpret_cast<const float*>(data + header.successorOffset + getSectionSize(header.numGrains + 1)
+					+ getSectionSize(header.numEdges));
+
+				if (! successors.assign(static_cast<int>(header.numGrains),
+						std::vector<int>(offsets, offsets + header.numGrains + 1),
+						std::vector<int>(successorArray, successorArray + header.numEdges),
+						std::vector<float>(costArray, costArray + header.numEdges)))
+					return nullptr;
+			}
+
+			corpus->setDescriptors(std::move(descriptors), std::move(successors));
+		}
+
+		file.setLastModificationTime(juce::Time::getCurrentTime());
+		return corpus;
+	}
+
+	int CorpusCache::trim(const juce::int64 maxBytes, const Key& keep) const
+	{
+		const auto keepFile = getFile(keep);
+		auto files = directory.findChildFiles(juce::File::findFiles, false, juce::String("*") + fileExtension);
+
+		// Most recently used first, so everything after the point the total passes maxBytes goes.
+		std::sort(files.begin(), files.end(), [](const juce::File& a, const juce::File& b) {
+			return a.getLastModificationTime() > b.getLastModificationTime();
+		});
+
+		auto totalBytes = keepFile.getSize();
+		auto numDeleted = 0;
+
+		for (const auto& file : files)
+		{
+			if (file == keepFile)
+				continue;
+
+			const auto size = file.getSize();
+			totalBytes += size;
+
+			if (totalBytes > maxBytes && file.deleteFile())
+			{
+				totalBytes -= size;
+				numDeleted++;
+			}
+		}
+
+		return numDeleted;
+	}
+
+	juce::uint64 CorpusCache::hashBytes(const void* data, const size_t numBytes, juce::uint64 seed)
+	{
+		// FNV-1a, a word at a time rather than a byte at a time so that whole files hash quickly.
+		constexpr juce::uint64 prime = 1099511628211ull;
+
+		const auto* bytes = static_cast<const char*>(data);
+		size_t i = 0;
+
+		for (; i + sizeof(juce::uint64) <= numBytes; i += sizeof(juce::uint64))
+		{
+			juce::uint64 word;
+			std::memcpy(&word, bytes + i, sizeof(word));
+			seed = (seed ^ word) * prime;
+		}
+
+		for (; i < numBytes; i++)
+			seed = (seed ^ static_cast<juce::uint8>(bytes[i])) * prime;
+
+		return seed;
+	}
+
+	juce::uint64 CorpusCache::hashFile(const juce::File& file, const std::function<bool()>& shouldStop)
+	{
+		const auto size = file.getSize();
+		auto hash = hashBytes(&size, sizeof(size));
+
+		if (size == 0)
+			return hash;
+
+		const juce::MemoryMappedFile mapping(file, juce::MemoryMappedFile::readOnly);
+		const auto* data = static_cast<const char*>(mapping.getData());
+
+		// Hashing continues from where it left off, so hashing a piece at a time gives the same hash as all at once.
+		for (size_t start = 0; start < mapping.getSize(); start += bytesPerHash)
+		{
+			if (shouldStop != nullptr && shouldStop())
+				return 0;
+
+			hash = hashBytes(data + start, juce::jmin(bytesPerHash, mapping.getSize() - start), hash);
+		}
+
+		return hash;
+	}
+}
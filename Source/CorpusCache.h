@@ -0,0 +1,268 @@
+/*
+  ==============================================================================
+
+    CorpusCache.h
+    Created: 16 Oct 2026 6:41:54pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+#include "Corpus.h"
+
+namespace Palette
+{
+	/*
+	 * CorpusCache keeps segmented and analysed corpora on disk, so a library only has to be
+	 * decoded, segmented and analysed once. Each corpus is stored in its own file, named after
+	 * a hash of its source file and a hash of the settings it was segmented and analysed with.
+	 *
+	 * A cache file is laid out as below. Everything is little endian and every section starts
+	 * on a 64 byte boundary, so it can be used straight from a memory mapping:
+	 *
+	 *     header              - format version, keys, sample rate and the offset of every section
+	 *     grain table         - start, length, channels and window of every grain
+	 *     descriptor columns  - one column of floats per descriptor, as DescriptorTable holds them
+	 *     successor graph     - SuccessorGraph's offsets, successors and costs, each its own section
+	 *     audio (optional)    - each channel's samples as floats, one channel after the other
+	 *
+	 * Loading maps the file. Cached audio is used in place without being read, so a warm start
+	 * costs about as much as the grain table, descriptors and successor graph are big.
+	 *
+	 * Cached audio is as big as the source file decoded to floats, so trim() keeps the cache
+	 * to a size by deleting the corpora used least recently.
+	 */
+	class CorpusCache
+	{
+	public:
+		struct Key
+		{
+			// A hash of the source file's contents.
+			juce::uint64 source = 0;
+			// A hash of everything the grains and descriptors were made with.
+			juce::uint64 settings = 0;
+		};
+
+		explicit CorpusCache(const juce::File& cacheDirectory);
+
+		const juce::File& getDirectory() const noexcept { return directory; }
+
+		// The file a corpus with the given key is cached in.
+		juce::File getFile(const Key& key) const;
+
+		/*
+		 * Writes corpus to the cache. With includeAudio its audio is stored too, so loading it
+		 * doesn't need the source file. The file is written under a temporary name and then
+		 * moved into place, so a cache is never seen half written. shouldStop, if given, is polled
+		 * as the file is written, and if it returns true nothing is stored. Returns false on
+		 * failure or if stopped.
+		 */
+		bool store(const Key& key, const Corpus<float>& corpus, bool includeAudio, const std::function<bool()>& shouldStop = nullptr) const;
+
+		/*
+		 * Loads the corpus cached with key, or returns nullptr if there isn't a valid one.
+		 * If the cache was stored without audio then audio (usually the mapped source file)
+		 * is used instead, and must have the length and channels the corpus was made from.
+		 *
+		 * maxGrainLength (in milliseconds) is the longest grain the settings it was stored
+		 * with allow. A cache with a longer grain or window is damaged, as is one with a
+		 * window shorter than its grain, which playback would read past the end of.
+		 *
+		 * Loading a corpus marks it as used, by setting its file's modification time to now.
+		 */
+		std::shared_ptr<Corpus<float>> load(const Key& key, double maxGrainLength, std::shared_ptr<const juce::AudioBuffer<float>> audio = nullptr) const;
+
+		/*
+		 * Deletes cached corpora, least recently stored or loaded first, until the rest take up
+		 * no more than maxBytes. The corpus cached with keep is never deleted, even if it's
+		 * bigger than maxBytes on its own. Returns how many corpora were deleted.
+		 */
+		int trim(juce::int64 maxBytes, const Key& keep) const;
+
+		// Hashes data, continuing from seed, so hashes can be chained.
+		static juce::uint64 hashBytes(const void* data, size_t numBytes, juce::uint64 seed = 14695981039346656037ull);
+
+		/*
+		 * Hashes the contents of file, mapping it rather than reading it. shouldStop, if given,
+		 * is polled as it goes, and if it returns true this gives up and returns 0.
+		 */
+		static juce::uint64 hashFile(const juce::File& file, const std::function<bool()>& shouldStop = nullptr);
+
+		// Bump whenever the layout, or what's stored in it, changes.
+		static constexpr juce::uint32 formatVersion = 3;
+
+	private:
+		juce::File directory;
+	};
+}
+
+TEST_CASE("CorpusCache")
+{
+	const auto sampleRate = 8000.0;
+	const auto directory = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("PaletteCacheTest");
+	directory.deleteRecursively();
+
+	juce::AudioBuffer<float> audio(2, 8000);
+	juce::Random random(9);
+	for (auto channel = 0; channel < 2; channel++)
+		for (auto i = 0; i < audio.getNumSamples(); i++)
+			audio.setSample(channel, i, random.nextFloat() * 2.0f - 1.0f);
+
+	const auto grainLength = 100.0;
+
+	auto corpus = std::make_shared<Palette::Corpus<float>>(std::move(audio), sampleRate);
+	corpus->segment(grainLength, 50.0, Palette::WindowType::hann);
+	corpus->analyse();
+
+	const Palette::CorpusCache cache(directory);
+	const Palette::CorpusCache::Key key { 1234, 5678 };
+
+	const auto checkSameCorpus = [&](const Palette::Corpus<float>& loaded) {
+		CHECK(loaded.getSampleRate() == sampleRate);
+		REQUIRE(loaded.getGrains().size() == corpus->getGrains().size());
+		REQUIRE(loaded.getDescriptors().getNumGrains() == corpus->getDescriptors().getNumGrains());
+		REQUIRE(loaded.getDescriptors().getNumDimensions() == corpus->getDescriptors().getNumDimensions());
+
+		for (size_t i = 0; i < loaded.getGrains().size(); i++)
+		{
+			const auto& grain = loaded.getGrains()[i];
+			const auto& expected = corpus->getGrains()[i];
+
+			CHECK(grain.startSample == expected.startSample);
+			CHECK(grain.numSamples == expected.numSamples);
+			CHECK(grain.numChannels == expected.numChannels);
+			CHECK(grain.window == expected.window);
+			CHECK(grain.source == &loaded.getAudio());
+			CHECK(grain.getReadPointer(1)[3] == expected.getReadPointer(1)[3]);
+
+			for (auto dimension = 0; dimension < loaded.getDescriptors().getNumDimensions(); dimension++)
+				CHECK(loaded.getDescriptors().getValue(i, dimension) == corpus->getDescriptors().getValue(i, dimension));
+		}
+
+		CHECK(loaded.getSuccessors().getNumEdges() > 0);
+		CHECK(loaded.getSuccessors().getOffsets() == corpus->getSuccessors().getOffsets());
+		CHECK(loaded.getSuccessors().getSuccessorArray() == corpus->getSuccessors().getSuccessorArray());
+		CHECK(loaded.getSuccessors().getCostArray() == corpus->getSuccessors().getCostArray());
+	};
+
+	SUBCASE("Corpora with their audio load back the same")
+	{
+		REQUIRE(cache.store(key, *corpus, true));
+
+		const auto loaded = cache.load(key, grainLength);
+		REQUIRE(loaded != nullptr);
+		checkSameCorpus(*loaded);
+
+		// The audio is used from the mapping, not copied back into the corpus it came from.
+		CHECK(&loaded->getAudio() != &corpus->getAudio());
+	}
+
+	SUBCASE("Corpora without their audio need it given back")
+	{
+		REQUIRE(cache.store(key, *corpus, false));
+		CHECK(cache.getFile(key).getSize() < 8000 * 2 * 4);
+
+		CHECK(cache.load(key, grainLength) == nullptr);
+
+		const auto loaded = cache.load(key, grainLength, corpus->getSharedAudio());
+		REQUIRE(loaded != nullptr);
+		checkSameCorpus(*loaded);
+
+		juce::AudioBuffer<float> tooShort(2, 100);
+		CHECK(cache.load(key, grainLength, std::make_shared<const juce::AudioBuffer<float>>(std::move(tooShort))) == nullptr);
+	}
+
+	SUBCASE("Only a cache with a matching key is loaded")
+	{
+		REQUIRE(cache.store(key, *corpus, true));
+
+		CHECK(cache.load({ 1234, 9999 }, grainLength) == nullptr);
+		CHECK(cache.load({ 4321, 5678 }, grainLength) == nullptr);
+	}
+
+	SUBCASE("Damaged caches aren't loaded")
+	{
+		REQUIRE(cache.store(key, *corpus, true));
+
+		juce::MemoryBlock data;
+		REQUIRE(cache.getFile(key).loadFileAsData(data));
+		cache.getFile(key).replaceWithData(data.getData(), data.getSize() / 2);
+
+		CHECK(cache.load(key, grainLength) == nullptr);
+	}
+
+	SUBCASE("Files hash by their contents")
+	{
+		const auto a = directory.getChildFile("a.bin");
+		const auto b = directory.getChildFile("b.bin");
+		directory.createDirectory();
+
+		a.replaceWithData("some audio!", 11);
+		b.replaceWithData("some audio?", 11);
+
+		CHECK(Palette::CorpusCache::hashFile(a) == Palette::CorpusCache::hashFile(a));
+		CHECK(Palette::CorpusCache::hashFile(a) != Palette::CorpusCache::hashFile(b));
+		CHECK(Palette::CorpusCache::hashFile(a, [] { return true; }) == 0);
+	}
+
+	SUBCASE("Grains longer than their settings allow, or than their windows, aren't loaded")
+	{
+		REQUIRE(cache.store(key, *corpus, true));
+		CHECK(cache.load(key, grainLength / 2) == nullptr);
+
+		// A window half as long as its grain, as a stale or damaged cache might hold.
+		auto grains = corpus->getGrains();
+		grains.front().window = Palette::getWindowTable<float>(Palette::WindowType::hann, grains.front().numSamples / 2);
+
+		Palette::Corpus<float> badWindow(corpus->getSharedAudio(), sampleRate);
+		badWindow.setGrains(std::move(grains));
+
+		REQUIRE(cache.store(key, badWindow, true));
+		CHECK(cache.load(key, grainLength) == nullptr);
+	}
+
+	SUBCASE("Trimming deletes the corpora used least recently")
+	{
+		const Palette::CorpusCache::Key oldest { 1, 1 };
+		const Palette::CorpusCache::Key loaded { 2, 2 };
+		const Palette::CorpusCache::Key newest { 3, 3 };
+
+		for (const auto& each : { oldest, loaded, newest })
+			REQUIRE(cache.store(each, *corpus, true));
+
+		const auto size = cache.getFile(newest).getSize();
+		const auto now = juce::Time::getCurrentTime().toMilliseconds();
+
+		// Stored in order a minute apart, after which the first stored but one is loaded again.
+		cache.getFile(oldest).setLastModificationTime(juce::Time(now - 180000));
+		cache.getFile(loaded).setLastModificationTime(juce::Time(now - 120000));
+		cache.getFile(newest).setLastModificationTime(juce::Time(now - 60000));
+		REQUIRE(cache.load(loaded, grainLength) != nullptr);
+
+		CHECK(cache.trim(3 * size, newest) == 0);
+
+		CHECK(cache.trim(2 * size, newest) == 1);
+		CHECK_FALSE(cache.getFile(oldest).existsAsFile());
+		CHECK(cache.getFile(loaded).existsAsFile());
+		CHECK(cache.getFile(newest).existsAsFile());
+
+		// What's kept stays, however little room there is.
+		CHECK(cache.trim(0, newest) == 1);
+		CHECK_FALSE(cache.getFile(loaded).existsAsFile());
+		CHECK(cache.load(newest, grainLength) != nullptr);
+	}
+
+	SUBCASE("Stopping while storing leaves nothing behind")
+	{
+		CHECK_FALSE(cache.store(key, *corpus, true, [] { return true; }));
+		CHECK_FALSE(cache.getFile(key).existsAsFile());
+		CHECK(cache.load(key, grainLength) == nullptr);
+	}
+
+	directory.deleteRecursively();
+}
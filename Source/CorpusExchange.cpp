@@ -0,0 +1,93 @@
+/*
+  ==============================================================================
+
+    CorpusExchange.cpp
+    Created: 16 Oct 2026 6:28:35pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#include "CorpusExchange.h"
+
+namespace Palette
+{
+	CorpusExchange::CorpusExchange()
+		: juce::Thread("Corpus reclaimer")
+	{
+		startThread();
+	}
+
+	CorpusExchange::~CorpusExchange()
+	{
+		stopThread(1000);
+	}
+
+	void CorpusExchange::publish(std::shared_ptr<const Corpus<float>> corpus)
+	{
+		const juce::ScopedLock lock(versionLock);
+
+		versions.push_back(std::make_unique<Version>(Version { std::move(corpus), nextGeneration++ }));
+		latest.store(versions.back().get(), std::memory_order_release);
+	}
+
+	const CorpusExchange::Version* CorpusExchange::acquire() const noexcept
+	{
+		return latest.load(std::memory_order_acquire);
+	}
+
+	void CorpusExchange::releaseOlderThan(const juce::uint64 generation) noexcept
+	{
+		oldestInUse.store(generation, std::memory_order_release);
+	}
+
+	void CorpusExchange::startPlayback() noexcept
+	{
+		oldestInUse.store(0, std::memory_order_release);
+	}
+
+	void CorpusExchange::stopPlayback() noexcept
+	{
+		oldestInUse.store(std::numeric_limits<juce::uint64>::max(), std::memory_order_release);
+	}
+
+	void CorpusExchange::reclaim()
+	{
+		std::vector<std::unique_ptr<Version>> finished;
+
+		{
+			const juce::ScopedLock lock(versionLock);
+
+			/*
+			 * The audio thread only ever picks up the latest version, and generations only grow,
+			 * so anything older than what it last reported and not the latest can't be read again.
+			 */
+			const auto* current = latest.load(std::memory_order_acquire);
+			const auto oldest = oldestInUse.load(std::memory_order_acquire);
+
+			for (auto& version : versions)
+				if (version.get() != current && version->generation < oldest)
+					finished.push_back(std::move(version));
+
+			versions.erase(std::remove(versions.begin(), versions.end(), nullptr), versions.end());
+		}
+
+		// Freeing a corpus can take a while, so do it without holding up publishers.
+		finished.clear();
+	}
+
+	int CorpusExchange::getNumVersions() const
+	{
+		const juce::ScopedLock lock(versionLock);
+		return static_cast<int>(versions.size());
+	}
+
+	void CorpusExchange::run()
+	{
+		while (! threadShouldExit())
+		{
+			reclaim();
+			wait(reclaimInterval);
+		}
+	}
+}
@@ -0,0 +1,228 @@
+/*
+  ==============================================================================
+
+    CorpusExchange.h
+    Created: 16 Oct 2026 6:28:35pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+#include "Corpus.h"
+
+namespace Palette
+{
+	/*
+	 * CorpusExchange hands corpora built on other threads to the audio thread without
+	 * ever making it wait, allocate or free.
+	 *
+	 * Each corpus published becomes a new version with a higher generation, swapped in with
+	 * a single atomic pointer store. The audio thread picks up the latest version at the start
+	 * of each block, and after the block reports the oldest generation it still plays grains
+	 * from. A background thread frees old versions once the audio thread has moved past them,
+	 * so a corpus is never freed while a voice is reading its audio.
+	 */
+	class CorpusExchange : private juce::Thread
+	{
+	public:
+		struct Version
+		{
+			std::shared_ptr<const Corpus<float>> corpus;
+			juce::uint64 generation;
+		};
+
+		// Starts the thread which frees old versions.
+		CorpusExchange();
+		~CorpusExchange() override;
+
+		/*
+		 * Makes corpus the one the audio thread plays from, from its next block on.
+		 * The previous corpus is kept alive until the audio thread has finished with it.
+		 * Any thread except the audio thread may publish.
+		 */
+		void publish(std::shared_ptr<const Corpus<float>> corpus);
+
+		/*
+		 * Returns the latest version published, or nullptr if nothing has been. For the audio
+		 * thread, which may use the version returned until it next reports what it's playing.
+		 */
+		const Version* acquire() const noexcept;
+
+		/*
+		 * Reports from the audio thread that it won't read any version older than generation
+		 * again, so those may be freed. Generation must be no newer than the version it last
+		 * acquired, and 0 if it acquired nullptr: a version published after that is read from
+		 * the next block, and must outlive any published while that block runs.
+		 */
+		void releaseOlderThan(juce::uint64 generation) noexcept;
+
+		/*
+		 * Called before the audio thread starts and after it stops. While it's stopped every
+		 * version except the latest is freed, since nothing can be reading them.
+		 */
+		void startPlayback() noexcept;
+		void stopPlayback() noexcept;
+
+		/*
+		 * Frees every version the audio thread has finished with. This is done regularly by the
+		 * exchange's own thread, so only needs calling to free memory sooner.
+		 */
+		void reclaim();
+
+		// How many versions are being kept alive, including the latest.
+		int getNumVersions() const;
+
+	private:
+		void run() override;
+
+		// How often old versions are looked for, in miliseconds.
+		static constexpr int reclaimInterval = 100;
+
+		// Guards versions between publishers and the reclaiming thread. Never taken by the audio thread.
+		juce::CriticalSection versionLock;
+		std::vector<std::unique_ptr<Version>> versions;
+		juce::uint64 nextGeneration = 1;
+
+		std::atomic<const Version*> latest { nullptr };
+		std::atomic<juce::uint64> oldestInUse { std::numeric_limits<juce::uint64>::max() };
+
+		JUCE_DECLARE_NON_COPYABLE(CorpusExchange)
+	};
+}
+
+TEST_CASE("CorpusExchange")
+{
+	const auto makeCorpus = [](const float value) {
+		juce::AudioBuffer<float> audio(1, 4410);
+		for (auto i = 0; i < audio.getNumSamples(); i++)
+			audio.setSample(0, i, value);
+
+		auto corpus = std::make_shared<Palette::Corpus<float>>(std::move(audio), 44100.0);
+		corpus->segment(10.0);
+		return std::shared_ptr<const Palette::Corpus<float>>(std::move(corpus));
+	};
+
+	Palette::CorpusExchange exchange;
+
+	SUBCASE("Old corpora are kept until the audio thread is done with them")
+	{
+		CHECK(exchange.acquire() == nullptr);
+
+		exchange.startPlayback();
+
+		auto first = makeCorpus(1.0f);
+		std::weak_ptr<const Palette::Corpus<float>> firstWatcher = first;
+		exchange.publish(std::move(first));
+
+		const auto* firstVersion = exchange.acquire();
+		REQUIRE(firstVersion != nullptr);
+		exchange.releaseOlderThan(firstVersion->generation);
+
+		exchange.publish(makeCorpus(2.0f));
+		const auto* secondVersion = exchange.acquire();
+		CHECK(secondVersion->generation > firstVersion->generation);
+
+		// Grains from the first corpus are still playing.
+		exchange.releaseOlderThan(firstVersion->generation);
+		exchange.reclaim();
+		CHECK_FALSE(firstWatcher.expired());
+		CHECK(exchange.getNumVersions() == 2);
+
+		exchange.releaseOlderThan(secondVersion->generation);
+		exchange.reclaim();
+		CHECK(firstWatcher.expired());
+		CHECK(exchange.getNumVersions() == 1);
+		CHECK(exchange.acquire() == secondVersion);
+	}
+
+	SUBCASE("A version acquired after an empty block outlives the ones published during the next")
+	{
+		exchange.startPlayback();
+
+		// A block with nothing to play reports that nothing may be freed yet.
+		REQUIRE(exchange.acquire() == nullptr);
+		exchange.releaseOlderThan(0);
+
+		auto first = makeCorpus(1.0f);
+		std::weak_ptr<const Palette::Corpus<float>> firstWatcher = first;
+		exchange.publish(std::move(first));
+
+		// The next block picks it up and is still reading it as the loader publishes again.
+		const auto* firstVersion = exchange.acquire();
+		REQUIRE(firstVersion != nullptr);
+
+		exchange.publish(makeCorpus(2.0f));
+		exchange.publish(makeCorpus(3.0f));
+		exchange.reclaim();
+
+		CHECK_FALSE(firstWatcher.expired());
+		CHECK(firstVersion->corpus->getAudio().getSample(0, 0) == 1.0f);
+
+		exchange.releaseOlderThan(firstVersion->generation);
+		exchange.reclaim();
+		CHECK_FALSE(firstWatcher.expired());
+	}
+
+	SUBCASE("Only the latest corpus is kept while stopped")
+	{
+		for (auto i = 0; i < 5; i++)
+			exchange.publish(makeCorpus((float)i));
+
+		exchange.reclaim();
+		CHECK(exchange.getNumVersions() == 1);
+		CHECK(exchange.acquire()->corpus->getAudio().getSample(0, 0) == 4.0f);
+	}
+
+	SUBCASE("Publishing while the audio thread plays is safe")
+	{
+		exchange.startPlayback();
+		exchange.publish(makeCorpus(0.0f));
+
+		std::atomic<bool> finished { false };
+
+		// Stands in for the audio thread, holding on to each corpus for a few blocks like a voice would.
+		std::thread audioThread([&] {
+			juce::uint64 playingGeneration = 0;
+			auto blocksLeft = 0;
+			auto sum = 0.0f;
+
+			while (! finished)
+			{
+				const auto* version = exchange.acquire();
+
+				if (version->generation != playingGeneration && blocksLeft == 0)
+				{
+					playingGeneration = version->generation;
+					blocksLeft = 3;
+				}
+
+				blocksLeft = juce::jmax(0, blocksLeft - 1);
+
+				for (const auto& grain : version->corpus->getGrains())
+					sum += grain.getReadPointer(0)[0];
+
+				exchange.releaseOlderThan(juce::jmin(playingGeneration, version->generation));
+			}
+
+			CHECK(sum >= 0.0f);
+		});
+
+		for (auto i = 1; i < 50; i++)
+		{
+			exchange.publish(makeCorpus((float)i));
+			juce::Thread::sleep(1);
+		}
+
+		finished = true;
+		audioThread.join();
+
+		exchange.stopPlayback();
+		exchange.reclaim();
+		CHECK(exchange.getNumVersions() == 1);
+	}
+}
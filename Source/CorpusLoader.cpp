@@ -0,0 +1,320 @@
+/*
+  ==============================================================================
+
+    CorpusLoader.cpp
+    Created: 16 Oct 2026 6:31:12pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#include "CorpusLoader.h"
+
+namespace Palette
+{
+	CorpusLoader::CorpusLoader()
+		: juce::Thread("Corpus loader")
+	{
+		formatManager.registerBasicFormats();
+	}
+
+	CorpusLoader::~CorpusLoader()
+	{
+		cancel();
+	}
+
+	bool CorpusLoader::load(const juce::File& file, const Options& options, Callback callback)
+	{
+		// Opening a reader only reads the header, so it's a quick way to find out if the file can be loaded.
+		std::unique_ptr<juce::AudioFormatReader> fileReader(formatManager.createReaderFor(file));
+
+		if (fileReader == nullptr)
+			return false;
+
+		cancel();
+
+		reader = std::move(fileReader);
+		sourceFile = file;
+		loadOptions = options;
+		loadCallback = std::move(callback);
+		setSource({ file, {} });
+
+		startThread();
+		return true;
+	}
+
+	void CorpusLoader::restore(const Source& sourceToRestore, const Options& options, Callback callback)
+	{
+		cancel();
+
+		// Without a file there's nothing to restore from, so it's the same as no corpus at all.
+		if (sourceToRestore.file == juce::File())
+			return;
+
+		sourceFile = sourceToRestore.file;
+		restoredKey = sourceToRestore.key;
+		loadOptions = options;
+		loadCallback = std::move(callback);
+		setSource(sourceToRestore);
+
+		startThread();
+	}
+
+	CorpusLoader::Source CorpusLoader::getSource() const
+	{
+		const juce::ScopedLock lock(sourceLock);
+		return source;
+	}
+
+	void CorpusLoader::setSource(const Source& newSource)
+	{
+		const juce::ScopedLock lock(sourceLock);
+		source = newSource;
+	}
+
+	void CorpusLoader::load(std::unique_ptr<juce::AudioFormatReader> newReader, const Options& options, Callback callback)
+	{
+		cancel();
+
+		reader = std::move(newReader);
+		loadOptions = options;
+		loadCallback = std::move(callback);
+
+		startThread();
+	}
+
+	juce::uint64 CorpusLoader::getSettingsHash(const Options& options)
+	{
+		auto hash = CorpusCache::hashBytes(&numDescriptors, sizeof(numDescriptors));
+
+		const auto add = [&hash](const auto value) { hash = CorpusCache::hashBytes(&value, sizeof(value), hash); };
+
+		add(static_cast<int>(options.segmentation));
+		add(options.analyse);
+
+		if (options.segmentation == Segmentation::fixedLength)
+		{
+			add(options.grainLength);
+			add(options.hopLength);
+			add(static_cast<int>(options.windowType));
+		}
+		else
+		{
+			const auto& onsets = options.onsetParameters;
+			add(onsets.fftOrder);
+			add(onsets.hopSize);
+			add(onsets.thresholdFrames);
+			add(onsets.thresholdMultiplier);
+			add(onsets.thresholdOffset);
+			add(onsets.minGrainLength);
+			add(onsets.maxGrainLength);
+		}
+
+		return hash;
+	}
+
+	double CorpusLoader::getMaxGrainLength(const Options& options) noexcept
+	{
+		return options.segmentation == Segmentation::fixedLength ? options.grainLength : options.onsetParameters.maxGrainLength;
+	}
+
+	void CorpusLoader::cancel()
+	{
+		stopThread(-1);
+		reader.reset();
+		sourceFile = juce::File();
+		restoredKey = {};
+		setSource({});
+	}
+
+	void CorpusLoader::run()
+	{
+		if (sourceFile != juce::File())
+			loadFile();
+		else if (reader != nullptr)
+			loadFromReader(*reader, loadOptions, loadCallback, [this] { return threadShouldExit(); });
+	}
+
+	void CorpusLoader::loadFile()
+	{
+		const auto shouldStop = [this] { return threadShouldExit(); };
+		const CorpusCache cache(loadOptions.cacheDirectory);
+		const auto useCache = loadOptions.cacheDirectory != juce::File();
+		const auto maxGrainLength = getMaxGrainLength(loadOptions);
+
+		// A restored file which has gone can still come from the cache, as long as its audio is there too.
+		if (! sourceFile.existsAsFile())
+		{
+			if (useCache)
+				if (auto cached = cache.load(restoredKey, maxGrainLength))
+					loadCallback(std::move(cached), true);
+
+			return;
+		}
+
+		std::shared_ptr<const juce::AudioBuffer<float>> mappedAudio;
+		auto mappedSampleRate = 0.0;
+
+		if (loadOptions.memoryMap)
+			mappedAudio = mapAudioFile(sourceFile, mappedSampleRate);
+
+		CorpusCache::Key key;
+
+		if (useCache)
+		{
+			key = { CorpusCache::hashFile(sourceFile, shouldStop), getSettingsHash(loadOptions) };
+
+			if (threadShouldExit())
+				return;
+
+			setSource({ sourceFile, key });
+
+			if (auto cached = cache.load(key, maxGrainLength, mappedAudio))
+			{
+				loadCallback(std::move(cached), true);
+				return;
+			}
+		}
+
+		/*
+		 * Once loaded, the corpus is cached before it's handed out. Its audio is only stored if it
+		 * can't be mapped from the source, and then the decoded copy is swapped for a mapping of
+		 * the cached one, so it's shared with anything else which loads the file.
+		 */
+		const auto callback = [&](std::shared_ptr<const Corpus<float>> corpus, const bool isComplete) {
+			if (isComplete && useCache && cache.store(key, *corpus, mappedAudio == nullptr, shouldStop))
+			{
+				cache.trim(loadOptions.maxCacheBytes, key);
+
+				if (mappedAudio == nullptr)
+					if (auto cached = cache.load(key, maxGrainLength))
+						corpus = std::move(cached);
+			}
+
+			loadCallback(std::move(corpus), isComplete);
+		};
+
+		if (mappedAudio != nullptr)
+		{
+			loadFromAudio(mappedAudio, mappedSampleRate, loadOptions, callback, shouldStop);
+			return;
+		}
+
+		if (loadOptions.memoryMap)
+			if (auto mappedReader = createMappedReader(sourceFile))
+				reader = std::move(mappedReader);
+
+		// Restored files haven't been opened yet.
+		if (reader == nullptr)
+			reader.reset(formatManager.createReaderFor(sourceFile));
+
+		if (reader != nullptr)
+			loadFromReader(*reader, loadOptions, callback, shouldStop);
+	}
+
+	bool CorpusLoader::loadFromAudio(std::shared_ptr<const juce::AudioBuffer<float>> audio, const double sampleRate, const Options& options,
+		const Callback& callback, const std::function<bool()>& shouldStop)
+	{
+		auto corpus = std::make_shared<Corpus<float>>(std::move(audio), sampleRate);
+
+		if (options.segmentation == Segmentation::fixedLength)
+			corpus->segment(options.grainLength, options.hopLength, options.windowType);
+		else
+			corpus->segmentAtOnsets(options.onsetParameters);
+
+		if (shouldStop() || (options.analyse && ! corpus->analyse(shouldStop)))
+			return false;
+
+		callback(std::move(corpus), true);
+		return true;
+	}
+
+	bool CorpusLoader::loadFromReader(juce::AudioFormatReader& reader, const Options& options, const Callback& callback,
+		const std::function<bool()>& shouldStop)
+	{
+		// AudioBuffer is indexed by int, which at 48kHz is still over 12 hours.
+		const auto numSamples = static_cast<int>(juce::jmin(reader.lengthInSamples, static_cast<juce::int64>(std::numeric_limits<int>::max())));
+		const auto numChannels = static_cast<int>(reader.numChannels);
+		const auto sampleRate = reader.sampleRate;
+
+		if (numSamples <= 0 || numChannels <= 0 || sampleRate <= 0)
+			return false;
+
+		const auto blockSize = juce::jmax(1, options.blockSize);
+
+		/*
+		 * The whole corpus is allocated up front and never resized, so grains can point into it
+		 * while later blocks are still being decoded. Snapshots only see it as const; blocks are
+		 * written through pointers taken before any snapshot exists.
+		 */
+		auto audio = std::make_shared<juce::AudioBuffer<float>>(numChannels, numSamples);
+		auto* const* destination = audio->getArrayOfWritePointers();
+		const std::shared_ptr<const juce::AudioBuffer<float>> sharedAudio = audio;
+
+		juce::AudioBuffer<float> block(numChannels, blockSize);
+
+		// Fixed length grains depend only on the length, so are all known up front.
+		std::vector<Grain<float>> grains;
+		if (options.segmentation == Segmentation::fixedLength)
+			grains = createGrains(*sharedAudio, options.grainLength, sampleRate, options.hopLength, options.windowType);
+
+		OnsetSegmenter segmenter(sampleRate, options.onsetParameters);
+		size_t nextOnset = 0;
+
+		size_t numReady = 0;
+		size_t numHandedOut = 0;
+
+		for (auto start = 0; start < numSamples; start += blockSize)
+		{
+			if (shouldStop())
+				return false;
+
+			const auto numToRead = juce::jmin(blockSize, numSamples - start);
+			reader.read(&block, 0, numToRead, start, true, true);
+
+			for (auto channel = 0; channel < numChannels; channel++)
+				juce::FloatVectorOperations::copy(destination[channel] + start, block.getReadPointer(channel), numToRead);
+
+			const auto numDecoded = start + numToRead;
+
+			if (options.segmentation == Segmentation::fixedLength)
+			{
+				while (numReady < grains.size() && grains[numReady].startSample + grains[numReady].numSamples <= numDecoded)
+					numReady++;
+			}
+			else
+			{
+				// The grain after the latest onset isn't made until the next onset is found.
+				segmenter.process(*sharedAudio, start, numToRead);
+				segmenter.appendGrains(*sharedAudio, sampleRate, grains, nextOnset, false);
+				nextOnset = segmenter.getOnsets().size() - 1;
+				numReady = grains.size();
+			}
+
+			/*
+			 * Each snapshot copies the grains ready so far, so snapshots are only handed out
+			 * when the number ready has doubled. That keeps the copying linear in the length of the file.
+			 */
+			if (numDecoded < numSamples && numReady > 0 && numReady >= 2 * numHandedOut)
+			{
+				auto snapshot = std::make_shared<Corpus<float>>(sharedAudio, sampleRate);
+				snapshot->setGrains({ grains.begin(), grains.begin() + static_cast<long>(numReady) });
+				callback(std::move(snapshot), false);
+
+				numHandedOut = numReady;
+			}
+		}
+
+		if (options.segmentation == Segmentation::onsets)
+			segmenter.appendGrains(*sharedAudio, sampleRate, grains, nextOnset, true);
+
+		auto corpus = std::make_shared<Corpus<float>>(sharedAudio, sampleRate);
+		corpus->setGrains(std::move(grains));
+
+		if (options.analyse && ! corpus->analyse(shouldStop))
+			return false;
+
+		callback(std::move(corpus), true);
+		return true;
+	}
+}
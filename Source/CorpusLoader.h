@@ -0,0 +1,450 @@
+/*
+  ==============================================================================
+
+    CorpusLoader.h
+    Created: 16 Oct 2026 6:31:12pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+#include "Corpus.h"
+#include "MappedAudioFile.h"
+#include "CorpusCache.h"
+
+namespace Palette
+{
+	/*
+	 * CorpusLoader decodes an audio file into a corpus on a background thread, a block at a time,
+	 * segmenting it as it goes.
+	 *
+	 * The corpus audio is allocated once at its final size and decoded straight into, so loading
+	 * never needs more than the file's samples plus one block. Grains are handed out as soon as
+	 * the audio they cover has been decoded, in snapshots which share the audio still being
+	 * written past their last grain, so playback can start long before a long file is loaded.
+	 */
+	class CorpusLoader : private juce::Thread
+	{
+	public:
+		enum class Segmentation
+		{
+			fixedLength,
+			onsets
+		};
+
+		struct Options
+		{
+			Segmentation segmentation = Segmentation::onsets;
+
+			// Grain length, hop length (both in miliseconds) and window for fixedLength grains.
+			double grainLength = 100.0;
+			double hopLength = 100.0;
+			WindowType windowType = WindowType::rectangular;
+
+			OnsetSegmenter::Parameters onsetParameters;
+
+			// Samples decoded at a time.
+			int blockSize = 1 << 16;
+
+			// Whether the finished corpus is analysed before it's handed out. Snapshots never are.
+			bool analyse = true;
+
+			/*
+			 * Whether WAV files are memory mapped. Mono 32-bit float files are then used in place
+			 * without decoding (see mapAudioFile()); other WAV files are decoded from the mapping,
+			 * so the first load of them is no quicker. With a cache, though, their decoded audio
+			 * is cached as floats and used from a mapping of the cache from then on.
+			 */
+			bool memoryMap = true;
+
+			/*
+			 * Where loaded files are cached (see CorpusCache), so loading them again with the same
+			 * settings skips decoding, segmenting and analysing. No caching if it's File().
+			 */
+			juce::File cacheDirectory;
+
+			/*
+			 * The most bytes the cache may take up. Each time a corpus is cached, those used least
+			 * recently are deleted to stay under it (see CorpusCache::trim()).
+			 */
+			juce::int64 maxCacheBytes = static_cast<juce::int64>(2) << 30;
+		};
+
+		/*
+		 * Called on the loading thread with each snapshot, which holds the grains ready so far,
+		 * and finally with the whole corpus when isComplete is true.
+		 */
+		using Callback = std::function<void(std::shared_ptr<const Corpus<float>> corpus, bool isComplete)>;
+
+		/*
+		 * Where a corpus was loaded from: its file, and the key it's cached under. key.source is 0
+		 * until the file has been hashed on the loading thread, or if there's no cache.
+		 */
+		struct Source
+		{
+			juce::File file;
+			CorpusCache::Key key {};
+		};
+
+		CorpusLoader();
+		~CorpusLoader() override;
+
+		/*
+		 * Starts loading file in the background, abandoning any load already in progress.
+		 * Returns false if the file isn't a format that can be read.
+		 *
+		 * A file used in place from a memory mapping, or found in the cache, is already whole,
+		 * so there are no snapshots of it; the complete corpus is handed out as soon as it's ready.
+		 */
+		bool load(const juce::File& file, const Options& options, Callback callback);
+
+		// As above, but reading from reader, which the loader takes ownership of.
+		void load(std::unique_ptr<juce::AudioFormatReader> reader, const Options& options, Callback callback);
+
+		/*
+		 * Loads a corpus again from where it was loaded before, for example when a host restores
+		 * a session. Nothing is read on the calling thread. If the file has gone the corpus comes
+		 * from the cache by source.key, which only works if its audio was cached too.
+		 */
+		void restore(const Source& source, const Options& options, Callback callback);
+
+		/*
+		 * Where the corpus being loaded, or last loaded, comes from. Cleared by cancel().
+		 * Safe to call from any thread.
+		 */
+		Source getSource() const;
+
+		/*
+		 * Abandons the load in progress, if there is one, and waits for it to stop. Every stage
+		 * of a load (decoding, hashing, analysing and caching) checks for this as it goes, so
+		 * the wait is short however far the load had got.
+		 */
+		void cancel();
+
+		bool isLoading() const noexcept { return isThreadRunning(); }
+
+		/*
+		 * Loads everything reader holds on the calling thread. shouldStop is polled between
+		 * blocks and while analysing; returns false if it stopped the load, or there was nothing to load.
+		 */
+		static bool loadFromReader(juce::AudioFormatReader& reader, const Options& options, const Callback& callback,
+			const std::function<bool()>& shouldStop);
+
+		/*
+		 * A hash of every option which changes the grains or descriptors loaded, for keying
+		 * cached corpora.
+		 */
+		static juce::uint64 getSettingsHash(const Options& options);
+
+		/*
+		 * Segments (and analyses) audio which is already whole, on the calling thread. Returns
+		 * false, without calling callback, if shouldStop stopped it.
+		 */
+		static bool loadFromAudio(std::shared_ptr<const juce::AudioBuffer<float>> audio, double sampleRate, const Options& options,
+			const Callback& callback, const std::function<bool()>& shouldStop);
+
+	private:
+		void run() override;
+		void loadFile();
+		void setSource(const Source& newSource);
+
+		// The longest grain options can make, in milliseconds, for checking cached corpora against.
+		static double getMaxGrainLength(const Options& options) noexcept;
+
+		juce::AudioFormatManager formatManager;
+
+		/*
+		 * The load the thread is working on: a reader, and the file it reads if there is one.
+		 * Only touched by other threads while the loading thread isn't running.
+		 */
+		std::unique_ptr<juce::AudioFormatReader> reader;
+		juce::File sourceFile;
+		CorpusCache::Key restoredKey {};
+		Options loadOptions;
+		Callback loadCallback;
+
+		mutable juce::CriticalSection sourceLock;
+		Source source;
+
+		JUCE_DECLARE_NON_COPYABLE(CorpusLoader)
+	};
+}
+
+TEST_CASE("CorpusLoader")
+{
+	const auto sampleRate = 44100.0;
+
+	// A stereo "file" of decaying noise bursts, read straight from memory.
+	struct BurstReader : public juce::AudioFormatReader
+	{
+		BurstReader(const juce::AudioBuffer<float>& audioToRead)
+			: juce::AudioFormatReader(nullptr, "Bursts"), audio(audioToRead)
+		{
+			sampleRate = 44100.0;
+			bitsPerSample = 32;
+			lengthInSamples = audio.getNumSamples();
+			numChannels = (unsigned int)audio.getNumChannels();
+			usesFloatingPointData = true;
+		}
+
+		bool readSamples(int** destChannels, int numDestChannels, int startOffsetInDestBuffer, juce::int64 startSampleInFile, int numSamples) override
+		{
+			for (auto channel = 0; channel < numDestChannels; channel++)
+				if (destChannels[channel] != nullptr)
+					juce::FloatVectorOperations::copy(reinterpret_cast<float*>(destChannels[channel]) + startOffsetInDestBuffer,
+						audio.getReadPointer(channel, (int)startSampleInFile), numSamples);
+
+			return true;
+		}
+
+		const juce::AudioBuffer<float>& audio;
+	};
+
+	juce::AudioBuffer<float> audio(2, (int)sampleRate * 3);
+	audio.clear();
+
+	juce::Random random(5);
+	for (auto burst = 4410; burst + 8000 < audio.getNumSamples(); burst += 11025)
+		for (auto i = 0; i < 8000; i++)
+			for (auto channel = 0; channel < 2; channel++)
+				audio.setSample(channel, burst + i, (random.nextFloat() * 2.0f - 1.0f) * std::exp(-i / 1000.0f));
+
+	std::vector<std::shared_ptr<const Palette::Corpus<float>>> snapshots;
+	std::shared_ptr<const Palette::Corpus<float>> complete;
+
+	const auto collect = [&](std::shared_ptr<const Palette::Corpus<float>> corpus, bool isComplete) {
+		if (isComplete)
+			complete = std::move(corpus);
+		else
+			snapshots.push_back(std::move(corpus));
+	};
+
+	const auto sameGrains = [](const Palette::Grain<float>& a, const Palette::Grain<float>& b) {
+		return a.startSample == b.startSample && a.numSamples == b.numSamples && a.numChannels == b.numChannels;
+	};
+
+	Palette::CorpusLoader::Options options;
+	options.blockSize = 8192;
+	options.analyse = false;
+
+	SUBCASE("Grains at onsets match segmenting the whole file at once")
+	{
+		BurstReader reader(audio);
+		REQUIRE(Palette::CorpusLoader::loadFromReader(reader, options, collect, [] { return false; }));
+		REQUIRE(complete != nullptr);
+
+		const auto expected = Palette::createGrainsAtOnsets(audio, sampleRate, options.onsetParameters);
+		const auto& grains = complete->getGrains();
+
+		REQUIRE(grains.size() == expected.size());
+		for (size_t i = 0; i < grains.size(); i++)
+			CHECK(sameGrains(grains[i], expected[i]));
+
+		for (auto channel = 0; channel < 2; channel++)
+			for (auto i = 0; i < audio.getNumSamples(); i += 97)
+				CHECK(complete->getAudio().getSample(channel, i) == audio.getSample(channel, i));
+
+		// Snapshots came first, growing, each sharing the complete corpus's audio.
+		REQUIRE_FALSE(snapshots.empty());
+		for (const auto& snapshot : snapshots)
+		{
+			CHECK(&snapshot->getAudio() == &complete->getAudio());
+			CHECK(snapshot->getGrains().size() < grains.size());
+
+			for (size_t i = 0; i < snapshot->getGrains().size(); i++)
+				CHECK(sameGrains(snapshot->getGrains()[i], grains[i]));
+		}
+	}
+
+	SUBCASE("Fixed length grains are handed out once decoded")
+	{
+		options.segmentation = Palette::CorpusLoader::Segmentation::fixedLength;
+		options.grainLength = 50.0;
+		options.hopLength = 25.0;
+		options.windowType = Palette::WindowType::hann;
+
+		BurstReader reader(audio);
+		REQUIRE(Palette::CorpusLoader::loadFromReader(reader, options, collect, [] { return false; }));
+
+		const auto expected = Palette::createGrains(audio, options.grainLength, sampleRate, options.hopLength, options.windowType);
+		REQUIRE(complete->getGrains().size() == expected.size());
+		CHECK(complete->getGrains().back().window == expected.back().window);
+
+		REQUIRE_FALSE(snapshots.empty());
+		CHECK(snapshots.front()->getGrains().size() >= 1);
+	}
+
+	SUBCASE("Loading in the background")
+	{
+		juce::WaitableEvent finished;
+		Palette::CorpusLoader loader;
+
+		options.analyse = true;
+		loader.load(std::make_unique<BurstReader>(audio), options, [&](std::shared_ptr<const Palette::Corpus<float>> corpus, bool isComplete) {
+			if (isComplete)
+			{
+				complete = std::move(corpus);
+				finished.signal();
+			}
+		});
+
+		REQUIRE(finished.wait(10000));
+		CHECK(complete->getDescriptors().getNumGrains() == complete->getGrains().size());
+	}
+
+	SUBCASE("WAV files are memory mapped")
+	{
+		const auto file = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("PaletteLoaderMono.wav");
+		file.deleteFile();
+
+		{
+			juce::WavAudioFormat wav;
+			std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(new juce::FileOutputStream(file), sampleRate, 1, 32, {}, 0));
+			writer->writeFromAudioSampleBuffer(audio, 0, audio.getNumSamples());
+		}
+
+		juce::WaitableEvent finished;
+		Palette::CorpusLoader loader;
+
+		const auto loadAndWait = [&] {
+			complete = nullptr;
+			REQUIRE(loader.load(file, options, [&](std::shared_ptr<const Palette::Corpus<float>> corpus, bool isComplete) {
+				if (isComplete)
+				{
+					complete = std::move(corpus);
+					finished.signal();
+				}
+			}));
+			REQUIRE(finished.wait(10000));
+		};
+
+		loadAndWait();
+		const auto expected = Palette::createGrainsAtOnsets(complete->getAudio(), sampleRate, options.onsetParameters);
+		CHECK(complete->getGrains().size() == expected.size());
+		CHECK(complete->getAudio().getSample(0, 5000) == audio.getSample(0, 5000));
+
+		// The same grains whether the file is mapped or decoded.
+		options.memoryMap = false;
+		loadAndWait();
+		CHECK(complete->getGrains().size() == expected.size());
+
+		complete = nullptr;
+		file.deleteFile();
+	}
+
+	SUBCASE("Loaded files are cached")
+	{
+		const auto directory = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("PaletteLoaderCache");
+		directory.deleteRecursively();
+
+		const auto file = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("PaletteLoaderStereo.wav");
+		file.deleteFile();
+
+		{
+			juce::WavAudioFormat wav;
+			std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(new juce::FileOutputStream(file), sampleRate, 2, 16, {}, 0));
+			writer->writeFromAudioSampleBuffer(audio, 0, audio.getNumSamples());
+		}
+
+		options.cacheDirectory = directory;
+
+		juce::WaitableEvent finished;
+		Palette::CorpusLoader loader;
+		auto numSnapshots = 0;
+		std::shared_ptr<const Palette::Corpus<float>> lastSnapshot;
+
+		const auto callback = [&](std::shared_ptr<const Palette::Corpus<float>> corpus, bool isComplete) {
+			if (! isComplete)
+			{
+				numSnapshots++;
+				lastSnapshot = std::move(corpus);
+				return;
+			}
+
+			complete = std::move(corpus);
+			finished.signal();
+		};
+
+		// Waits for the loading thread to finish too, so the corpus has been cached.
+		const auto waitForLoad = [&] {
+			REQUIRE(finished.wait(10000));
+			while (loader.isLoading())
+				juce::Thread::sleep(1);
+		};
+
+		numSnapshots = 0;
+		REQUIRE(loader.load(file, options, callback));
+		waitForLoad();
+
+		const auto firstGrains = complete->getGrains().size();
+		CHECK(numSnapshots > 0);
+
+		const Palette::CorpusCache cache(directory);
+		const Palette::CorpusCache::Key key { Palette::CorpusCache::hashFile(file), Palette::CorpusLoader::getSettingsHash(options) };
+		CHECK(cache.getFile(key).existsAsFile());
+
+		const auto source = loader.getSource();
+		CHECK(source.file == file);
+		CHECK(source.key.source == key.source);
+		CHECK(source.key.settings == key.settings);
+
+		// 16-bit audio can't be mapped, so once cached the decoded copy is swapped for the cache's.
+		CHECK(&complete->getAudio() != &lastSnapshot->getAudio());
+		CHECK(complete->getAudio().getSample(1, 5000) == lastSnapshot->getAudio().getSample(1, 5000));
+		lastSnapshot = nullptr;
+
+		// Loading again comes straight from the cache.
+		numSnapshots = 0;
+		complete = nullptr;
+		REQUIRE(loader.load(file, options, callback));
+		waitForLoad();
+
+		CHECK(numSnapshots == 0);
+		CHECK(complete->getGrains().size() == firstGrains);
+
+		// So does restoring, even once the file has gone, because its audio couldn't be mapped and was cached too.
+		file.deleteFile();
+		complete = nullptr;
+		loader.restore(source, options, callback);
+		waitForLoad();
+
+		CHECK(complete->getGrains().size() == firstGrains);
+		CHECK(complete->getAudio().getNumSamples() == audio.getNumSamples());
+		CHECK(loader.getSource().key.source == key.source);
+
+		loader.cancel();
+		CHECK(loader.getSource().file == juce::File());
+
+		// Different settings aren't.
+		options.onsetParameters.thresholdMultiplier = 2.0f;
+		CHECK(Palette::CorpusLoader::getSettingsHash(options) != key.settings);
+
+		complete = nullptr;
+		directory.deleteRecursively();
+	}
+
+	SUBCASE("Stopping abandons the load")
+	{
+		BurstReader reader(audio);
+		CHECK_FALSE(Palette::CorpusLoader::loadFromReader(reader, options, collect, [] { return true; }));
+		CHECK(complete == nullptr);
+	}
+
+	SUBCASE("Stopping abandons the analysis too")
+	{
+		// Decoding polls once a block and finishes, so snapshots are handed out, but the corpus is never completed.
+		options.analyse = true;
+		const auto numBlocks = (audio.getNumSamples() + options.blockSize - 1) / options.blockSize;
+		auto numPolls = 0;
+
+		BurstReader reader(audio);
+		CHECK_FALSE(Palette::CorpusLoader::loadFromReader(reader, options, collect, [&] { return ++numPolls > numBlocks; }));
+		CHECK(complete == nullptr);
+		CHECK_FALSE(snapshots.empty());
+	}
+}
@@ -0,0 +1,588 @@
+/*
+  ==============================================================================
+
+    Descriptors.h
+    Created: 16 Oct 2026 6:13:41pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+#include "Grain.h"
+#include "MelCepstrum.h"
+#include "ParallelWork.h"
+#include "PitchEstimator.h"
+#include "Stft.h"
+#include "Window.h"
+
+#include <array>
+
+namespace Palette
+{
+	/*
+	 * The audio descriptors every grain is analysed for. These are the dimensions
+	 * unit selection measures the distance between a target and a grain in.
+	 */
+	enum class Descriptor
+	{
+		// Root mean square level across all channels.
+		rms,
+		// Centre of mass of the magnitude spectrum, in hz.
+		spectralCentroid,
+		// Geometric over arithmetic mean of the power spectrum. Near 1 for noise, near 0 for tones.
+		spectralFlatness,
+		// Fraction of consecutive samples which change sign.
+		zeroCrossingRate,
+		// Fundamental frequency as a (fractional) midi note number, or 0 when no pitch was found.
+		pitch,
+		// How periodic the grain is, from 0 for noise to 1 for a steady tone. Says how far to trust pitch.
+		pitchConfidence,
+		// The first of numMfccs mel frequency cepstral coefficients, which describe timbre. The rest follow it.
+		mfcc
+	};
+
+	constexpr int numMfccs = 13;
+	constexpr int numDescriptors = static_cast<int>(Descriptor::mfcc) + numMfccs;
+
+	inline const char* getDescriptorName(const int descriptor)
+	{
+		static const char* const names[numDescriptors] = { "rms", "spectralCentroid", "spectralFlatness", "zeroCrossingRate", "pitch", "pitchConfidence",
+			"mfcc0", "mfcc1", "mfcc2", "mfcc3", "mfcc4", "mfcc5", "mfcc6", "mfcc7", "mfcc8", "mfcc9", "mfcc10", "mfcc11", "mfcc12" };
+		return juce::isPositiveAndBelow(descriptor, numDescriptors) ? names[descriptor] : "";
+	}
+
+	/*
+	 * DescriptorTable holds one fixed width descriptor vector per grain, stored as a
+	 * structure of arrays: all grains' values for one descriptor are contiguous, so a
+	 * scan over one dimension for every grain walks memory linearly and can be vectorised.
+	 *
+	 * The columns live in a single allocation and each starts on a multiple of
+	 * columnAlignment floats from the first, so they all share the same alignment.
+	 */
+	class DescriptorTable
+	{
+	public:
+		static constexpr size_t columnAlignment = 8;
+
+		DescriptorTable() = default;
+
+		DescriptorTable(const int dimensions, const size_t grains)
+			: numDimensions(dimensions),
+			  numGrains(grains),
+			  columnStride((grains + columnAlignment - 1) / columnAlignment * columnAlignment),
+			  values(static_cast<size_t>(dimensions) * columnStride, 0.0f) { }
+
+		int getNumDimensions() const noexcept { return numDimensions; }
+		size_t getNumGrains() const noexcept { return numGrains; }
+
+		// All grains' values for one descriptor, getNumGrains() long.
+		const float* getColumn(const int dimension) const noexcept
+		{
+			jassert(juce::isPositiveAndBelow(dimension, numDimensions));
+			return values.data() + static_cast<size_t>(dimension) * columnStride;
+		}
+
+		float* getColumn(const int dimension) noexcept
+		{
+			jassert(juce::isPositiveAndBelow(dimension, numDimensions));
+			return values.data() + static_cast<size_t>(dimension) * columnStride;
+		}
+
+		float getValue(const size_t grain, const int dimension) const noexcept { return getColumn(dimension)[grain]; }
+		void setValue(const size_t grain, const int dimension, const float value) noexcept { getColumn(dimension)[grain] = value; }
+
+		// Scatters one grain's descriptor vector (getNumDimensions() values) into the columns.
+		void setRow(const size_t grain, const float* row) noexcept
+		{
+			for (auto dimension = 0; dimension < numDimensions; dimension++)
+				setValue(grain, dimension, row[dimension]);
+		}
+
+		// Gathers one grain's descriptor vector into row, which must hold getNumDimensions() values.
+		void getRow(const size_t grain, float* row) const noexcept
+		{
+			for (auto dimension = 0; dimension < numDimensions; dimension++)
+				row[dimension] = getValue(grain, dimension);
+		}
+
+	private:
+		int numDimensions = 0;
+		size_t numGrains = 0;
+		size_t columnStride = 0;
+		std::vector<float> values;
+	};
+
+	/*
+	 * DescriptorStatistics holds the mean and standard deviation of every descriptor across a
+	 * table, measured once when a corpus is analysed.
+	 *
+	 * Descriptors come in very different units (rms is at most 1, spectral centroid runs into
+	 * the thousands of hz), so raw euclidean distances are dominated by whichever is largest.
+	 * Measuring distance in standard deviations fixes that, and since
+	 *
+	 *     ((a - mean) / deviation - (b - mean) / deviation)^2 = (a - b)^2 / deviation^2
+	 *
+	 * it's the same as weighting each dimension by 1 / deviation^2. So the indexes keep the raw
+	 * descriptors and standardising is just a weight in the distance kernel.
+	 */
+	struct DescriptorStatistics
+	{
+		static DescriptorStatistics measure(const DescriptorTable& table)
+		{
+			DescriptorStatistics statistics;
+			const auto numGrains = table.getNumGrains();
+
+			for (auto dimension = 0; dimension < table.getNumDimensions(); dimension++)
+			{
+				const auto* column = table.getColumn(dimension);
+				auto sum = 0.0;
+				auto sumOfSquares = 0.0;
+
+				for (size_t grain = 0; grain < numGrains; grain++)
+				{
+					sum += column[grain];
+					sumOfSquares += static_cast<double>(column[grain]) * column[grain];
+				}
+
+				const auto mean = numGrains > 0 ? sum / static_cast<double>(numGrains) : 0.0;
+				const auto variance = numGrains > 0 ? juce::jmax(0.0, sumOfSquares / static_cast<double>(numGrains) - mean * mean) : 0.0;
+
+				statistics.mean.push_back(static_cast<float>(mean));
+				statistics.deviation.push_back(static_cast<float>(std::sqrt(variance)));
+			}
+
+			return statistics;
+		}
+
+		/*
+		 * Fills weights, one per dimension, with 1 / deviation^2. A descriptor which is the
+		 * same for every grain can't tell them apart, so it's weighted 0.
+		 */
+		void getStandardWeights(float* weights) const noexcept
+		{
+			for (size_t dimension = 0; dimension < deviation.size(); dimension++)
+				weights[dimension] = deviation[dimension] > 1.0e-6f ? 1.0f / (deviation[dimension] * deviation[dimension]) : 0.0f;
+		}
+
+		std::vector<float> mean;
+		std::vector<float> deviation;
+	};
+
+	/*
+	 * One result of a nearest neighbour query: which grain, and how far it is from the
+	 * target as a squared euclidean distance in descriptor space, weighted as the query was.
+	 */
+	struct Neighbour
+	{
+		int grain = -1;
+		float distanceSquared = 0.0f;
+	};
+
+	/*
+	 * GrainAnalyser computes the descriptors of grains.
+	 *
+	 * Each grain is mixed to mono and cut into frames of 2^frameOrder samples. Each frame is
+	 * Hann windowed by an Stft for the spectral descriptors, and handed to a PitchEstimator for
+	 * pitch. The averaged spectra of a batch of grains are kept so a MelCepstrum can compute all
+	 * their MFCCs in one pass.
+	 *
+	 * All scratch space is allocated in the constructor, so analyse() is real time safe.
+	 * An analyser is not thread safe, so use one per thread.
+	 */
+	class GrainAnalyser
+	{
+	public:
+		using DescriptorVector = std::array<float, numDescriptors>;
+
+		GrainAnalyser(const double analysisSampleRate, const int frameOrder = 10)
+			: sampleRate(analysisSampleRate),
+			  cepstrum(analysisSampleRate, 1 << frameOrder, getCepstrumParameters()),
+			  pitchEstimator(analysisSampleRate, frameOrder, minimumPitch, maximumPitch),
+			  batch(static_cast<size_t>(maxBatchSize))
+		{
+			Stft::Parameters parameters;
+			parameters.frameOrder = frameOrder;
+			parameters.hopSize = 1 << frameOrder;
+			parameters.windowType = WindowType::hann;
+			stft.prepare(parameters);
+
+			powers.resize(static_cast<size_t>(stft.getNumBins() * maxBatchSize), 0.0f);
+		}
+
+		/*
+		 * Analyses grain and returns its descriptors, indexed by Descriptor.
+		 */
+		template <typename SampleType>
+		DescriptorVector analyse(const Grain<SampleType>& grain)
+		{
+			auto descriptors = describe(grain, powers.data());
+			cepstrum.compute(powers.data(), 0, 1, descriptors.data() + static_cast<size_t>(Descriptor::mfcc), 0);
+
+			return descriptors;
+		}
+
+		/*
+		 * Analyses numGrains grains into rows firstRow onwards of table. Their MFCCs are
+		 * computed a batch at a time, which is quicker than analysing the grains one by one.
+		 */
+		template <typename SampleType>
+		void analyse(const Grain<SampleType>* grains, const size_t numGrains, DescriptorTable& table, const size_t firstRow)
+		{
+			const auto numBins = static_cast<size_t>(stft.getNumBins());
+
+			for (size_t batchStart = 0; batchStart < numGrains; batchStart += static_cast<size_t>(maxBatchSize))
+			{
+				const auto batchSize = juce::jmin(static_cast<size_t>(maxBatchSize), numGrains - batchStart);
+
+				for (size_t i = 0; i < batchSize; i++)
+					batch[i] = describe(grains[batchStart + i], powers.data() + i * numBins);
+
+				cepstrum.compute(powers.data(), numBins, static_cast<int>(batchSize),
+					batch.front().data() + static_cast<size_t>(Descriptor::mfcc), static_cast<size_t>(numDescriptors));
+
+				for (size_t i = 0; i < batchSize; i++)
+					table.setRow(firstRow + batchStart + i, batch[i].data());
+			}
+		}
+
+		// The lowest and highest fundamentals, in hz, which pitch estimation looks for.
+		static constexpr double minimumPitch = 50.0;
+		static constexpr double maximumPitch = 2000.0;
+
+		// The most grains whose MFCCs are computed together.
+		static constexpr int maxBatchSize = 32;
+
+	private:
+		static MelCepstrum::Parameters getCepstrumParameters()
+		{
+			MelCepstrum::Parameters parameters;
+			parameters.numCoefficients = numMfccs;
+			parameters.maxBatchSize = maxBatchSize;
+			return parameters;
+		}
+
+		/*
+		 * Computes every descriptor of grain but the MFCCs, and leaves its averaged power
+		 * spectrum in power for them to be computed from.
+		 */
+		template <typename SampleType>
+		DescriptorVector describe(const Grain<SampleType>& grain, float* power)
+		{
+			DescriptorVector descriptors{};
+
+			const auto numSamples = grain.getNumSamples();
+			const auto numChannels = grain.getNumChannels();
+			const auto frameSize = stft.getFrameSize();
+			const auto numBins = stft.getNumBins();
+
+			juce::FloatVectorOperations::clear(power, numBins);
+
+			if (numSamples <= 0 || numChannels <= 0)
+				return descriptors;
+
+			auto sumOfSquares = 0.0;
+			auto zeroCrossings = 0;
+			auto previousSample = 0.0f;
+			auto numFrames = 0;
+			auto numBatched = 0;
+
+			for (auto frameStart = 0; frameStart < numSamples; frameStart += frameSize)
+			{
+				const auto frameLength = juce::jmin(frameSize, numSamples - frameStart);
+				auto* frame = stft.getFrame(numBatched++);
+
+				// Mix to mono into the next frame while measuring the time domain descriptors.
+				for (auto i = 0; i < frameLength; i++)
+				{
+					auto mono = 0.0f;
+					for (auto ch = 0; ch < numChannels; ch++)
+					{
+						const auto sample = static_cast<float>(grain.getReadPointer(ch)[frameStart + i]);
+						sumOfSquares += sample * sample;
+						mono += sample;
+					}
+
+					mono /= numChannels;
+
+					if (frameStart + i > 0 && (mono < 0.0f) != (previousSample < 0.0f))
+						zeroCrossings++;
+
+					previousSample = mono;
+					frame[i] = mono;
+				}
+
+				juce::FloatVectorOperations::clear(frame + frameLength, frameSize - frameLength);
+				pitchEstimator.addFrame(frame);
+				numFrames++;
+
+				if (numBatched == stft.getMaxBatchSize() || frameStart + frameSize >= numSamples)
+				{
+					stft.transform(numBatched);
+
+					for (auto batched = 0; batched < numBatched; batched++)
+						juce::FloatVectorOperations::add(power, stft.getSpectrum(batched), numBins);
+
+					numBatched = 0;
+				}
+			}
+
+			juce::FloatVectorOperations::multiply(power, 1.0f / numFrames, numBins);
+
+			descriptors[static_cast<size_t>(Descriptor::rms)] = static_cast<float>(std::sqrt(sumOfSquares / ((double)numSamples * numChannels)));
+			descriptors[static_cast<size_t>(Descriptor::zeroCrossingRate)] = numSamples > 1 ? zeroCrossings / (float)(numSamples - 1) : 0.0f;
+
+			computeSpectralShape(power, descriptors);
+
+			const auto estimate = pitchEstimator.estimate();
+			descriptors[static_cast<size_t>(Descriptor::pitch)] = estimate.pitch;
+			descriptors[static_cast<size_t>(Descriptor::pitchConfidence)] = estimate.confidence;
+
+			return descriptors;
+		}
+
+		// Spectral centroid and flatness of the averaged power spectrum.
+		void computeSpectralShape(const float* power, DescriptorVector& descriptors) const
+		{
+			const auto binWidth = sampleRate / stft.getFftSize();
+			const auto numBins = stft.getNumBins();
+			const auto epsilon = 1.0e-12;
+
+			auto weightedSum = 0.0;
+			auto magnitudeSum = 0.0;
+			auto logPowerSum = 0.0;
+			auto powerSum = 0.0;
+
+			// DC is skipped; it says nothing about timbre.
+			for (auto bin = 1; bin < numBins; bin++)
+			{
+				const auto binPower = (double)power[bin];
+				const auto magnitude = std::sqrt(binPower);
+
+				weightedSum += bin * binWidth * magnitude;
+				magnitudeSum += magnitude;
+				logPowerSum += std::log(binPower + epsilon);
+				powerSum += binPower;
+			}
+
+			const auto numUsedBins = numBins - 1;
+
+			descriptors[static_cast<size_t>(Descriptor::spectralCentroid)] = magnitudeSum > epsilon ? static_cast<float>(weightedSum / magnitudeSum) : 0.0f;
+			descriptors[static_cast<size_t>(Descriptor::spectralFlatness)] = powerSum > epsilon
+				? static_cast<float>(std::exp(logPowerSum / numUsedBins) / (powerSum / numUsedBins + epsilon))
+				: 0.0f;
+		}
+
+		const double sampleRate;
+
+		Stft stft;
+		MelCepstrum cepstrum;
+		PitchEstimator pitchEstimator;
+
+		// The power spectrum averaged over every frame of each grain in the batch, one after another.
+		std::vector<float> powers;
+		std::vector<DescriptorVector> batch;
+
+		JUCE_DECLARE_NON_COPYABLE(GrainAnalyser)
+	};
+
+	/*
+	 * analyseGrains computes the descriptors of every grain, in order, into a new
+	 * DescriptorTable with one row per grain.
+	 */
+	template <typename SampleType>
+	DescriptorTable analyseGrains(const std::vector<Grain<SampleType>>& grains, const double sampleRate)
+	{
+		DescriptorTable table(numDescriptors, grains.size());
+		GrainAnalyser analyser(sampleRate);
+		analyser.analyse(grains.data(), grains.size(), table, 0);
+
+		return table;
+	}
+
+	/*
+	 * analyseGrains spread across the threads of pool, with the calling thread working too.
+	 *
+	 * The grains are split into chunks of grainsPerChunk which each worker claims one at a
+	 * time from a shared counter, so threads which get quick grains simply take more chunks
+	 * instead of idling while others finish. Every grain's row is written to its own index,
+	 * so the table is identical to analyseGrains' whatever order the chunks run in.
+	 * Blocks until every grain has been analysed, or until shouldStop, if given, returns true.
+	 * It's polled before each chunk, and the rows of any chunks not yet started are left as 0.
+	 */
+	template <typename SampleType>
+	DescriptorTable analyseGrains(const std::vector<Grain<SampleType>>& grains, const double sampleRate, juce::ThreadPool& pool,
+		const size_t grainsPerChunk = 64, const std::function<bool()>& shouldStop = nullptr)
+	{
+		DescriptorTable table(numDescriptors, grains.size());
+
+		if (grains.empty())
+			return table;
+
+		const auto chunkSize = juce::jmax<size_t>(1, grainsPerChunk);
+		const auto numChunks = (grains.size() + chunkSize - 1) / chunkSize;
+		std::atomic<size_t> nextChunk{ 0 };
+
+		auto analyseChunks = [&]()
+		{
+			GrainAnalyser analyser(sampleRate);
+
+			for (auto chunk = nextChunk++; chunk < numChunks; chunk = nextChunk++)
+			{
+				if (shouldStop != nullptr && shouldStop())
+					return;
+
+				const auto start = chunk * chunkSize;
+				const auto end = juce::jmin(grains.size(), start + chunkSize);
+
+				analyser.analyse(grains.data() + start, end - start, table, start);
+			}
+		};
+
+		// The calling thread takes chunks too, so it only needs help with the rest.
+		runOnPool(&pool, static_cast<int>(juce::jmin<size_t>(numChunks - 1, std::numeric_limits<int>::max())), analyseChunks);
+
+		return table;
+	}
+}
+
+TEST_CASE("Descriptors")
+{
+	const auto sampleRate = 44100.0;
+	const auto length = 8192;
+
+	// A grain's worth of a 440hz sine followed by a grain's worth of white noise.
+	juce::AudioBuffer<float> audio(2, length * 2);
+	juce::Random random(42);
+
+	for (auto i = 0; i < length; i++)
+	{
+		const auto sine = 0.5f * std::sin(juce::MathConstants<float>::twoPi * 440.0f * i / (float)sampleRate);
+		const auto noise = random.nextFloat() * 2.0f - 1.0f;
+
+		for (auto ch = 0; ch < 2; ch++)
+		{
+			audio.setSample(ch, i, sine);
+			audio.setSample(ch, length + i, noise);
+		}
+	}
+
+	const std::vector<Palette::Grain<float>> grains = {
+		Palette::Grain<float>(audio, 0, length, 0, 2),
+		Palette::Grain<float>(audio, length, length, 0, 2)
+	};
+
+	const auto table = Palette::analyseGrains(grains, sampleRate);
+
+	const auto value = [&table](size_t grain, Palette::Descriptor descriptor) {
+		return table.getValue(grain, static_cast<int>(descriptor));
+	};
+
+	SUBCASE("The table has a row per grain and a column per descriptor")
+	{
+		CHECK(table.getNumGrains() == 2);
+		CHECK(table.getNumDimensions() == Palette::numDescriptors);
+		CHECK(table.getColumn(1) - table.getColumn(0) == Palette::DescriptorTable::columnAlignment);
+	}
+
+	SUBCASE("A sine is loud, tonal and pitched where it should be")
+	{
+		CHECK(value(0, Palette::Descriptor::rms) == doctest::Approx(0.5f / std::sqrt(2.0f)).epsilon(0.01));
+		CHECK(value(0, Palette::Descriptor::pitch) == doctest::Approx(69.0f).epsilon(0.0005));
+		CHECK(value(0, Palette::Descriptor::pitchConfidence) > 0.9f);
+		CHECK(value(0, Palette::Descriptor::spectralCentroid) == doctest::Approx(440.0f).epsilon(0.2));
+		CHECK(value(0, Palette::Descriptor::zeroCrossingRate) == doctest::Approx(880.0f / sampleRate).epsilon(0.05));
+		CHECK(value(0, Palette::Descriptor::spectralFlatness) < 0.1f);
+	}
+
+	SUBCASE("White noise is flat, bright and unpitched")
+	{
+		CHECK(value(1, Palette::Descriptor::spectralFlatness) > 0.5f);
+		CHECK(value(1, Palette::Descriptor::spectralCentroid) > 5000.0f);
+		CHECK(value(1, Palette::Descriptor::zeroCrossingRate) > 0.3f);
+		CHECK(value(1, Palette::Descriptor::pitch) == 0.0f);
+		CHECK(value(1, Palette::Descriptor::pitchConfidence) < 0.5f);
+	}
+
+	SUBCASE("MFCCs tell a tone from noise, and don't depend on how grains are batched")
+	{
+		Palette::GrainAnalyser analyser(sampleRate);
+		const auto sine = analyser.analyse(grains[0]);
+		const auto noise = analyser.analyse(grains[1]);
+
+		auto distanceSquared = 0.0f;
+		for (auto coefficient = 1; coefficient < Palette::numMfccs; coefficient++)
+		{
+			const auto index = static_cast<size_t>(Palette::Descriptor::mfcc) + static_cast<size_t>(coefficient);
+			distanceSquared += (sine[index] - noise[index]) * (sine[index] - noise[index]);
+		}
+
+		CHECK(distanceSquared > 1.0f);
+
+		for (auto coefficient = 0; coefficient < Palette::numMfccs; coefficient++)
+		{
+			const auto index = static_cast<size_t>(Palette::Descriptor::mfcc) + static_cast<size_t>(coefficient);
+			CHECK(value(0, static_cast<Palette::Descriptor>(index)) == sine[index]);
+			CHECK(value(1, static_cast<Palette::Descriptor>(index)) == noise[index]);
+		}
+	}
+
+	SUBCASE("Analysing across threads gives exactly the same table")
+	{
+		// Lots of small grains so there are many chunks to share out.
+		std::vector<Palette::Grain<float>> manyGrains;
+		for (auto start = 0; start + 500 <= audio.getNumSamples(); start += 250)
+			manyGrains.emplace_back(audio, start, 500, 0, 2);
+
+		juce::ThreadPool pool(4);
+		const auto serial = Palette::analyseGrains(manyGrains, sampleRate);
+		const auto parallel = Palette::analyseGrains(manyGrains, sampleRate, pool, 3);
+
+		REQUIRE(parallel.getNumGrains() == manyGrains.size());
+
+		for (auto dimension = 0; dimension < Palette::numDescriptors; dimension++)
+			for (size_t grain = 0; grain < manyGrains.size(); grain++)
+				CHECK(parallel.getValue(grain, dimension) == serial.getValue(grain, dimension));
+	}
+
+	SUBCASE("Statistics standardise every descriptor alike")
+	{
+		const auto statistics = Palette::DescriptorStatistics::measure(table);
+		REQUIRE(statistics.mean.size() == static_cast<size_t>(Palette::numDescriptors));
+
+		// Two grains, so each descriptor is its mean give or take half their difference.
+		const auto centroid = static_cast<int>(Palette::Descriptor::spectralCentroid);
+		const auto difference = value(1, Palette::Descriptor::spectralCentroid) - value(0, Palette::Descriptor::spectralCentroid);
+
+		CHECK(statistics.mean[static_cast<size_t>(centroid)] == doctest::Approx(value(0, Palette::Descriptor::spectralCentroid) + difference / 2));
+		CHECK(statistics.deviation[static_cast<size_t>(centroid)] == doctest::Approx(std::abs(difference) / 2).epsilon(1.0e-4));
+
+		// Weighted by them, the grains are two deviations apart in every dimension which differs.
+		std::vector<float> weights(static_cast<size_t>(Palette::numDescriptors));
+		statistics.getStandardWeights(weights.data());
+
+		for (auto dimension = 0; dimension < Palette::numDescriptors; dimension++)
+		{
+			const auto gap = table.getValue(1, dimension) - table.getValue(0, dimension);
+
+			if (weights[static_cast<size_t>(dimension)] > 0.0f)
+				CHECK(weights[static_cast<size_t>(dimension)] * gap * gap == doctest::Approx(4.0f).epsilon(1.0e-3));
+		}
+	}
+
+	SUBCASE("Silence has no pitch or spectrum")
+	{
+		juce::AudioBuffer<float> silence(1, 1000);
+		silence.clear();
+
+		Palette::GrainAnalyser analyser(sampleRate);
+		const auto descriptors = analyser.analyse(Palette::Grain<float>(silence, 0, 1000, 0, 1));
+
+		for (const auto descriptor : descriptors)
+			CHECK(descriptor == 0.0f);
+	}
+}
@@ -13,32 +13,79 @@
 #include "doctest.h"
 #include "JuceHeader.h"
 
+#include "Window.h"
+
 namespace Palette 
 {
 	/*
 	 * Grains are the fundamental building block of concatenative synthesis.
-	 * Each grain is some buffer of audio samples.
+	 * A grain does not own any samples. It is a view of numSamples samples, starting at
+	 * startSample, across the channels [startChannel, startChannel + numChannels) of a
+	 * source buffer - usually the single immutable buffer held by a Corpus. The source
+	 * must outlive the grain and must never be resized while grains refer to it.
 	 */
 	template <typename SampleType>
 	struct Grain
 	{
-		Grain(const juce::AudioBuffer<SampleType>& data) : sampleData(data) { }
-		// The collection of samples which will be played back.
-		juce::AudioBuffer<SampleType> sampleData;
+		Grain(const juce::AudioBuffer<SampleType>& sourceBuffer, int start, int length, int firstChannel, int channels,
+			const SampleType* windowTable = nullptr)
+			: source(&sourceBuffer), startSample(start), numSamples(length), startChannel(firstChannel), numChannels(channels),
+			  window(windowTable) { }
+
+		// Returns a pointer to the first sample of this grain in the given channel of the grain.
+		const SampleType* getReadPointer(int channel) const noexcept
+		{
+			jassert(channel >= 0 && channel < numChannels);
+			return source->getReadPointer(startChannel + channel, startSample);
+		}
+
+		int getNumSamples() const noexcept { return numSamples; }
+		int getNumChannels() const noexcept { return numChannels; }
+
+		// The buffer this grain views into. Never owned by the grain.
+		const juce::AudioBuffer<SampleType>* source;
+		int startSample;
+		int numSamples;
+		int startChannel;
+		int numChannels;
+
+		/*
+		 * The shared window table to fade this grain with, or nullptr if it isn't windowed.
+		 * The table spans the full grain length, so a grain cut short by the end of the
+		 * audio only uses the first numSamples values of it.
+		 */
+		const SampleType* window;
 	};
 
+	/*
+	 * Converts an overlap factor (how many grains cover any one sample) into
+	 * the hop length between grain starts, both in miliseconds.
+	 */
+	constexpr double hopLengthForOverlap(const double grainLength, const double overlapFactor)
+	{
+		return overlapFactor > 0 ? grainLength / overlapFactor : grainLength;
+	}
+
 	/*
 	 * createGrains splits an Audio file into Grains
 	 * and provides utilties for handling the data.
 	 *
+	 * No samples are copied: every grain returned is a view into audioData, so audioData
+	 * must stay alive (and unchanged in size) for as long as the grains are used.
+	 *
 	 * grainLength in terms of miliseconds
 	 * sampleRate in terms of samples per second.
+	 * hopLength in terms of miliseconds between the starts of consecutive grains. A hopLength
+	 * shorter than grainLength makes grains overlap, e.g. half of grainLength for 2x overlap.
+	 * windowType is the window every grain is tagged with for overlap-add playback. The window
+	 * table is computed once per grain length and shared, not applied to the samples.
 	 */
 	template <typename SampleType>
-	constexpr std::vector<Palette::Grain<SampleType>> createGrains(const juce::AudioBuffer<SampleType>& audioData, const double grainLength, const double sampleRate)
+	constexpr std::vector<Palette::Grain<SampleType>> createGrains(const juce::AudioBuffer<SampleType>& audioData, const double grainLength, const double sampleRate,
+		const double hopLength, const WindowType windowType)
 	{
-		// Return an empty vector if grainLength is less than or equal to zero.
-		if (grainLength <= 0)
+		// Return an empty vector if grainLength or hopLength is less than or equal to zero.
+		if (grainLength <= 0 || hopLength <= 0)
 			return std::vector<Palette::Grain<SampleType>>{};
 
 		/*
@@ -47,103 +94,55 @@ namespace Palette
 		 * or samplesPerSecond * grainLength. Since grainLength is ms we divide by 1000
 		 */
 		const auto samplesPerGrain = static_cast<int>(sampleRate * (grainLength / 1000));
+		const auto samplesPerHop = static_cast<int>(sampleRate * (hopLength / 1000));
 
-		/*
-		 * There must be a grain for each chunk of samples to be held. We round up because
-		 * we want to capture all samples of the audioData. The last grain will be padded with
-		 * zeros if there is remaining space.
-		 */
-		const auto numGrains = std::ceil(audioData.getNumSamples() / (double)samplesPerGrain);
-
-		DBG("Parsing " << audioData.getNumSamples() << " samples to partition into grains. ");
-		DBG("With a grainLength of " << grainLength << " there should be " << numGrains << " grains");
-		DBG("[ " << audioData.getNumSamples() << " / " << samplesPerGrain << " = " << numGrains << " ]");
-		
-		std::vector<Grain<SampleType>> grains;
+		// A grain or hop shorter than one sample can't hold anything.
+		if (samplesPerGrain <= 0 || samplesPerHop <= 0)
+			return std::vector<Palette::Grain<SampleType>>{};
 
 		const auto numChannels = audioData.getNumChannels();
+		const auto numSamples = audioData.getNumSamples();
 
 		/*
-		 * If there are not enough samples in the audio file to fit in one grain,
-		 * just return a single grain the AudioBuffer in audioData. This grain
-		 * will thus be shorter in length than samplesPerGrain but this behaviour
-		 * seems to be the best default. It's conceivable we may want to later adjust the
-		 * API to create a grain padded with zeros to fit the requested grain size.
+		 * There must be a grain for each hop until a grain reaches the end of the audio.
+		 * We round up because we want to capture all samples of the audioData. The last
+		 * grain will be shorter than the rest if there is remaining space.
 		 */
-		if (audioData.getNumSamples() < samplesPerGrain)
-		{
-			// Create buffer the size of audioData.getNumSamples()
-			auto buffer = juce::AudioBuffer<SampleType>(numChannels, audioData.getNumSamples());
-
-			for (auto ch = 0; ch < numChannels; ch++)
-				buffer.copyFrom(ch, 0, audioData, ch, 0, audioData.getNumSamples());
+		const auto numGrains = numSamples <= samplesPerGrain ? 1.0 : 1 + std::ceil((numSamples - samplesPerGrain) / (double)samplesPerHop);
 
-			grains.push_back(Palette::Grain<SampleType>(buffer));
+		std::vector<Grain<SampleType>> grains;
+		grains.reserve(static_cast<size_t>(numGrains));
 
-			return grains;
-		}
+		const auto* window = getWindowTable<SampleType>(windowType, samplesPerGrain);
 
 		/*
-		 * We walk through the data to be converted to grains one chunk at a time,
-		 * where each chunk is the size of samplesPerGrain. This will loop
-		 * enough times to fill each grain except possibly the last.
+		 * We walk through the data one hop at a time and hand out a view of the samplesPerGrain
+		 * samples starting there. The grain which reaches the end of the audio is the last one.
+		 * If it runs past the end (including when the audio is shorter than a single grain)
+		 * it's cut short. Views can't be padded, so anything reading a grain treats samples
+		 * past getNumSamples() as silence.
 		 */
-		auto partitionedSamples = 0;
-		for (; partitionedSamples < (audioData.getNumSamples() - samplesPerGrain); partitionedSamples += samplesPerGrain)
+		for (auto start = 0; start < numSamples; start += samplesPerHop)
 		{
-			// Create the buffer empty, with 2 channels, and samplesPerGrain space for samples.
-			auto buffer = juce::AudioBuffer<SampleType>(numChannels, samplesPerGrain);
+			const auto length = juce::jmin(samplesPerGrain, numSamples - start);
 
-			// Copy the data from the audioData AudioBuffer into a new buffer to be stored in a Grain.
-			// Copy into channel ch, starting at sample 0, from audioData, from channel ch, starting at
-			// an offset of partitionedSamples into audioData, and copy samplesPerGrain samples.
-			for (auto ch = 0; ch < numChannels; ch++)
-				buffer.copyFrom(ch, 0, audioData, ch, partitionedSamples, samplesPerGrain);
+			grains.emplace_back(audioData, start, length, 0, numChannels, window);
 
-			grains.push_back(Palette::Grain<SampleType>(buffer));
+			if (start + samplesPerGrain >= numSamples)
+				break;
 		}
 
-		/*
-		 * Fill last grain by zeroing out a grain then filling it as much as possible
-		 * with the remaining grains - only if there were samples left over from above.
-		 */
-		 // If partitionedSamples does not evenly divide by samplesPerGrain, there will be
-		 // leftover samples to partition. 
-		if (audioData.getNumSamples() % samplesPerGrain != 0)
-		{
-			const auto remainingSamples = audioData.getNumSamples() % samplesPerGrain;
-
-			// There should not be more than one grains worth of samples leftover.
-			jassert(remainingSamples <= samplesPerGrain);
-
-			auto buffer = juce::AudioBuffer<SampleType>(2, samplesPerGrain);
-			for (auto ch = 0; ch < numChannels; ch++)
-				buffer.copyFrom(ch, 0, audioData, ch, partitionedSamples, remainingSamples);
-
-			// Check if there's remaining space in the buffer which couldn't be filled
-			// with samples. This space will need to be zeroed out to prevent audio artifacts.
-			if (partitionedSamples + remainingSamples < samplesPerGrain)
-			{
-				// Zero out any remaining space for samples in the buffer.
-				// 2 channels to the buffer
-				// samplesPerGrain sized buffer
-				// keepExistingContent = true
-				// clearExtraSpace = true
-				// avoidReallocating = false
-				buffer.setSize(2,
-					samplesPerGrain,
-					true,
-					true,
-					false);
-			}
-
-			grains.push_back(Palette::Grain<SampleType>(buffer));
-		}
-
-		DBG("Partitioned " << grains.size() << " grains");
-
 		return grains;
 	}
+
+	/*
+	 * createGrains with back-to-back, unwindowed grains: each grain starts where the last one ended.
+	 */
+	template <typename SampleType>
+	constexpr std::vector<Palette::Grain<SampleType>> createGrains(const juce::AudioBuffer<SampleType>& audioData, const double grainLength, const double sampleRate)
+	{
+		return createGrains(audioData, grainLength, sampleRate, grainLength, WindowType::rectangular);
+	}
 }
 
 TEST_CASE("Grain")
@@ -154,14 +153,15 @@ TEST_CASE("Grain")
 
 		auto* reader = formatManager.createReaderFor(juce::File(location));
 
-		juce::AudioBuffer<float> fileBuffer;
+		// Grains are views, so the buffer they point into has to outlive them.
+		auto fileBuffer = std::make_shared<juce::AudioBuffer<float>>();
 
 		if (reader != nullptr)
 		{
 			auto duration = reader->lengthInSamples / reader->sampleRate;
 
-			fileBuffer.setSize(reader->numChannels, (int)reader->lengthInSamples);
-			reader->read(&fileBuffer,
+			fileBuffer->setSize(reader->numChannels, (int)reader->lengthInSamples);
+			reader->read(fileBuffer.get(),
 				0,
 				(int)reader->lengthInSamples,
 				0,
@@ -170,8 +170,9 @@ TEST_CASE("Grain")
 		}
 
 		auto grainsAndSamples = std::make_tuple(
-			Palette::createGrains(fileBuffer, grainLength, sampleRate),
-			reader->lengthInSamples);
+			Palette::createGrains(*fileBuffer, grainLength, sampleRate),
+			reader->lengthInSamples,
+			fileBuffer);
 
 		delete reader;
 
@@ -192,16 +193,31 @@ TEST_CASE("Grain")
 	auto grainLength = 100;
 	auto sampleRate = 44100;
 	
-	auto [snareGrains100, snareLengthInSamples] = fileToGrains(snareLoc, grainLength, sampleRate);
+	auto [snareGrains100, snareLengthInSamples, snareBuffer] = fileToGrains(snareLoc, grainLength, sampleRate);
 
 	SUBCASE("snare.wav contains 8113 samples at a sampleRate of 44100 hz with a grainLength of 100 ms")
 	{
 		CHECK(snareGrains100.size() == numGrains(snareLengthInSamples, sampleRate, grainLength));
 	}
 
+	SUBCASE("snare.wav grains are views into the decoded file, not copies")
+	{
+		const auto samplesPerGrain = (int)(sampleRate * (grainLength / 1000.0));
+
+		for (size_t i = 0; i < snareGrains100.size(); i++)
+		{
+			CHECK(snareGrains100[i].source == snareBuffer.get());
+			CHECK(snareGrains100[i].startSample == (int)i * samplesPerGrain);
+			CHECK(snareGrains100[i].getReadPointer(0) == snareBuffer->getReadPointer(0, (int)i * samplesPerGrain));
+		}
+
+		// The last grain only covers the samples which were left over.
+		CHECK(snareGrains100.back().getNumSamples() == snareLengthInSamples % samplesPerGrain);
+	}
+
 	grainLength = 1000;
 
-	auto [snareGrains1000, _] = fileToGrains(snareLoc, grainLength, sampleRate);
+	auto [snareGrains1000, _, snareBuffer1000] = fileToGrains(snareLoc, grainLength, sampleRate);
 	SUBCASE("snare.wav contains 8113 samples at a sampleRate of 44100 hz with a grainLength of 1000 ms")
 	{
 		CHECK(snareGrains1000.size() == numGrains(snareLengthInSamples, sampleRate, grainLength));
@@ -209,7 +225,7 @@ TEST_CASE("Grain")
 	
 	grainLength = 0;
 
-	auto [snareGrains0, __] = fileToGrains(snareLoc, grainLength, sampleRate);
+	auto [snareGrains0, __, snareBuffer0] = fileToGrains(snareLoc, grainLength, sampleRate);
 	SUBCASE("snare.wav contains 8113 samples at a sampleRate of 44100 hz with a grainLength of 0 ms")
 	{
 		CHECK(snareGrains0.size() == 0);
@@ -220,17 +236,60 @@ TEST_CASE("Grain")
 	sampleRate = 48000;
 	grainLength = 100;
 
-	auto [springGrains, springLengthInSamples] = fileToGrains(springLoc, grainLength, sampleRate);
+	auto [springGrains, springLengthInSamples, springBuffer] = fileToGrains(springLoc, grainLength, sampleRate);
 
 	SUBCASE("spring.wav contains 176400 samples at a sampleRate of 48000 hz with a grainLength of 100 ms")
 	{
 		CHECK(springGrains.size() == numGrains(springLengthInSamples, sampleRate, grainLength));
 	}
 
-	auto [bangGrains, bangLengthInSamples] = fileToGrains(bangLoc, grainLength, sampleRate);
+	auto [bangGrains, bangLengthInSamples, bangBuffer] = fileToGrains(bangLoc, grainLength, sampleRate);
 
 	SUBCASE("loudanime.wav contains 229946 samples at a sampleRate of 48000 hz with a grainLength of 100 ms")
 	{
 		CHECK(bangGrains.size() == numGrains(bangLengthInSamples, sampleRate, grainLength));
 	}
-}
\ No newline at end of file
+}
+
+TEST_CASE("Overlapping grains")
+{
+	const auto sampleRate = 1000.0;
+	juce::AudioBuffer<float> audio(1, 2500);
+	audio.clear();
+
+	SUBCASE("A hop of half the grain length doubles the grains")
+	{
+		const auto grains = Palette::createGrains(audio, 1000, sampleRate, Palette::hopLengthForOverlap(1000, 2), Palette::WindowType::hann);
+
+		// Grains start at 0, 500, 1000 and 1500, and the one at 1500 reaches the end.
+		REQUIRE(grains.size() == 4);
+		CHECK(grains[1].startSample == 500);
+		CHECK(grains[3].getNumSamples() == 1000);
+	}
+
+	SUBCASE("Grains of the same length share one window table")
+	{
+		const auto grains = Palette::createGrains(audio, 1000, sampleRate, 250, Palette::WindowType::blackman);
+
+		REQUIRE(grains.size() > 1);
+		CHECK(grains.front().window != nullptr);
+
+		for (const auto& grain : grains)
+			CHECK(grain.window == grains.front().window);
+
+		CHECK(grains.front().window == Palette::getWindowTable<float>(Palette::WindowType::blackman, 1000));
+	}
+
+	SUBCASE("Back-to-back grains aren't windowed")
+	{
+		const auto grains = Palette::createGrains(audio, 1000, sampleRate);
+
+		CHECK(grains.size() == 3);
+		CHECK(grains.front().window == nullptr);
+	}
+
+	SUBCASE("A hop of zero produces no grains")
+	{
+		CHECK(Palette::createGrains(audio, 1000, sampleRate, 0, Palette::WindowType::hann).empty());
+	}
+}
@@ -0,0 +1,274 @@
+/*
+  ==============================================================================
+
+    GrainScheduler.cpp
+    Created: 16 Oct 2026 6:24:47pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#include "GrainScheduler.h"
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+#endif
+
+namespace Palette
+{
+	namespace
+	{
+		/*
+		 * One voice's part of a mix. Sample i adds samples[i] * window[i] * (gain + gainStep * i)
+		 * to the output.
+		 */
+		struct VoiceSpan
+		{
+			const float* samples;
+			const float* window;
+			float gain;
+			float gainStep;
+		};
+
+		// Mixes samples [first, numSamples) of every span into output.
+		void mixScalar(float* output, const VoiceSpan* spans, const int numSpans, const int first, const int numSamples) noexcept
+		{
+			for (auto i = first; i < numSamples; i++)
+			{
+				auto sum = output[i];
+
+				for (auto v = 0; v < numSpans; v++)
+					sum += spans[v].samples[i] * spans[v].window[i] * (spans[v].gain + spans[v].gainStep * static_cast<float>(i));
+
+				output[i] = sum;
+			}
+		}
+
+		/*
+		 * Mixes every span into output in one pass, so each output sample is loaded and
+		 * stored once however many voices are added to it.
+		 */
+		void mix(float* output, const VoiceSpan* spans, const int numSpans, const int numSamples) noexcept
+		{
+			jassert(numSpans <= GrainScheduler::voicesPerPass);
+
+			auto i = 0;
+
+		   #if JUCE_INTEL
+			__m128 gains[GrainScheduler::voicesPerPass];
+			__m128 gainSteps[GrainScheduler::voicesPerPass];
+
+			// Gains for samples 0-3. Every four samples they each move on by four steps.
+			for (auto v = 0; v < numSpans; v++)
+			{
+				gainSteps[v] = _mm_set1_ps(spans[v].gainStep * 4.0f);
+				gains[v] = _mm_add_ps(_mm_set1_ps(spans[v].gain), _mm_mul_ps(_mm_set1_ps(spans[v].gainStep), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f)));
+			}
+
+			for (; i + 4 <= numSamples; i += 4)
+			{
+				auto sum = _mm_loadu_ps(output + i);
+
+				for (auto v = 0; v < numSpans; v++)
+				{
+					const auto windowed = _mm_mul_ps(_mm_loadu_ps(spans[v].samples + i), _mm_loadu_ps(spans[v].window + i));
+					sum = _mm_add_ps(sum, _mm_mul_ps(windowed, gains[v]));
+					gains[v] = _mm_add_ps(gains[v], gainSteps[v]);
+				}
+
+				_mm_storeu_ps(output + i, sum);
+			}
+		   #endif
+
+			mixScalar(output, spans, numSpans, i, numSamples);
+		}
+	}
+
+	void GrainScheduler::prepare(const int maxVoices, const int maximumBlockSize)
+	{
+		maxActiveVoices = juce::jmax(0, maxVoices);
+
+		voices.clear();
+		voices.reserve(static_cast<size_t>(maxActiveVoices));
+
+		blockSize = juce::jmax(0, maximumBlockSize);
+		fadeScratch.assign(static_cast<size_t>(blockSize * voicesPerPass), 0.0f);
+
+		gain = targetGain;
+	}
+
+	void GrainScheduler::reset() noexcept
+	{
+		voices.clear();
+		gain = targetGain;
+	}
+
+	void GrainScheduler::setGain(const float newGain) noexcept
+	{
+		targetGain = newGain;
+	}
+
+	GrainScheduler::VoiceId GrainScheduler::startGrain(const Grain<float>& grain, const int delay, const float voiceGain, const juce::uint64 generation) noexcept
+	{
+		if (getNumActiveVoices() == maxActiveVoices || grain.getNumSamples() <= 0 || grain.getNumChannels() <= 0)
+			return noVoice;
+
+		const auto id = nextVoiceId++;
+		if (nextVoiceId == noVoice)
+			nextVoiceId++;
+
+		// Never beyond the capacity reserved in prepare(), so this doesn't allocate.
+		voices.push_back({ grain, 0, juce::jmax(0, delay), voiceGain, voiceGain, generation, id });
+		return id;
+	}
+
+	bool GrainScheduler::setVoiceGain(const VoiceId voice, const float newGain) noexcept
+	{
+		for (auto& playing : voices)
+		{
+			if (playing.id == voice)
+			{
+				playing.targetGain = newGain;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	juce::uint64 GrainScheduler::getOldestGeneration(const juce::uint64 ifNonePlaying) const noexcept
+	{
+		auto oldest = ifNonePlaying;
+
+		for (const auto& voice : voices)
+			oldest = juce::jmin(oldest, voice.generation);
+
+		return oldest;
+	}
+
+	void GrainScheduler::fillFade(const Voice& voice, float* gains, const int numSamples) const noexcept
+	{
+		const auto length = voice.grain.getNumSamples();
+		const auto fadeLength = juce::jmin(unwindowedFadeLength, length / 2);
+
+		for (auto i = 0; i < numSamples; i++)
+		{
+			const auto position = voice.position + i;
+			const auto fromEdge = juce::jmin(position, length - 1 - position);
+
+			gains[i] = fromEdge < fadeLength ? static_cast<float>(fromEdge) / static_cast<float>(fadeLength) : 1.0f;
+		}
+	}
+
+	void GrainScheduler::renderNextBlock(juce::AudioBuffer<float>& output, const int startSample, const int numSamples) noexcept
+	{
+		jassert(numSamples <= blockSize);
+
+		if (numSamples <= 0)
+			return;
+
+		const auto blockLength = static_cast<float>(numSamples);
+
+		/*
+		 * Voices playing for the whole block are mixed voicesPerPass at a time. Voices starting
+		 * or finishing partway through cover different ranges, so they're mixed on their own.
+		 */
+		Voice* batch[voicesPerPass];
+		auto batchSize = 0;
+
+		const auto mixVoices = [&](Voice* const* toMix, const int numToMix, const int offset, const int numToRender) {
+			VoiceSpan spans[voicesPerPass];
+
+			for (auto v = 0; v < numToMix; v++)
+			{
+				const auto& voice = *toMix[v];
+				if (voice.grain.window != nullptr)
+				{
+					spans[v].window = voice.grain.window + voice.position;
+				}
+				else
+				{
+					auto* fade = fadeScratch.data() + v * blockSize;
+					fillFade(voice, fade, numToRender);
+					spans[v].window = fade;
+				}
+
+				/*
+				 * The voice's gain times the master gain ramps linearly across the block, from
+				 * their product at its start to their product once both reach their targets.
+				 */
+				const auto startGain = voice.gain * gain;
+				const auto gainStep = (voice.targetGain * targetGain - startGain) / blockLength;
+
+				spans[v].gain = startGain + gainStep * static_cast<float>(offset);
+				spans[v].gainStep = gainStep;
+			}
+
+			for (auto channel = 0; channel < output.getNumChannels(); channel++)
+			{
+				for (auto v = 0; v < numToMix; v++)
+				{
+					const auto& grain = toMix[v]->grain;
+					spans[v].samples = grain.getReadPointer(channel % grain.getNumChannels()) + toMix[v]->position;
+				}
+
+				mix(output.getWritePointer(channel, startSample + offset), spans, numToMix, numToRender);
+			}
+		};
+
+		for (auto& voice : voices)
+		{
+			if (voice.delay >= numSamples)
+				continue;
+
+			const auto numToRender = juce::jmin(numSamples - voice.delay, voice.grain.getNumSamples() - voice.position);
+
+			if (voice.delay > 0 || numToRender < numSamples)
+			{
+				auto* single = &voice;
+				mixVoices(&single, 1, voice.delay, numToRender);
+				continue;
+			}
+
+			batch[batchSize++] = &voice;
+
+			if (batchSize == voicesPerPass)
+			{
+				mixVoices(batch, batchSize, 0, numSamples);
+				batchSize = 0;
+			}
+		}
+
+		if (batchSize > 0)
+			mixVoices(batch, batchSize, 0, numSamples);
+
+		gain = targetGain;
+
+		// Move every voice on, replacing finished ones with the last, which is then looked at in their place.
+		for (size_t v = 0; v < voices.size();)
+		{
+			auto& voice = voices[v];
+			voice.gain = voice.targetGain;
+
+			if (voice.delay >= numSamples)
+			{
+				voice.delay -= numSamples;
+				v++;
+				continue;
+			}
+
+			voice.position += numSamples - voice.delay;
+			voice.delay = 0;
+
+			if (voice.position >= voice.grain.getNumSamples())
+			{
+				voice = voices.back();
+				voices.pop_back();
+			}
+			else
+			{
+				v++;
+			}
+		}
+	}
+}
@@ -0,0 +1,343 @@
+/*
+  ==============================================================================
+
+    GrainScheduler.h
+    Created: 16 Oct 2026 6:24:47pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+#include "Grain.h"
+
+namespace Palette
+{
+	/*
+	 * GrainScheduler plays grains back on the audio thread. Each grain started is given a
+	 * voice from a pool allocated in prepare(), delayed to start on an exact sample, and
+	 * overlap-added into the output with its window and gain.
+	 *
+	 * Voices playing through a whole block are mixed several at a time, so each output
+	 * sample is read and written once per pass rather than once per voice.
+	 *
+	 * Once prepared nothing allocates, locks or makes a system call, so every function
+	 * other than prepare() is safe to call from processBlock.
+	 */
+	class GrainScheduler
+	{
+	public:
+		GrainScheduler() = default;
+
+		/*
+		 * Allocates room for maxVoices grains playing at once, rendered in blocks of
+		 * up to maximumBlockSize samples. Stops any grains playing.
+		 */
+		void prepare(int maxVoices, int maximumBlockSize);
+
+		// Stops every grain immediately, and jumps straight to the gain last set without ramping.
+		void reset() noexcept;
+
+		/*
+		 * Sets the gain every voice is scaled by. The next block rendered ramps smoothly
+		 * from the previous gain to this one, so changing it doesn't click.
+		 */
+		void setGain(float newGain) noexcept;
+		float getGain() const noexcept { return targetGain; }
+
+		// Identifies a voice started by startGrain(). noVoice is never given to one.
+		using VoiceId = juce::uint32;
+		static constexpr VoiceId noVoice = 0;
+
+		/*
+		 * Starts playing grain delay samples into the next block rendered (which may be
+		 * beyond that block). The grain's samples are read from its source until it finishes,
+		 * so the source must outlive it. Returns the voice playing it, or noVoice, dropping
+		 * the grain, if every voice is in use.
+		 *
+		 * generation is the generation of the corpus the grain came from (see CorpusExchange),
+		 * so the corpus can be kept alive until the grain finishes.
+		 */
+		VoiceId startGrain(const Grain<float>& grain, int delay, float voiceGain, juce::uint64 generation = 0) noexcept;
+
+		/*
+		 * Sets the gain of one voice. Like setGain(), the next block rendered ramps smoothly
+		 * to it. Returns false if the voice's grain has already finished.
+		 */
+		bool setVoiceGain(VoiceId voice, float newGain) noexcept;
+
+		/*
+		 * Adds the next numSamples samples of every playing grain into output, starting at
+		 * startSample. numSamples must be no more than the maximumBlockSize prepared for.
+		 * Grains with fewer channels than output are repeated across the extra channels.
+		 */
+		void renderNextBlock(juce::AudioBuffer<float>& output, int startSample, int numSamples) noexcept;
+
+		/*
+		 * Returns the oldest corpus generation a playing grain came from, or ifNonePlaying
+		 * if that's older still.
+		 */
+		juce::uint64 getOldestGeneration(juce::uint64 ifNonePlaying) const noexcept;
+
+		int getNumActiveVoices() const noexcept { return static_cast<int>(voices.size()); }
+		int getMaxVoices() const noexcept { return maxActiveVoices; }
+
+		/*
+		 * Grains without a window are faded in and out over this many samples (or half their
+		 * length if that's shorter) so they don't click.
+		 */
+		static constexpr int unwindowedFadeLength = 64;
+
+		// How many voices are mixed into the output in a single pass.
+		static constexpr int voicesPerPass = 4;
+
+	private:
+		struct Voice
+		{
+			Grain<float> grain;
+			// How far through the grain playback has got.
+			int position;
+			// Samples left before the grain starts.
+			int delay;
+			// The gain at the start of the next block, and the one it ramps to by the end.
+			float gain;
+			float targetGain;
+			juce::uint64 generation;
+			VoiceId id;
+		};
+
+		// Writes the fade for numSamples samples of an unwindowed voice from its position into gains.
+		void fillFade(const Voice& voice, float* gains, int numSamples) const noexcept;
+
+		// The playing voices, with room reserved for maxActiveVoices so starting one never allocates.
+		std::vector<Voice> voices;
+		int maxActiveVoices = 0;
+		int blockSize = 0;
+
+		float gain = 1.0f;
+		float targetGain = 1.0f;
+
+		VoiceId nextVoiceId = noVoice + 1;
+
+		// Fades for up to voicesPerPass unwindowed voices, blockSize samples each.
+		std::vector<float> fadeScratch;
+	};
+}
+
+TEST_CASE("GrainScheduler")
+{
+	// A source of ones makes it easy to see exactly which samples a grain covers.
+	juce::AudioBuffer<float> source(1, 1000);
+	for (auto i = 0; i < source.getNumSamples(); i++)
+		source.setSample(0, i, 1.0f);
+
+	juce::AudioBuffer<float> output(2, 64);
+	output.clear();
+
+	Palette::GrainScheduler scheduler;
+	scheduler.prepare(4, 64);
+
+	const auto hannGrain = Palette::Grain<float>(source, 0, 100, 0, 1, Palette::getWindowTable<float>(Palette::WindowType::hann, 100));
+
+	SUBCASE("Grains start on the exact sample they're scheduled for")
+	{
+		const auto flatGrain = Palette::Grain<float>(source, 0, 200, 0, 1);
+
+		REQUIRE(scheduler.startGrain(flatGrain, 10, 0.5f));
+		scheduler.renderNextBlock(output, 0, 64);
+
+		for (auto i = 0; i < 10; i++)
+			CHECK(output.getSample(0, i) == 0.0f);
+
+		// Unwindowed grains fade in, then play at their gain on every channel.
+		const auto halfFade = Palette::GrainScheduler::unwindowedFadeLength / 2;
+		CHECK(output.getSample(0, 10) == 0.0f);
+		CHECK(output.getSample(0, 10 + halfFade) == doctest::Approx(0.25f));
+		CHECK(output.getSample(1, 10 + halfFade) == doctest::Approx(0.25f));
+
+		output.clear();
+		scheduler.renderNextBlock(output, 0, 64);
+		CHECK(output.getSample(0, 20) == doctest::Approx(0.5f));
+	}
+
+	SUBCASE("Delays longer than a block carry over to the next")
+	{
+		REQUIRE(scheduler.startGrain(hannGrain, 100, 1.0f));
+		scheduler.renderNextBlock(output, 0, 64);
+
+		CHECK(output.getMagnitude(0, 0, 64) == 0.0f);
+
+		output.clear();
+		scheduler.renderNextBlock(output, 0, 64);
+
+		// The grain starts 100 - 64 = 36 samples into the second block, where its window rises from zero.
+		CHECK(output.getMagnitude(0, 0, 37) == 0.0f);
+		CHECK(output.getSample(0, 63) > 0.0f);
+	}
+
+	SUBCASE("Hann grains at half overlap sum to a constant")
+	{
+		juce::AudioBuffer<float> longOutput(1, 400);
+		longOutput.clear();
+
+		Palette::GrainScheduler longScheduler;
+		longScheduler.prepare(8, 400);
+
+		for (auto start = 0; start < 400; start += 50)
+			longScheduler.startGrain(hannGrain, start, 1.0f);
+
+		longScheduler.renderNextBlock(longOutput, 0, 400);
+
+		for (auto i = 100; i < 350; i++)
+			CHECK(longOutput.getSample(0, i) == doctest::Approx(1.0f));
+	}
+
+	SUBCASE("Mixing many voices at once matches mixing them one by one")
+	{
+		juce::AudioBuffer<float> noise(2, 1000);
+		juce::Random random(3);
+		for (auto channel = 0; channel < 2; channel++)
+			for (auto i = 0; i < noise.getNumSamples(); i++)
+				noise.setSample(channel, i, random.nextFloat() * 2.0f - 1.0f);
+
+		const auto* window = Palette::getWindowTable<float>(Palette::WindowType::blackman, 300);
+
+		Palette::GrainScheduler many;
+		many.prepare(16, 64);
+
+		juce::AudioBuffer<float> expected(2, 64 * 4);
+		expected.clear();
+
+		// Some voices play whole blocks, some start or finish partway through, some are unwindowed.
+		for (auto v = 0; v < 11; v++)
+		{
+			const auto start = v * 37;
+			const auto length = 100 + v * 17;
+			const auto voiceGain = 0.1f * (float)(v + 1);
+			const auto delay = (v * 13) % 70;
+			const auto grain = Palette::Grain<float>(noise, start, length, v % 2, 1, v % 3 == 0 ? nullptr : window);
+
+			REQUIRE(many.startGrain(grain, delay, voiceGain));
+
+			Palette::GrainScheduler one;
+			one.prepare(1, 64);
+			one.startGrain(grain, delay, voiceGain);
+
+			for (auto block = 0; block < 4; block++)
+				one.renderNextBlock(expected, block * 64, 64);
+		}
+
+		juce::AudioBuffer<float> mixed(2, 64 * 4);
+		mixed.clear();
+
+		for (auto block = 0; block < 4; block++)
+			many.renderNextBlock(mixed, block * 64, 64);
+
+		for (auto channel = 0; channel < 2; channel++)
+			for (auto i = 0; i < mixed.getNumSamples(); i++)
+				CHECK(mixed.getSample(channel, i) == doctest::Approx(expected.getSample(channel, i)).epsilon(1e-5));
+	}
+
+	SUBCASE("Gain changes ramp across the next block")
+	{
+		const auto flatGrain = Palette::Grain<float>(source, 0, 1000, 0, 1);
+
+		scheduler.startGrain(flatGrain, 0, 1.0f);
+		scheduler.renderNextBlock(output, 0, 64);
+
+		output.clear();
+		scheduler.setGain(0.0f);
+		scheduler.renderNextBlock(output, 0, 64);
+
+		CHECK(output.getSample(0, 0) == doctest::Approx(1.0f));
+		CHECK(output.getSample(0, 32) == doctest::Approx(0.5f));
+		for (auto i = 1; i < 64; i++)
+			CHECK(output.getSample(0, i) < output.getSample(0, i - 1));
+
+		output.clear();
+		scheduler.renderNextBlock(output, 0, 64);
+		CHECK(output.getMagnitude(0, 0, 64) == 0.0f);
+	}
+
+	SUBCASE("A single voice's gain ramps without touching the others")
+	{
+		const auto flatGrain = Palette::Grain<float>(source, 0, 1000, 0, 1);
+
+		const auto fading = scheduler.startGrain(flatGrain, 0, 1.0f);
+		const auto steady = scheduler.startGrain(flatGrain, 0, 0.25f);
+		REQUIRE(fading != Palette::GrainScheduler::noVoice);
+		REQUIRE(steady != Palette::GrainScheduler::noVoice);
+		CHECK(fading != steady);
+
+		scheduler.renderNextBlock(output, 0, 64);
+
+		output.clear();
+		CHECK(scheduler.setVoiceGain(fading, 0.0f));
+		scheduler.renderNextBlock(output, 0, 64);
+
+		CHECK(output.getSample(0, 0) == doctest::Approx(1.25f));
+		CHECK(output.getSample(0, 32) == doctest::Approx(0.75f));
+		for (auto i = 1; i < 64; i++)
+			CHECK(output.getSample(0, i) < output.getSample(0, i - 1));
+
+		// From then on only the steady voice is heard, and ramps with the scheduler's gain on top.
+		output.clear();
+		scheduler.setGain(0.5f);
+		scheduler.renderNextBlock(output, 0, 64);
+		CHECK(output.getSample(0, 0) == doctest::Approx(0.25f));
+		CHECK(output.getSample(0, 32) == doctest::Approx(0.1875f));
+
+		output.clear();
+		scheduler.renderNextBlock(output, 0, 64);
+		CHECK(output.getSample(0, 0) == doctest::Approx(0.125f));
+		CHECK(output.getSample(0, 63) == doctest::Approx(0.125f));
+	}
+
+	SUBCASE("Setting the gain of a finished voice does nothing")
+	{
+		const auto voice = scheduler.startGrain(hannGrain, 0, 1.0f);
+
+		scheduler.renderNextBlock(output, 0, 64);
+		scheduler.renderNextBlock(output, 0, 64);
+
+		CHECK_FALSE(scheduler.setVoiceGain(voice, 0.5f));
+		CHECK_FALSE(scheduler.setVoiceGain(Palette::GrainScheduler::noVoice, 0.5f));
+	}
+
+	SUBCASE("Voices are reused once their grains finish")
+	{
+		for (auto i = 0; i < 4; i++)
+			REQUIRE(scheduler.startGrain(hannGrain, 0, 1.0f));
+
+		CHECK_FALSE(scheduler.startGrain(hannGrain, 0, 1.0f));
+		CHECK(scheduler.getNumActiveVoices() == 4);
+
+		scheduler.renderNextBlock(output, 0, 64);
+		scheduler.renderNextBlock(output, 0, 64);
+
+		CHECK(scheduler.getNumActiveVoices() == 0);
+		CHECK(scheduler.startGrain(hannGrain, 0, 1.0f));
+	}
+
+	SUBCASE("The oldest corpus generation playing is tracked")
+	{
+		CHECK(scheduler.getOldestGeneration(5) == 5);
+
+		scheduler.startGrain(hannGrain, 0, 1.0f, 3);
+		scheduler.startGrain(hannGrain, 50, 1.0f, 4);
+		CHECK(scheduler.getOldestGeneration(5) == 3);
+		CHECK(scheduler.getOldestGeneration(2) == 2);
+
+		// The first grain finishes after 100 samples, the second after 150.
+		scheduler.renderNextBlock(output, 0, 64);
+		scheduler.renderNextBlock(output, 0, 64);
+		CHECK(scheduler.getOldestGeneration(5) == 4);
+
+		scheduler.renderNextBlock(output, 0, 64);
+		CHECK(scheduler.getOldestGeneration(5) == 5);
+	}
+}
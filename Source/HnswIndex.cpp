@@ -0,0 +1,382 @@
+/*
+  ==============================================================================
+
+    HnswIndex.cpp
+    Created: 16 Oct 2026 6:20:16pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#include "HnswIndex.h"
+
+#include "ParallelWork.h"
+
+namespace Palette
+{
+	void HnswIndex::SearchScratch::prepare(const int numPointsToVisit, const int breadth)
+	{
+		visitedTags.assign(static_cast<size_t>(numPointsToVisit), 0);
+		currentTag = 0;
+		beam.resize(static_cast<size_t>(juce::jmax(1, breadth)));
+		beamSize = 0;
+	}
+
+	void HnswIndex::SearchScratch::startSearch() noexcept
+	{
+		// Bumping the tag forgets every visit at once. Only when it wraps do the tags need clearing.
+		if (++currentTag == 0)
+		{
+			std::fill(visitedTags.begin(), visitedTags.end(), 0u);
+			currentTag = 1;
+		}
+
+		beamSize = 0;
+	}
+
+	bool HnswIndex::SearchScratch::markVisited(const int point) noexcept
+	{
+		auto& tag = visitedTags[static_cast<size_t>(point)];
+
+		if (tag == currentTag)
+			return false;
+
+		tag = currentTag;
+		return true;
+	}
+
+	void HnswIndex::build(const DescriptorTable& descriptors, const Parameters& parameters, juce::ThreadPool* pool, const float* weights)
+	{
+		numDimensions = descriptors.getNumDimensions();
+
+		if (weights != nullptr)
+			buildWeights.assign(weights, weights + numDimensions);
+		else
+			buildWeights.clear();
+		numPoints = static_cast<int>(descriptors.getNumGrains());
+		maxDegree = juce::jmax(2, parameters.maxDegree);
+		constructionBreadth = juce::jmax(maxDegree, parameters.constructionBreadth);
+
+		points.resize(static_cast<size_t>(numPoints) * static_cast<size_t>(numDimensions));
+		for (auto point = 0; point < numPoints; point++)
+			descriptors.getRow(static_cast<size_t>(point), points.data() + static_cast<size_t>(point) * numDimensions);
+
+		/*
+		 * Each grain's top layer is drawn from an exponential distribution, so every layer
+		 * holds about 1 / maxDegree of the grains of the layer below it.
+		 */
+		juce::Random random(parameters.seed);
+		const auto levelScale = 1.0 / std::log((double)maxDegree);
+
+		levels.resize(static_cast<size_t>(numPoints));
+		upperLinkOffsets.resize(static_cast<size_t>(numPoints));
+
+		size_t numUpperLinks = 0;
+		for (auto point = 0; point < numPoints; point++)
+		{
+			const auto level = juce::jmin(16, static_cast<int>(-std::log(1.0 - random.nextDouble()) * levelScale));
+
+			levels[static_cast<size_t>(point)] = level;
+			upperLinkOffsets[static_cast<size_t>(point)] = numUpperLinks;
+			numUpperLinks += static_cast<size_t>(level) * static_cast<size_t>(maxDegree + 1);
+		}
+
+		bottomLinks.assign(static_cast<size_t>(numPoints) * static_cast<size_t>(getMaxLinks(0) + 1), 0);
+		upperLinks.assign(numUpperLinks, 0);
+		linkLocks.reset(new juce::SpinLock[static_cast<size_t>(juce::jmax(1, numPoints))]);
+
+		entryPoint = numPoints > 0 ? 0 : -1;
+		topLevel = numPoints > 0 ? levels[0] : -1;
+
+		// Every grain after the first is linked to the ones already in the graph.
+		std::atomic<int> nextPoint{ 1 };
+		const auto pointsPerChunk = 64;
+
+		auto insertPoints = [&]()
+		{
+			SearchScratch scratch;
+			scratch.prepare(numPoints, constructionBreadth);
+			std::vector<int> selected;
+
+			for (auto start = nextPoint.fetch_add(pointsPerChunk); start < numPoints; start = nextPoint.fetch_add(pointsPerChunk))
+				for (auto point = start; point < juce::jmin(numPoints, start + pointsPerChunk); point++)
+					insert(point, scratch, selected);
+		};
+
+		const auto numChunks = (numPoints + pointsPerChunk - 1) / pointsPerChunk;
+		runOnPool(pool, numChunks - 1, insertPoints);
+
+		setSearchBreadth(parameters.searchBreadth);
+	}
+
+	void HnswIndex::setSearchBreadth(const int breadth)
+	{
+		searchBreadth = juce::jmax(1, breadth);
+		queryScratch.prepare(numPoints, searchBreadth);
+	}
+
+	float HnswIndex::distanceSquared(const int point, const float* target, const float* weights) const noexcept
+	{
+		const auto* row = points.data() + static_cast<size_t>(point) * numDimensions;
+		auto distance = 0.0f;
+
+		if (weights == nullptr)
+		{
+			for (auto dimension = 0; dimension < numDimensions; dimension++)
+			{
+				const auto difference = row[dimension] - target[dimension];
+				distance += difference * difference;
+			}
+		}
+		else
+		{
+			for (auto dimension = 0; dimension < numDimensions; dimension++)
+			{
+				const auto difference = row[dimension] - target[dimension];
+				distance += weights[dimension] * difference * difference;
+			}
+		}
+
+		return distance;
+	}
+
+	int* HnswIndex::getLinks(const int point, const int level) noexcept
+	{
+		if (level == 0)
+			return bottomLinks.data() + static_cast<size_t>(point) * static_cast<size_t>(getMaxLinks(0) + 1);
+
+		return upperLinks.data() + upperLinkOffsets[static_cast<size_t>(point)] + static_cast<size_t>(level - 1) * static_cast<size_t>(maxDegree + 1);
+	}
+
+	const int* HnswIndex::getLinks(const int point, const int level) const noexcept
+	{
+		return const_cast<HnswIndex*>(this)->getLinks(point, level);
+	}
+
+	int HnswIndex::greedyClosest(const float* target, const float* weights, const int entry, const int level, const bool lockLinks) const noexcept
+	{
+		auto current = entry;
+		auto currentDistance = distanceSquared(current, target, weights);
+
+		for (auto moved = true; moved;)
+		{
+			moved = false;
+
+			if (lockLinks)
+				linkLocks[static_cast<size_t>(current)].enter();
+
+			const auto* links = getLinks(current, level);
+			auto next = current;
+
+			for (auto i = 1; i <= links[0]; i++)
+			{
+				const auto distance = distanceSquared(links[i], target, weights);
+
+				if (distance < currentDistance)
+				{
+					currentDistance = distance;
+					next = links[i];
+					moved = true;
+				}
+			}
+
+			if (lockLinks)
+				linkLocks[static_cast<size_t>(current)].exit();
+
+			current = next;
+		}
+
+		return current;
+	}
+
+	void HnswIndex::searchLayer(const float* target, const float* weights, const int entry, const int level, const int breadth, SearchScratch& scratch,
+		const bool lockLinks) const noexcept
+	{
+		using Candidate = SearchScratch::Candidate;
+
+		scratch.startSearch();
+		scratch.markVisited(entry);
+		scratch.beam[0] = { entry, distanceSquared(entry, target, weights), false };
+		scratch.beamSize = 1;
+
+		auto* beam = scratch.beam.data();
+
+		/*
+		 * Repeatedly expand the nearest candidate which hasn't been expanded yet, keeping the
+		 * best `breadth` grains seen. The search ends once every candidate kept has been expanded.
+		 */
+		for (auto cursor = 0; cursor < scratch.beamSize;)
+		{
+			if (beam[cursor].expanded)
+			{
+				cursor++;
+				continue;
+			}
+
+			beam[cursor].expanded = true;
+			const auto point = beam[cursor].point;
+			auto nextCursor = cursor + 1;
+
+			if (lockLinks)
+				linkLocks[static_cast<size_t>(point)].enter();
+
+			const auto* links = getLinks(point, level);
+
+			for (auto i = 1; i <= links[0]; i++)
+			{
+				const auto neighbour = links[i];
+
+				if (! scratch.markVisited(neighbour))
+					continue;
+
+				const auto distance = distanceSquared(neighbour, target, weights);
+
+				if (scratch.beamSize == breadth && distance >= beam[breadth - 1].distanceSquared)
+					continue;
+
+				auto position = scratch.beamSize < breadth ? scratch.beamSize++ : breadth - 1;
+				while (position > 0 && beam[position - 1].distanceSquared > distance)
+				{
+					beam[position] = beam[position - 1];
+					position--;
+				}
+
+				beam[position] = Candidate{ neighbour, distance, false };
+
+				// A closer candidate than the one just expanded has to be expanded next.
+				nextCursor = juce::jmin(nextCursor, position);
+			}
+
+			if (lockLinks)
+				linkLocks[static_cast<size_t>(point)].exit();
+
+			cursor = nextCursor;
+		}
+	}
+
+	void HnswIndex::selectNeighbours(const SearchScratch::Candidate* candidates, const int numCandidates, const int maxLinks, std::vector<int>& selected) const
+	{
+		/*
+		 * Candidates arrive nearest first. One is only kept if it's closer to the grain being
+		 * linked than to any neighbour kept already, which spreads links out in different
+		 * directions instead of spending them all on one tight cluster.
+		 */
+		selected.clear();
+
+		for (auto i = 0; i < numCandidates && static_cast<int>(selected.size()) < maxLinks; i++)
+		{
+			const auto& candidate = candidates[i];
+			const auto* candidateRow = points.data() + static_cast<size_t>(candidate.point) * numDimensions;
+
+			auto isDiverse = true;
+			for (const auto other : selected)
+				if (distanceSquared(other, candidateRow, getBuildWeights()) < candidate.distanceSquared)
+				{
+					isDiverse = false;
+					break;
+				}
+
+			if (isDiverse)
+				selected.push_back(candidate.point);
+		}
+	}
+
+	void HnswIndex::insert(const int point, SearchScratch& scratch, std::vector<int>& selected)
+	{
+		const auto* target = points.data() + static_cast<size_t>(point) * numDimensions;
+		const auto level = levels[static_cast<size_t>(point)];
+
+		/*
+		 * A grain which reaches higher than the current top layer becomes the new entry point,
+		 * so the entry point stays locked until it has been linked in.
+		 */
+		entryLock.enter();
+		auto current = entryPoint;
+		const auto currentTopLevel = topLevel;
+		const auto becomesEntryPoint = level > currentTopLevel;
+
+		if (! becomesEntryPoint)
+			entryLock.exit();
+
+		for (auto layer = currentTopLevel; layer > level; layer--)
+			current = greedyClosest(target, getBuildWeights(), current, layer, true);
+
+		for (auto layer = juce::jmin(level, currentTopLevel); layer >= 0; layer--)
+		{
+			searchLayer(target, getBuildWeights(), current, layer, constructionBreadth, scratch, true);
+			selectNeighbours(scratch.beam.data(), scratch.beamSize, maxDegree, selected);
+
+			{
+				const juce::SpinLock::ScopedLockType lock(linkLocks[static_cast<size_t>(point)]);
+
+				auto* links = getLinks(point, layer);
+				links[0] = static_cast<int>(selected.size());
+				std::copy(selected.begin(), selected.end(), links + 1);
+			}
+
+			for (const auto neighbour : selected)
+				addLink(neighbour, point, layer);
+
+			current = scratch.beam[0].point;
+		}
+
+		if (becomesEntryPoint)
+		{
+			entryPoint = point;
+			topLevel = level;
+			entryLock.exit();
+		}
+	}
+
+	void HnswIndex::addLink(const int from, const int to, const int level)
+	{
+		const juce::SpinLock::ScopedLockType lock(linkLocks[static_cast<size_t>(from)]);
+
+		auto* links = getLinks(from, level);
+		const auto maxLinks = getMaxLinks(level);
+
+		if (links[0] < maxLinks)
+		{
+			links[++links[0]] = to;
+			return;
+		}
+
+		// Full, so choose the best maxLinks out of the existing links and the new one.
+		const auto* fromRow = points.data() + static_cast<size_t>(from) * numDimensions;
+
+		std::vector<SearchScratch::Candidate> candidates;
+		candidates.reserve(static_cast<size_t>(maxLinks + 1));
+
+		for (auto i = 1; i <= links[0]; i++)
+			candidates.push_back({ links[i], distanceSquared(links[i], fromRow, getBuildWeights()), true });
+
+		candidates.push_back({ to, distanceSquared(to, fromRow, getBuildWeights()), true });
+
+		std::sort(candidates.begin(), candidates.end(),
+			[](const SearchScratch::Candidate& a, const SearchScratch::Candidate& b) { return a.distanceSquared < b.distanceSquared; });
+
+		std::vector<int> kept;
+		selectNeighbours(candidates.data(), static_cast<int>(candidates.size()), maxLinks, kept);
+
+		links[0] = static_cast<int>(kept.size());
+		std::copy(kept.begin(), kept.end(), links + 1);
+	}
+
+	int HnswIndex::findNearest(const float* target, const int k, Neighbour* results, const float* weights) const noexcept
+	{
+		if (numPoints == 0 || k <= 0)
+			return 0;
+
+		auto current = entryPoint;
+		for (auto layer = topLevel; layer > 0; layer--)
+			current = greedyClosest(target, weights, current, layer, false);
+
+		searchLayer(target, weights, current, 0, searchBreadth, queryScratch, false);
+
+		const auto numFound = juce::jmin(k, queryScratch.beamSize);
+		for (auto i = 0; i < numFound; i++)
+			results[i] = { queryScratch.beam[static_cast<size_t>(i)].point, queryScratch.beam[static_cast<size_t>(i)].distanceSquared };
+
+		return numFound;
+	}
+}
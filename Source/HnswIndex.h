@@ -0,0 +1,274 @@
+/*
+  ==============================================================================
+
+    HnswIndex.h
+    Created: 16 Oct 2026 6:20:16pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+#include "Descriptors.h"
+
+namespace Palette
+{
+	/*
+	 * HnswIndex is an approximate nearest neighbour index over the rows of a DescriptorTable,
+	 * built as a hierarchical navigable small world graph. Unlike KDTree its query cost stays
+	 * roughly logarithmic in the number of grains however many dimensions there are, at the
+	 * price of sometimes missing a true nearest neighbour.
+	 *
+	 * Recall is traded against latency with the search breadth: the number of candidates
+	 * a query keeps while walking the bottom layer of the graph.
+	 *
+	 * Queries use scratch space owned by the index, so they never allocate but only one
+	 * thread may query at a time, and never while the index is being built.
+	 *
+	 * The graph is linked under the weights given to build(), but queries may weight the
+	 * dimensions differently. The links still lead towards the neighbours of the new metric
+	 * as long as the weights don't stray too far from the build weights, so moving them
+	 * costs some recall rather than a rebuild.
+	 */
+	class HnswIndex
+	{
+	public:
+		struct Parameters
+		{
+			// Links per grain in the upper layers. The bottom layer has twice as many.
+			int maxDegree = 16;
+			// Candidates considered when linking each grain during the build.
+			int constructionBreadth = 100;
+			// Candidates kept by queries. Higher finds true neighbours more often but takes longer.
+			int searchBreadth = 64;
+			// Seeds the random layer assignment so builds are repeatable.
+			juce::int64 seed = 1;
+		};
+
+		HnswIndex() = default;
+
+		/*
+		 * Rebuilds the index over every row of descriptors, measuring distances with weights,
+		 * one per dimension, unless it's nullptr. If pool is given the grains are linked into
+		 * the graph by its threads and the calling thread together. Not real-time safe.
+		 */
+		void build(const DescriptorTable& descriptors, const Parameters& parameters, juce::ThreadPool* pool = nullptr,
+			const float* weights = nullptr);
+
+		/*
+		 * Changes how many candidates queries keep. Reallocates the query scratch space,
+		 * so it must not be called while a query might be running.
+		 */
+		void setSearchBreadth(int breadth);
+		int getSearchBreadth() const noexcept { return searchBreadth; }
+
+		int getNumDimensions() const noexcept { return numDimensions; }
+		int getNumPoints() const noexcept { return numPoints; }
+
+		/*
+		 * Finds (approximately) the k grains nearest to target, which must hold getNumDimensions()
+		 * values. results must have room for k neighbours and is filled nearest first.
+		 * k larger than the search breadth is limited to the search breadth. Distances are
+		 * weighted by weights, one per dimension, unless it's nullptr.
+		 * Returns how many neighbours were written.
+		 */
+		int findNearest(const float* target, int k, Neighbour* results, const float* weights = nullptr) const noexcept;
+
+	private:
+		/*
+		 * Everything one thread needs to search the graph: marks for visited grains,
+		 * and the beam of best candidates found so far, sorted nearest first.
+		 */
+		struct SearchScratch
+		{
+			void prepare(int numPointsToVisit, int breadth);
+			bool markVisited(int point) noexcept;
+			void startSearch() noexcept;
+
+			std::vector<juce::uint32> visitedTags;
+			juce::uint32 currentTag = 0;
+
+			struct Candidate
+			{
+				int point;
+				float distanceSquared;
+				bool expanded;
+			};
+
+			std::vector<Candidate> beam;
+			int beamSize = 0;
+		};
+
+		float distanceSquared(int point, const float* target, const float* weights) const noexcept;
+		const float* getBuildWeights() const noexcept { return buildWeights.empty() ? nullptr : buildWeights.data(); }
+
+		int* getLinks(int point, int level) noexcept;
+		const int* getLinks(int point, int level) const noexcept;
+		int getMaxLinks(int level) const noexcept { return level == 0 ? maxDegree * 2 : maxDegree; }
+
+		int greedyClosest(const float* target, const float* weights, int entry, int level, bool lockLinks) const noexcept;
+		void searchLayer(const float* target, const float* weights, int entry, int level, int breadth, SearchScratch& scratch,
+			bool lockLinks) const noexcept;
+
+		void insert(int point, SearchScratch& scratch, std::vector<int>& selected);
+		void selectNeighbours(const SearchScratch::Candidate* candidates, int numCandidates, int maxLinks, std::vector<int>& selected) const;
+		void addLink(int from, int to, int level);
+
+		int numDimensions = 0;
+		int numPoints = 0;
+		int maxDegree = 16;
+		int constructionBreadth = 100;
+		int searchBreadth = 64;
+
+		// Descriptor rows, numDimensions floats each.
+		std::vector<float> points;
+		std::vector<int> levels;
+		// The weights the graph was linked under, or empty if it wasn't weighted.
+		std::vector<float> buildWeights;
+
+		/*
+		 * Links are stored as a count followed by room for getMaxLinks(level) grain indices.
+		 * Bottom layer links for every grain are in one array; a grain's upper layer links
+		 * are consecutive blocks in another, starting at upperLinkOffsets[point].
+		 */
+		std::vector<int> bottomLinks;
+		std::vector<int> upperLinks;
+		std::vector<size_t> upperLinkOffsets;
+
+		int entryPoint = -1;
+		int topLevel = -1;
+
+		// Guards each grain's links and the entry point while the graph is built in parallel.
+		std::unique_ptr<juce::SpinLock[]> linkLocks;
+		juce::SpinLock entryLock;
+
+		mutable SearchScratch queryScratch;
+	};
+}
+
+TEST_CASE("HnswIndex")
+{
+	const auto dimensions = 12;
+	const auto numGrains = 2000;
+
+	Palette::DescriptorTable table(dimensions, numGrains);
+	juce::Random random(11);
+
+	for (size_t grain = 0; grain < numGrains; grain++)
+		for (auto dimension = 0; dimension < dimensions; dimension++)
+			table.setValue(grain, dimension, random.nextFloat());
+
+	const auto exactNearest = [&table](const float* target, size_t k, const float* weights) {
+		std::vector<std::pair<float, int>> distances;
+		for (size_t grain = 0; grain < table.getNumGrains(); grain++)
+		{
+			auto distance = 0.0f;
+			for (auto dimension = 0; dimension < table.getNumDimensions(); dimension++)
+				distance += (weights != nullptr ? weights[dimension] : 1.0f)
+					* (table.getValue(grain, dimension) - target[dimension]) * (table.getValue(grain, dimension) - target[dimension]);
+			distances.emplace_back(distance, (int)grain);
+		}
+
+		std::partial_sort(distances.begin(), distances.begin() + (long)k, distances.end());
+
+		std::vector<int> grains;
+		for (size_t i = 0; i < k; i++)
+			grains.push_back(distances[i].second);
+		return grains;
+	};
+
+	// The fraction of the true 10 nearest grains the index finds over some random queries.
+	const auto measureRecall = [&](const Palette::HnswIndex& index, const float* weights = nullptr) {
+		const auto k = 10;
+		auto found = 0;
+		auto total = 0;
+
+		for (auto query = 0; query < 50; query++)
+		{
+			float target[dimensions];
+			for (auto& value : target)
+				value = random.nextFloat();
+
+			Palette::Neighbour results[k];
+			const auto numFound = index.findNearest(target, k, results, weights);
+			const auto expected = exactNearest(target, k, weights);
+
+			for (auto i = 0; i < numFound; i++)
+				if (std::find(expected.begin(), expected.end(), results[i].grain) != expected.end())
+					found++;
+
+			total += k;
+		}
+
+		return found / (double)total;
+	};
+
+	Palette::HnswIndex::Parameters parameters;
+
+	SUBCASE("Most true neighbours are found")
+	{
+		Palette::HnswIndex index;
+		index.build(table, parameters);
+
+		CHECK(index.getNumPoints() == numGrains);
+		CHECK(measureRecall(index) > 0.9);
+	}
+
+	SUBCASE("A parallel build is as good as a serial one")
+	{
+		juce::ThreadPool pool(4);
+		Palette::HnswIndex index;
+		index.build(table, parameters, &pool);
+
+		CHECK(measureRecall(index) > 0.9);
+	}
+
+	SUBCASE("Queries can be weighted differently from the build")
+	{
+		Palette::HnswIndex index;
+		index.build(table, parameters);
+
+		float weights[dimensions];
+		for (auto dimension = 0; dimension < dimensions; dimension++)
+			weights[dimension] = dimension < dimensions / 2 ? 2.0f : 0.5f;
+
+		CHECK(measureRecall(index, weights) > 0.9);
+
+		Palette::HnswIndex weighted;
+		weighted.build(table, parameters, nullptr, weights);
+
+		CHECK(measureRecall(weighted, weights) > 0.9);
+	}
+
+	SUBCASE("Results are sorted nearest first")
+	{
+		Palette::HnswIndex index;
+		index.build(table, parameters);
+
+		const float target[dimensions] = {};
+		Palette::Neighbour results[20];
+		const auto numFound = index.findNearest(target, 20, results);
+
+		REQUIRE(numFound == 20);
+		for (auto i = 1; i < numFound; i++)
+			CHECK(results[i - 1].distanceSquared <= results[i].distanceSquared);
+	}
+
+	SUBCASE("Small and empty indexes")
+	{
+		Palette::DescriptorTable small(dimensions, 3);
+		Palette::HnswIndex index;
+		index.build(small, parameters);
+
+		const float target[dimensions] = {};
+		Palette::Neighbour results[10];
+		CHECK(index.findNearest(target, 10, results) == 3);
+
+		Palette::HnswIndex empty;
+		CHECK(empty.findNearest(target, 10, results) == 0);
+	}
+}
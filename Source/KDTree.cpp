@@ -0,0 +1,223 @@
+/*
+  ==============================================================================
+
+    KDTree.cpp
+    Created: 16 Oct 2026 6:15:52pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#include "KDTree.h"
+
+namespace Palette
+{
+	void KDTree::build(const DescriptorTable& descriptors, const float* weights)
+	{
+		numDimensions = descriptors.getNumDimensions();
+
+		const auto numPoints = static_cast<int>(descriptors.getNumGrains());
+
+		nodes.clear();
+		indices.resize(static_cast<size_t>(numPoints));
+		points.resize(static_cast<size_t>(numPoints) * static_cast<size_t>(numDimensions));
+
+		if (numPoints == 0)
+			return;
+
+		// Gather the columns into rows, which is the order distances are computed in.
+		std::vector<float> rows(points.size());
+		for (auto point = 0; point < numPoints; point++)
+		{
+			indices[static_cast<size_t>(point)] = point;
+			descriptors.getRow(static_cast<size_t>(point), rows.data() + static_cast<size_t>(point) * numDimensions);
+		}
+
+		// A balanced tree has about 2n / maxLeafSize nodes.
+		nodes.reserve(static_cast<size_t>(2 * numPoints / maxLeafSize + 1));
+		buildNode(rows, weights, 0, numPoints);
+
+		// Pack the rows in leaf order so each leaf's points are contiguous.
+		for (auto point = 0; point < numPoints; point++)
+			std::copy_n(rows.data() + static_cast<size_t>(indices[static_cast<size_t>(point)]) * numDimensions,
+				numDimensions,
+				points.data() + static_cast<size_t>(point) * numDimensions);
+	}
+
+	int KDTree::buildNode(std::vector<float>& rows, const float* weights, const int begin, const int end)
+	{
+		const auto nodeIndex = static_cast<int>(nodes.size());
+		nodes.emplace_back();
+
+		if (end - begin <= maxLeafSize)
+		{
+			nodes[static_cast<size_t>(nodeIndex)].begin = begin;
+			nodes[static_cast<size_t>(nodeIndex)].end = end;
+			return nodeIndex;
+		}
+
+		const auto valueOf = [&rows, this](const int point, const int dimension) {
+			return rows[static_cast<size_t>(point) * numDimensions + dimension];
+		};
+
+		// Split along the dimension the points are most spread out in, compared as weighted squares.
+		auto splitDimension = 0;
+		auto widestSpread = -1.0f;
+
+		for (auto dimension = 0; dimension < numDimensions; dimension++)
+		{
+			auto minimum = valueOf(indices[static_cast<size_t>(begin)], dimension);
+			auto maximum = minimum;
+
+			for (auto i = begin + 1; i < end; i++)
+			{
+				const auto value = valueOf(indices[static_cast<size_t>(i)], dimension);
+				minimum = juce::jmin(minimum, value);
+				maximum = juce::jmax(maximum, value);
+			}
+
+			const auto spread = (weights != nullptr ? weights[dimension] : 1.0f) * (maximum - minimum) * (maximum - minimum);
+
+			if (spread > widestSpread)
+			{
+				widestSpread = spread;
+				splitDimension = dimension;
+			}
+		}
+
+		const auto middle = begin + (end - begin) / 2;
+		std::nth_element(indices.begin() + begin, indices.begin() + middle, indices.begin() + end,
+			[&valueOf, splitDimension](const int a, const int b) { return valueOf(a, splitDimension) < valueOf(b, splitDimension); });
+
+		const auto split = valueOf(indices[static_cast<size_t>(middle)], splitDimension);
+
+		// nodes may reallocate while the children are built, so don't hold a reference across these.
+		const auto left = buildNode(rows, weights, begin, middle);
+		const auto right = buildNode(rows, weights, middle, end);
+
+		auto& node = nodes[static_cast<size_t>(nodeIndex)];
+		node.dimension = splitDimension;
+		node.split = split;
+		node.left = left;
+		node.right = right;
+
+		return nodeIndex;
+	}
+
+	float KDTree::distanceSquaredTo(const int point, const float* target, const float* weights) const noexcept
+	{
+		const auto* row = points.data() + static_cast<size_t>(point) * numDimensions;
+		auto distance = 0.0f;
+
+		if (weights == nullptr)
+		{
+			for (auto dimension = 0; dimension < numDimensions; dimension++)
+			{
+				const auto difference = row[dimension] - target[dimension];
+				distance += difference * difference;
+			}
+		}
+		else
+		{
+			for (auto dimension = 0; dimension < numDimensions; dimension++)
+			{
+				const auto difference = row[dimension] - target[dimension];
+				distance += weights[dimension] * difference * difference;
+			}
+		}
+
+		return distance;
+	}
+
+	int KDTree::findNearest(const float* target, const int k, Neighbour* results, const float* weights) const noexcept
+	{
+		if (nodes.empty() || k <= 0)
+			return 0;
+
+		auto numFound = 0;
+		searchNearest(0, target, weights, k, results, numFound);
+		return numFound;
+	}
+
+	void KDTree::searchNearest(const int nodeIndex, const float* target, const float* weights, const int k, Neighbour* results,
+		int& numFound) const noexcept
+	{
+		const auto& node = nodes[static_cast<size_t>(nodeIndex)];
+
+		if (node.dimension < 0)
+		{
+			for (auto point = node.begin; point < node.end; point++)
+			{
+				const auto distance = distanceSquaredTo(point, target, weights);
+
+				if (numFound == k && distance >= results[k - 1].distanceSquared)
+					continue;
+
+				// Insertion into the sorted results, dropping the furthest if they're full.
+				auto position = numFound < k ? numFound++ : k - 1;
+				while (position > 0 && results[position - 1].distanceSquared > distance)
+				{
+					results[position] = results[position - 1];
+					position--;
+				}
+
+				results[position] = { indices[static_cast<size_t>(point)], distance };
+			}
+
+			return;
+		}
+
+		const auto difference = target[node.dimension] - node.split;
+		const auto nearChild = difference < 0.0f ? node.left : node.right;
+		const auto farChild = difference < 0.0f ? node.right : node.left;
+
+		searchNearest(nearChild, target, weights, k, results, numFound);
+
+		// The far side can only hold something closer if the splitting plane is closer than our worst result.
+		const auto planeDistance = (weights != nullptr ? weights[node.dimension] : 1.0f) * difference * difference;
+
+		if (numFound < k || planeDistance < results[k - 1].distanceSquared)
+			searchNearest(farChild, target, weights, k, results, numFound);
+	}
+
+	int KDTree::findWithinRadius(const float* target, const float radius, Neighbour* results, const int maxResults, const float* weights) const noexcept
+	{
+		if (nodes.empty() || maxResults <= 0 || radius < 0.0f)
+			return 0;
+
+		auto numFound = 0;
+		searchRadius(0, target, weights, radius * radius, results, maxResults, numFound);
+		return numFound;
+	}
+
+	void KDTree::searchRadius(const int nodeIndex, const float* target, const float* weights, const float radiusSquared, Neighbour* results,
+		const int maxResults, int& numFound) const noexcept
+	{
+		if (numFound == maxResults)
+			return;
+
+		const auto& node = nodes[static_cast<size_t>(nodeIndex)];
+
+		if (node.dimension < 0)
+		{
+			for (auto point = node.begin; point < node.end && numFound < maxResults; point++)
+			{
+				const auto distance = distanceSquaredTo(point, target, weights);
+
+				if (distance <= radiusSquared)
+					results[numFound++] = { indices[static_cast<size_t>(point)], distance };
+			}
+
+			return;
+		}
+
+		const auto difference = target[node.dimension] - node.split;
+		const auto planeDistance = (weights != nullptr ? weights[node.dimension] : 1.0f) * difference * difference;
+
+		if (difference < 0.0f || planeDistance <= radiusSquared)
+			searchRadius(node.left, target, weights, radiusSquared, results, maxResults, numFound);
+
+		if (difference >= 0.0f || planeDistance <= radiusSquared)
+			searchRadius(node.right, target, weights, radiusSquared, results, maxResults, numFound);
+	}
+}
@@ -0,0 +1,205 @@
+/*
+  ==============================================================================
+
+    KDTree.h
+    Created: 16 Oct 2026 6:15:52pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+#include "Descriptors.h"
+
+namespace Palette
+{
+	/*
+	 * KDTree is an exact nearest neighbour index over the rows of a DescriptorTable.
+	 *
+	 * Building copies the descriptors into leaf order, so grains which are close in descriptor
+	 * space are close in memory, and splits each node at the median of its widest dimension.
+	 * Queries only touch memory owned by the tree and the caller, so they never allocate
+	 * and are safe to call from the audio thread as long as nothing rebuilds the tree meanwhile.
+	 *
+	 * Distances can be weighted per dimension at query time. A weight scales the bound on the
+	 * far side of each splitting plane just as it scales the distances to points, so searches
+	 * stay exact under any weights without the tree being rebuilt.
+	 */
+	class KDTree
+	{
+	public:
+		KDTree() = default;
+
+		/*
+		 * Rebuilds the tree over every row of descriptors. If weights are given, nodes are split
+		 * along the dimension which is widest once weighted, which suits queries using about
+		 * those weights best. Not real-time safe.
+		 */
+		void build(const DescriptorTable& descriptors, const float* weights = nullptr);
+
+		int getNumDimensions() const noexcept { return numDimensions; }
+		int getNumPoints() const noexcept { return static_cast<int>(indices.size()); }
+
+		/*
+		 * Finds the k grains nearest to target, which must hold getNumDimensions() values.
+		 * results must have room for k neighbours and is filled nearest first.
+		 * Returns how many neighbours were found, which is less than k only if the tree
+		 * holds fewer than k grains. Distances are weighted by weights, one per dimension,
+		 * unless it's nullptr.
+		 */
+		int findNearest(const float* target, int k, Neighbour* results, const float* weights = nullptr) const noexcept;
+
+		/*
+		 * Finds up to maxResults grains no further than radius from target, in no particular order.
+		 * Returns how many were written to results.
+		 */
+		int findWithinRadius(const float* target, float radius, Neighbour* results, int maxResults, const float* weights = nullptr) const noexcept;
+
+		// The most points a leaf holds before it's split.
+		static constexpr int maxLeafSize = 8;
+
+	private:
+		struct Node
+		{
+			// The dimension this node splits on, or -1 for a leaf.
+			int dimension = -1;
+			float split = 0.0f;
+			// Children, for inner nodes.
+			int left = -1;
+			int right = -1;
+			// The points held, for leaves, as a range of indices.
+			int begin = 0;
+			int end = 0;
+		};
+
+		int buildNode(std::vector<float>& rows, const float* weights, int begin, int end);
+
+		void searchNearest(int nodeIndex, const float* target, const float* weights, int k, Neighbour* results, int& numFound) const noexcept;
+		void searchRadius(int nodeIndex, const float* target, const float* weights, float radiusSquared, Neighbour* results, int maxResults,
+			int& numFound) const noexcept;
+
+		float distanceSquaredTo(int point, const float* target, const float* weights) const noexcept;
+
+		int numDimensions = 0;
+		std::vector<Node> nodes;
+		// Descriptor rows packed in leaf order, numDimensions floats each.
+		std::vector<float> points;
+		// The grain each packed point came from.
+		std::vector<int> indices;
+	};
+}
+
+TEST_CASE("KDTree")
+{
+	const auto dimensions = 3;
+	const auto numGrains = 1000;
+
+	Palette::DescriptorTable table(dimensions, numGrains);
+	juce::Random random(7);
+
+	for (size_t grain = 0; grain < numGrains; grain++)
+		for (auto dimension = 0; dimension < dimensions; dimension++)
+			table.setValue(grain, dimension, random.nextFloat() * (dimension + 1));
+
+	Palette::KDTree tree;
+	tree.build(table);
+
+	const auto bruteForceDistance = [&table](size_t grain, const float* target) {
+		auto distance = 0.0f;
+		for (auto dimension = 0; dimension < table.getNumDimensions(); dimension++)
+			distance += (table.getValue(grain, dimension) - target[dimension]) * (table.getValue(grain, dimension) - target[dimension]);
+		return distance;
+	};
+
+	SUBCASE("k nearest matches a brute force search")
+	{
+		for (auto query = 0; query < 50; query++)
+		{
+			const float target[dimensions] = { random.nextFloat(), random.nextFloat() * 2, random.nextFloat() * 3 };
+
+			std::vector<float> distances;
+			for (size_t grain = 0; grain < numGrains; grain++)
+				distances.push_back(bruteForceDistance(grain, target));
+			std::sort(distances.begin(), distances.end());
+
+			Palette::Neighbour results[5];
+			REQUIRE(tree.findNearest(target, 5, results) == 5);
+
+			for (auto i = 0; i < 5; i++)
+			{
+				CHECK(results[i].distanceSquared == doctest::Approx(distances[(size_t)i]));
+				CHECK(bruteForceDistance((size_t)results[i].grain, target) == doctest::Approx(results[i].distanceSquared));
+			}
+		}
+	}
+
+	SUBCASE("Radius queries find exactly the grains inside the radius")
+	{
+		const float target[dimensions] = { 0.5f, 1.0f, 1.5f };
+		const auto radius = 0.4f;
+
+		Palette::Neighbour results[numGrains];
+		const auto numFound = tree.findWithinRadius(target, radius, results, numGrains);
+
+		auto expected = 0;
+		for (size_t grain = 0; grain < numGrains; grain++)
+			if (bruteForceDistance(grain, target) <= radius * radius)
+				expected++;
+
+		CHECK(numFound == expected);
+
+		for (auto i = 0; i < numFound; i++)
+			CHECK(results[i].distanceSquared <= radius * radius);
+	}
+
+	SUBCASE("Weighted queries match a weighted brute force search without rebuilding")
+	{
+		const float weights[dimensions] = { 4.0f, 0.25f, 0.0f };
+
+		for (auto query = 0; query < 50; query++)
+		{
+			const float target[dimensions] = { random.nextFloat(), random.nextFloat() * 2, random.nextFloat() * 3 };
+
+			std::vector<float> distances;
+			for (size_t grain = 0; grain < numGrains; grain++)
+			{
+				auto distance = 0.0f;
+				for (auto dimension = 0; dimension < dimensions; dimension++)
+					distance += weights[dimension] * (table.getValue(grain, dimension) - target[dimension]) * (table.getValue(grain, dimension) - target[dimension]);
+				distances.push_back(distance);
+			}
+			std::sort(distances.begin(), distances.end());
+
+			Palette::Neighbour results[5];
+			REQUIRE(tree.findNearest(target, 5, results, weights) == 5);
+
+			for (auto i = 0; i < 5; i++)
+				CHECK(results[i].distanceSquared == doctest::Approx(distances[(size_t)i]));
+		}
+	}
+
+	SUBCASE("Asking for more neighbours than grains returns them all")
+	{
+		Palette::DescriptorTable small(dimensions, 3);
+		Palette::KDTree smallTree;
+		smallTree.build(small);
+
+		const float target[dimensions] = { 0.0f, 0.0f, 0.0f };
+		Palette::Neighbour results[10];
+
+		CHECK(smallTree.findNearest(target, 10, results) == 3);
+	}
+
+	SUBCASE("An empty tree finds nothing")
+	{
+		Palette::KDTree empty;
+		const float target[dimensions] = { 0.0f, 0.0f, 0.0f };
+		Palette::Neighbour results[1];
+
+		CHECK(empty.findNearest(target, 1, results) == 0);
+	}
+}
@@ -0,0 +1,49 @@
+/*
+  ==============================================================================
+
+    LiveAnalyser.cpp
+    Created: 16 Oct 2026 7:06:20pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#include "LiveAnalyser.h"
+
+namespace Palette
+{
+	void LiveAnalyser::prepare(const double sampleRate, const int numChannels, const int frameLength, const int hopLength)
+	{
+		jassert(frameLength > 0 && hopLength > 0 && hopLength <= frameLength);
+
+		hop = hopLength;
+		ring.setSize(numChannels, frameLength);
+		frame.setSize(numChannels, frameLength);
+		analyser = numChannels > 0 ? std::make_unique<GrainAnalyser>(sampleRate) : nullptr;
+
+		reset();
+	}
+
+	void LiveAnalyser::reset() noexcept
+	{
+		ring.clear();
+		writePosition = 0;
+		samplesUntilHop = hop;
+		descriptors = {};
+	}
+
+	const GrainAnalyser::DescriptorVector& LiveAnalyser::analyseFrame() noexcept
+	{
+		// The oldest sample is the next to be overwritten, so the frame is the ring from writePosition on, then from its start.
+		const auto numOldest = ring.getNumSamples() - writePosition;
+
+		for (auto channel = 0; channel < ring.getNumChannels(); channel++)
+		{
+			juce::FloatVectorOperations::copy(frame.getWritePointer(channel), ring.getReadPointer(channel, writePosition), numOldest);
+			juce::FloatVectorOperations::copy(frame.getWritePointer(channel, numOldest), ring.getReadPointer(channel), writePosition);
+		}
+
+		descriptors = analyser->analyse(Grain<float>(frame, 0, frame.getNumSamples(), 0, frame.getNumChannels()));
+		return descriptors;
+	}
+}
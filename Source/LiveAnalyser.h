@@ -0,0 +1,202 @@
+/*
+  ==============================================================================
+
+    LiveAnalyser.h
+    Created: 16 Oct 2026 7:06:20pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+#include "Descriptors.h"
+
+namespace Palette
+{
+	/*
+	 * LiveAnalyser computes descriptors of incoming audio as it arrives, for choosing grains
+	 * which match a live input.
+	 *
+	 * Input is written into a ring buffer holding the last frameLength samples. Every hopLength
+	 * samples the ring is unrolled into one frame and analysed by a GrainAnalyser, exactly as a
+	 * corpus grain of the same length would be. A frame is analysed on the sample which completes
+	 * it, so whatever answers it trails the input by at most one hop.
+	 *
+	 * Every frame costs the same to analyse, pitch included, and a block completes at most
+	 * numSamples / hopLength + 1 of them, so the work per block is bounded by the block size.
+	 *
+	 * Everything is allocated in prepare(), so process() is safe to call from processBlock.
+	 */
+	class LiveAnalyser
+	{
+	public:
+		LiveAnalyser() = default;
+
+		/*
+		 * Allocates for analysing numChannels channels in frames of frameLength samples, one
+		 * every hopLength samples. hopLength must be no longer than frameLength.
+		 */
+		void prepare(double sampleRate, int numChannels, int frameLength, int hopLength);
+
+		// Forgets all input so far, as if the last frame was silent.
+		void reset() noexcept;
+
+		/*
+		 * Adds the first numSamples samples of input's channels to the ring and analyses every
+		 * frame completed along the way. onFrame is called with the offset into input of the sample
+		 * after each frame's last, and the frame's descriptors.
+		 */
+		template <typename Callback>
+		void process(const juce::AudioBuffer<float>& input, const int numSamples, Callback&& onFrame) noexcept
+		{
+			if (analyser == nullptr)
+				return;
+
+			const auto numInputChannels = juce::jmin(input.getNumChannels(), ring.getNumChannels());
+
+			for (auto position = 0; position < numSamples;)
+			{
+				const auto numToCopy = juce::jmin(numSamples - position, samplesUntilHop, ring.getNumSamples() - writePosition);
+
+				for (auto channel = 0; channel < ring.getNumChannels(); channel++)
+				{
+					// Channels the input doesn't have are silent.
+					if (channel < numInputChannels)
+						juce::FloatVectorOperations::copy(ring.getWritePointer(channel, writePosition), input.getReadPointer(channel, position), numToCopy);
+					else
+						juce::FloatVectorOperations::clear(ring.getWritePointer(channel, writePosition), numToCopy);
+				}
+
+				writePosition = (writePosition + numToCopy) % ring.getNumSamples();
+				samplesUntilHop -= numToCopy;
+				position += numToCopy;
+
+				if (samplesUntilHop == 0)
+				{
+					samplesUntilHop = hop;
+					onFrame(position, analyseFrame());
+				}
+			}
+		}
+
+		// How far behind the input analysis runs: one hop, or nothing if there's no input to analyse.
+		int getLatencySamples() const noexcept { return analyser != nullptr ? hop : 0; }
+
+		int getFrameLength() const noexcept { return frame.getNumSamples(); }
+		int getHopLength() const noexcept { return hop; }
+
+	private:
+		const GrainAnalyser::DescriptorVector& analyseFrame() noexcept;
+
+		std::unique_ptr<GrainAnalyser> analyser;
+
+		// The last frameLength samples of input, oldest first from writePosition.
+		juce::AudioBuffer<float> ring;
+		int writePosition = 0;
+
+		// The ring unrolled, oldest sample first, for analysing.
+		juce::AudioBuffer<float> frame;
+
+		int hop = 0;
+		int samplesUntilHop = 0;
+
+		GrainAnalyser::DescriptorVector descriptors{};
+
+		JUCE_DECLARE_NON_COPYABLE(LiveAnalyser)
+	};
+}
+
+TEST_CASE("LiveAnalyser")
+{
+	const auto sampleRate = 44100.0;
+	const auto frameLength = 4410;
+	const auto hopLength = 1000;
+
+	// A rising chirp, so every frame sounds different.
+	juce::AudioBuffer<float> input(2, 20000);
+	for (auto i = 0; i < input.getNumSamples(); i++)
+	{
+		const auto sample = static_cast<float>(std::sin(juce::MathConstants<double>::twoPi * (200.0 + i * 0.05) * i / sampleRate));
+		input.setSample(0, i, sample);
+		input.setSample(1, i, sample * 0.5f);
+	}
+
+	Palette::LiveAnalyser live;
+	live.prepare(sampleRate, 2, frameLength, hopLength);
+	CHECK(live.getLatencySamples() == hopLength);
+
+	Palette::GrainAnalyser reference(sampleRate);
+
+	SUBCASE("Frames arrive every hop, and match analysing the same samples directly")
+	{
+		// Blocks of awkward sizes, so hops and the ring's wrap land all over them.
+		const int blockSizes[] = { 512, 37, 1500, 999, 4096, 1 };
+		auto numFrames = 0;
+		auto blockStart = 0;
+
+		for (auto block = 0; blockStart < input.getNumSamples(); block++)
+		{
+			const auto numSamples = juce::jmin(blockSizes[block % 6], input.getNumSamples() - blockStart);
+
+			juce::AudioBuffer<float> blockBuffer(2, numSamples);
+			for (auto channel = 0; channel < 2; channel++)
+				blockBuffer.copyFrom(channel, 0, input, channel, blockStart, numSamples);
+
+			live.process(blockBuffer, numSamples, [&](const int offset, const Palette::GrainAnalyser::DescriptorVector& descriptors) {
+				const auto frameEnd = blockStart + offset;
+				numFrames++;
+
+				CHECK(frameEnd == numFrames * hopLength);
+
+				// Before the ring has filled, the missing samples are silence.
+				if (frameEnd < frameLength)
+					return;
+
+				const auto expected = reference.analyse(Palette::Grain<float>(input, frameEnd - frameLength, frameLength, 0, 2));
+				for (size_t d = 0; d < expected.size(); d++)
+					CHECK(descriptors[d] == doctest::Approx(expected[d]));
+			});
+
+			blockStart += numSamples;
+		}
+
+		CHECK(numFrames == input.getNumSamples() / hopLength);
+	}
+
+	SUBCASE("Missing input channels are silent")
+	{
+		juce::AudioBuffer<float> mono(1, 2 * frameLength);
+		mono.copyFrom(0, 0, input, 0, 0, mono.getNumSamples());
+
+		juce::AudioBuffer<float> padded(2, mono.getNumSamples());
+		padded.clear();
+		padded.copyFrom(0, 0, mono, 0, 0, mono.getNumSamples());
+
+		auto lastFrameEnd = 0;
+		Palette::GrainAnalyser::DescriptorVector last{};
+		live.process(mono, mono.getNumSamples(), [&](const int offset, const Palette::GrainAnalyser::DescriptorVector& descriptors) {
+			lastFrameEnd = offset;
+			last = descriptors;
+		});
+
+		const auto expected = reference.analyse(Palette::Grain<float>(padded, lastFrameEnd - frameLength, frameLength, 0, 2));
+		for (size_t d = 0; d < expected.size(); d++)
+			CHECK(last[d] == doctest::Approx(expected[d]));
+	}
+
+	SUBCASE("Nothing is analysed without input channels")
+	{
+		Palette::LiveAnalyser none;
+		none.prepare(sampleRate, 0, frameLength, hopLength);
+
+		auto numFrames = 0;
+		none.process(input, input.getNumSamples(), [&](int, const Palette::GrainAnalyser::DescriptorVector&) { numFrames++; });
+
+		CHECK(numFrames == 0);
+		CHECK(none.getLatencySamples() == 0);
+	}
+}
@@ -0,0 +1,77 @@
+/*
+  ==============================================================================
+
+    MappedAudioFile.cpp
+    Created: 16 Oct 2026 6:34:30pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#include "MappedAudioFile.h"
+
+namespace Palette
+{
+	namespace
+	{
+		std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapWav(const juce::File& file)
+		{
+			juce::WavAudioFormat wav;
+			std::unique_ptr<juce::MemoryMappedAudioFormatReader> reader(wav.createMemoryMappedReader(file));
+
+			if (reader == nullptr || ! reader->mapEntireFile())
+				return nullptr;
+
+			return reader;
+		}
+
+		// Keeps the mapping alive alongside the buffer which refers to it.
+		struct MappedAudio
+		{
+			MappedAudio(std::unique_ptr<juce::MemoryMappedAudioFormatReader> mappedReader, float* samples, const int numSamples)
+				: reader(std::move(mappedReader)), audio(&samples, 1, numSamples) { }
+
+			const std::unique_ptr<juce::MemoryMappedAudioFormatReader> reader;
+			const juce::AudioBuffer<float> audio;
+		};
+	}
+
+	std::shared_ptr<const juce::AudioBuffer<float>> mapAudioFile(const juce::File& file, double& sampleRate)
+	{
+		auto reader = mapWav(file);
+
+		// WAV samples are little endian, so only a little endian machine can use them as they are.
+	   #if JUCE_BIG_ENDIAN
+		reader.reset();
+	   #endif
+
+		if (reader == nullptr
+			|| reader->numChannels != 1
+			|| reader->bitsPerSample != 32
+			|| ! reader->usesFloatingPointData
+			|| reader->lengthInSamples <= 0
+			|| reader->lengthInSamples > std::numeric_limits<int>::max())
+			return nullptr;
+
+		// The data chunk can start anywhere in the file, so the samples might not be aligned.
+		auto* samples = static_cast<float*>(const_cast<void*>(reader->getSampleData(0)));
+		if (reinterpret_cast<std::uintptr_t>(samples) % alignof(float) != 0)
+			return nullptr;
+
+		const auto numSamples = static_cast<int>(reader->lengthInSamples);
+
+		// Fault every page in now, so the audio thread never has to. 1024 floats is the smallest page size.
+		for (juce::int64 sample = 0; sample < numSamples; sample += 1024)
+			reader->touchSample(sample);
+
+		sampleRate = reader->sampleRate;
+
+		auto mapped = std::make_shared<MappedAudio>(std::move(reader), samples, numSamples);
+		return std::shared_ptr<const juce::AudioBuffer<float>>(mapped, &mapped->audio);
+	}
+
+	std::unique_ptr<juce::AudioFormatReader> createMappedReader(const juce::File& file)
+	{
+		return mapWav(file);
+	}
+}
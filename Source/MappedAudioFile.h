@@ -0,0 +1,112 @@
+/*
+  ==============================================================================
+
+    MappedAudioFile.h
+    Created: 16 Oct 2026 6:34:30pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+namespace Palette
+{
+	/*
+	 * Memory maps a WAV file and returns a buffer whose samples are the mapped file itself,
+	 * so nothing is decoded or copied and every instance of the plugin reading the same file
+	 * shares the operating system's cached pages. The buffer keeps the mapping alive for as
+	 * long as anything holds it.
+	 *
+	 * Grains need each channel's samples to be contiguous floats, so only mono 32-bit float
+	 * files can be used this way. For anything else, which includes the usual 16 and 24-bit
+	 * and stereo files, this returns nullptr and the file has to be decoded instead. Those
+	 * only get the same benefits once CorpusLoader has cached a float copy of them.
+	 *
+	 * Every page is touched before returning, so playback doesn't have to wait for the disk.
+	 */
+	std::shared_ptr<const juce::AudioBuffer<float>> mapAudioFile(const juce::File& file, double& sampleRate);
+
+	/*
+	 * Opens a reader which decodes a WAV file from a memory mapping of it, rather than reading
+	 * it through a stream. Returns nullptr if the file isn't a WAV file or can't be mapped.
+	 */
+	std::unique_ptr<juce::AudioFormatReader> createMappedReader(const juce::File& file);
+}
+
+TEST_CASE("MappedAudioFile")
+{
+	const auto writeWav = [](const juce::File& file, const juce::AudioBuffer<float>& audio, const int bitsPerSample) {
+		file.deleteFile();
+
+		juce::WavAudioFormat wav;
+		std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(new juce::FileOutputStream(file), 44100.0,
+			(unsigned int)audio.getNumChannels(), bitsPerSample, {}, 0));
+
+		REQUIRE(writer != nullptr);
+		writer->writeFromAudioSampleBuffer(audio, 0, audio.getNumSamples());
+	};
+
+	juce::AudioBuffer<float> audio(2, 10000);
+	for (auto channel = 0; channel < 2; channel++)
+		for (auto i = 0; i < audio.getNumSamples(); i++)
+			audio.setSample(channel, i, std::sin(i * 0.01f * (channel + 1)) * 0.5f);
+
+	const auto directory = juce::File::getSpecialLocation(juce::File::tempDirectory);
+
+	SUBCASE("Mono float files are referenced in place")
+	{
+		const auto file = directory.getChildFile("PaletteMappedMono.wav");
+		writeWav(file, juce::AudioBuffer<float>(audio.getArrayOfWritePointers(), 1, audio.getNumSamples()), 32);
+
+		auto sampleRate = 0.0;
+		const auto mapped = Palette::mapAudioFile(file, sampleRate);
+
+		REQUIRE(mapped != nullptr);
+		CHECK(sampleRate == 44100.0);
+		CHECK(mapped->getNumChannels() == 1);
+		REQUIRE(mapped->getNumSamples() == audio.getNumSamples());
+
+		for (auto i = 0; i < audio.getNumSamples(); i++)
+			CHECK(mapped->getSample(0, i) == audio.getSample(0, i));
+
+		file.deleteFile();
+	}
+
+	SUBCASE("Other layouts have to be decoded from the mapping")
+	{
+		const auto file = directory.getChildFile("PaletteMappedStereo.wav");
+		writeWav(file, audio, 16);
+
+		auto sampleRate = 0.0;
+		CHECK(Palette::mapAudioFile(file, sampleRate) == nullptr);
+
+		auto reader = Palette::createMappedReader(file);
+		REQUIRE(reader != nullptr);
+		CHECK(reader->numChannels == 2);
+
+		juce::AudioBuffer<float> decoded(2, audio.getNumSamples());
+		reader->read(&decoded, 0, audio.getNumSamples(), 0, true, true);
+
+		for (auto i = 0; i < audio.getNumSamples(); i += 7)
+			CHECK(decoded.getSample(1, i) == doctest::Approx(audio.getSample(1, i)).epsilon(1e-3));
+
+		reader.reset();
+		file.deleteFile();
+	}
+
+	SUBCASE("Files which aren't WAV can't be mapped")
+	{
+		const auto file = directory.getChildFile("PaletteNotAWav.wav");
+		file.replaceWithData("nothing", 7);
+
+		auto sampleRate = 0.0;
+		CHECK(Palette::mapAudioFile(file, sampleRate) == nullptr);
+		CHECK(Palette::createMappedReader(file) == nullptr);
+
+		file.deleteFile();
+	}
+}
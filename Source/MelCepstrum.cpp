@@ -0,0 +1,162 @@
+/*
+  ==============================================================================
+
+    MelCepstrum.cpp
+    Created: 16 Oct 2026 7:20:27pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#include "MelCepstrum.h"
+
+namespace Palette
+{
+	namespace
+	{
+		double hzToMel(const double hz) noexcept { return 2595.0 * std::log10(1.0 + hz / 700.0); }
+		double melToHz(const double mel) noexcept { return 700.0 * (std::pow(10.0, mel / 2595.0) - 1.0); }
+
+		// Dot product with four independent sums, so the compiler is free to keep them in one vector register.
+		float dotProduct(const float* a, const float* b, const int numValues) noexcept
+		{
+			float sums[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			auto i = 0;
+
+			for (; i + 4 <= numValues; i += 4)
+				for (auto lane = 0; lane < 4; lane++)
+					sums[lane] += a[i + lane] * b[i + lane];
+
+			for (; i < numValues; i++)
+				sums[0] += a[i] * b[i];
+
+			return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+		}
+	}
+
+	MelCepstrum::MelCepstrum(const double sampleRate, const int fftSize, const Parameters& parameters)
+		: numBins(fftSize / 2 + 1),
+		  numFilters(parameters.numFilters),
+		  numCoefficients(parameters.numCoefficients),
+		  maxBatchSize(juce::jmax(1, parameters.maxBatchSize)),
+		  filterStart(static_cast<size_t>(parameters.numFilters)),
+		  filterLength(static_cast<size_t>(parameters.numFilters)),
+		  filterOffset(static_cast<size_t>(parameters.numFilters)),
+		  dct(static_cast<size_t>(parameters.numFilters * parameters.numCoefficients)),
+		  energies(static_cast<size_t>(parameters.numFilters * juce::jmax(1, parameters.maxBatchSize)))
+	{
+		jassert(numFilters > 0 && numCoefficients > 0 && numCoefficients <= numFilters);
+
+		const auto binWidth = sampleRate / fftSize;
+		const auto minMel = hzToMel(parameters.minFrequency);
+		const auto maxMel = hzToMel(juce::jmin(parameters.maxFrequency, sampleRate / 2));
+
+		// Filter f rises from edge f to a peak at edge f + 1 and falls back to zero at edge f + 2.
+		std::vector<double> edges(static_cast<size_t>(numFilters + 2));
+		for (size_t edge = 0; edge < edges.size(); edge++)
+			edges[edge] = melToHz(minMel + (maxMel - minMel) * static_cast<double>(edge) / static_cast<double>(numFilters + 1));
+
+		for (auto filter = 0; filter < numFilters; filter++)
+		{
+			const auto low = edges[static_cast<size_t>(filter)];
+			const auto centre = edges[static_cast<size_t>(filter + 1)];
+			const auto high = edges[static_cast<size_t>(filter + 2)];
+
+			const auto first = juce::jlimit(0, numBins, static_cast<int>(std::ceil(low / binWidth)));
+			const auto end = juce::jlimit(first, numBins, static_cast<int>(std::floor(high / binWidth)) + 1);
+
+			filterStart[static_cast<size_t>(filter)] = first;
+			filterLength[static_cast<size_t>(filter)] = end - first;
+			filterOffset[static_cast<size_t>(filter)] = weights.size();
+
+			for (auto bin = first; bin < end; bin++)
+			{
+				const auto frequency = bin * binWidth;
+				const auto weight = frequency <= centre ? (frequency - low) / (centre - low) : (high - frequency) / (high - centre);
+				weights.push_back(static_cast<float>(juce::jmax(0.0, weight)));
+			}
+		}
+
+		for (auto filter = 0; filter < numFilters; filter++)
+			for (auto coefficient = 0; coefficient < numCoefficients; coefficient++)
+			{
+				const auto scale = std::sqrt((coefficient == 0 ? 1.0 : 2.0) / numFilters);
+				const auto angle = juce::MathConstants<double>::pi * coefficient * (filter + 0.5) / numFilters;
+				dct[static_cast<size_t>(filter * numCoefficients + coefficient)] = static_cast<float>(scale * std::cos(angle));
+			}
+	}
+
+	MelCepstrum::MelCepstrum(const double sampleRate, const int fftSize)
+		: MelCepstrum(sampleRate, fftSize, Parameters()) { }
+
+	void MelCepstrum::compute(const float* powers, const size_t powerStride, const int numSpectra, float* coefficients,
+		const size_t coefficientStride) noexcept
+	{
+		for (auto batchStart = 0; batchStart < numSpectra; batchStart += maxBatchSize)
+		{
+			const auto batchSize = juce::jmin(maxBatchSize, numSpectra - batchStart);
+
+			for (auto spectrum = 0; spectrum < batchSize; spectrum++)
+			{
+				const auto* power = powers + static_cast<size_t>(batchStart + spectrum) * powerStride;
+				auto* energy = energies.data() + static_cast<size_t>(spectrum * numFilters);
+
+				for (size_t filter = 0; filter < filterStart.size(); filter++)
+					energy[filter] = dotProduct(weights.data() + filterOffset[filter], power + filterStart[filter], filterLength[filter]);
+			}
+
+			transformBatch(batchSize, coefficients + static_cast<size_t>(batchStart) * coefficientStride, coefficientStride);
+		}
+	}
+
+	void MelCepstrum::transformBatch(const int numSpectra, float* coefficients, const size_t coefficientStride) noexcept
+	{
+		const auto numEnergies = numSpectra * numFilters;
+
+		// log(1 + energy / energyFloor), over the whole batch at once.
+		juce::FloatVectorOperations::multiply(energies.data(), 1.0f / energyFloor, numEnergies);
+		juce::FloatVectorOperations::add(energies.data(), 1.0f, numEnergies);
+		logarithm(energies.data(), numEnergies);
+
+		for (auto spectrum = 0; spectrum < numSpectra; spectrum++)
+		{
+			const auto* energy = energies.data() + static_cast<size_t>(spectrum * numFilters);
+			auto* output = coefficients + static_cast<size_t>(spectrum) * coefficientStride;
+
+			juce::FloatVectorOperations::clear(output, numCoefficients);
+
+			for (auto filter = 0; filter < numFilters; filter++)
+				juce::FloatVectorOperations::addWithMultiply(output, dct.data() + static_cast<size_t>(filter * numCoefficients), energy[filter], numCoefficients);
+		}
+	}
+
+	void MelCepstrum::logarithm(float* values, const int numValues) noexcept
+	{
+		constexpr auto ln2 = 0.693147180559945f;
+
+		for (auto i = 0; i < numValues; i++)
+		{
+			// Split the value into 2^exponent * mantissa, with the mantissa in [1, 2)...
+			juce::uint32 bits;
+			std::memcpy(&bits, values + i, sizeof(bits));
+
+			auto exponent = static_cast<int>(bits >> 23) - 127;
+			bits = (bits & 0x007fffffu) | 0x3f800000u;
+
+			float mantissa;
+			std::memcpy(&mantissa, &bits, sizeof(mantissa));
+
+			// ...then into [sqrt(1/2), sqrt(2)), where the series below converges fastest.
+			const auto isHigh = mantissa > 1.41421356f;
+			mantissa = isHigh ? mantissa * 0.5f : mantissa;
+			exponent += isHigh ? 1 : 0;
+
+			// log(m) = 2 atanh(t) for t = (m - 1) / (m + 1), and |t| < 0.172 so four terms are plenty.
+			const auto t = (mantissa - 1.0f) / (mantissa + 1.0f);
+			const auto t2 = t * t;
+			const auto series = 2.0f * t * (1.0f + t2 * (1.0f / 3.0f + t2 * (1.0f / 5.0f + t2 * (1.0f / 7.0f))));
+
+			values[i] = static_cast<float>(exponent) * ln2 + series;
+		}
+	}
+}
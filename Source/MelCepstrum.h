@@ -0,0 +1,181 @@
+/*
+  ==============================================================================
+
+    MelCepstrum.h
+    Created: 16 Oct 2026 7:20:27pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+namespace Palette
+{
+	/*
+	 * MelCepstrum turns power spectra into mel frequency cepstral coefficients (MFCCs), which
+	 * describe the shape of a spectral envelope much as the ear hears it.
+	 *
+	 * Each spectrum is summed through a bank of triangular filters evenly spaced on the mel
+	 * scale. Every filter only covers the bins between its neighbours' centres, so the bank is
+	 * stored sparsely as one run of weights per filter rather than as a matrix mostly of zeros.
+	 * The filter energies are then logged and decorrelated with an orthonormal DCT-II.
+	 *
+	 * compute() works on a batch of spectra at a time: the filterbank pass streams through the
+	 * spectra, then the log and DCT each run as one long vectorised pass over the whole batch's
+	 * filter energies, so the per-grain cost is dominated by reading the spectra.
+	 *
+	 * Everything is allocated in the constructor, so compute() is real time safe. It isn't
+	 * thread safe, so use one per thread.
+	 */
+	class MelCepstrum
+	{
+	public:
+		struct Parameters
+		{
+			int numFilters = 40;
+			int numCoefficients = 13;
+			// The band the filters cover, in hz. It's capped at the Nyquist frequency.
+			double minFrequency = 20.0;
+			double maxFrequency = 20000.0;
+			// The most spectra whose filter energies are held at once.
+			int maxBatchSize = 64;
+		};
+
+		// Prepares for power spectra of fftSize / 2 + 1 bins, from an FFT of fftSize samples at sampleRate.
+		MelCepstrum(double sampleRate, int fftSize, const Parameters& parameters);
+		MelCepstrum(double sampleRate, int fftSize);
+
+		/*
+		 * Computes the coefficients of numSpectra power spectra. Spectrum s starts at
+		 * powers + s * powerStride, and its coefficients are written to
+		 * coefficients + s * coefficientStride.
+		 *
+		 * Filter energies are logged as log(1 + energy / energyFloor), so a silent spectrum
+		 * has coefficients of exactly 0 and anything audible is unaffected but for an offset
+		 * in the first coefficient.
+		 */
+		void compute(const float* powers, size_t powerStride, int numSpectra, float* coefficients, size_t coefficientStride) noexcept;
+
+		int getNumFilters() const noexcept { return numFilters; }
+		int getNumCoefficients() const noexcept { return numCoefficients; }
+
+		/*
+		 * Natural log of numValues values in place. They must be positive, normal floats.
+		 * Written without branches or library calls so the compiler can vectorise it, and
+		 * accurate to within a few units in the last place.
+		 */
+		static void logarithm(float* values, int numValues) noexcept;
+
+		// Power below this is treated as silence.
+		static constexpr float energyFloor = 1.0e-10f;
+
+	private:
+		// Logs and transforms the filter energies of the first numSpectra spectra of the batch.
+		void transformBatch(int numSpectra, float* coefficients, size_t coefficientStride) noexcept;
+
+		const int numBins;
+		const int numFilters;
+		const int numCoefficients;
+		const int maxBatchSize;
+
+		// Filter f weights bins [filterStart[f], filterStart[f] + filterLength[f]) by weights[filterOffset[f]...].
+		std::vector<int> filterStart;
+		std::vector<int> filterLength;
+		std::vector<size_t> filterOffset;
+		std::vector<float> weights;
+
+		// The DCT transposed: numFilters rows of numCoefficients, so each filter adds its row to the output.
+		std::vector<float> dct;
+
+		// numFilters filter energies for each spectrum of the batch.
+		std::vector<float> energies;
+
+		JUCE_DECLARE_NON_COPYABLE(MelCepstrum)
+	};
+}
+
+TEST_CASE("MelCepstrum")
+{
+	const auto sampleRate = 44100.0;
+	const auto fftSize = 2048;
+	const auto numBins = fftSize / 2 + 1;
+
+	Palette::MelCepstrum cepstrum(sampleRate, fftSize);
+	const auto numCoefficients = cepstrum.getNumCoefficients();
+
+	// A sloping spectrum with a few strong peaks, and another much brighter one.
+	std::vector<float> spectra(static_cast<size_t>(numBins * 2));
+	for (auto bin = 0; bin < numBins; bin++)
+	{
+		spectra[static_cast<size_t>(bin)] = 100.0f / (1.0f + bin) + (bin % 97 == 5 ? 50.0f : 0.0f);
+		spectra[static_cast<size_t>(numBins + bin)] = 0.01f * bin;
+	}
+
+	SUBCASE("The logarithm is accurate across the float range")
+	{
+		std::vector<float> values;
+		for (auto value = 1.0e-30f; value < 1.0e30f; value *= 1.37f)
+			values.push_back(value);
+		values.push_back(1.0f);
+
+		auto logs = values;
+		Palette::MelCepstrum::logarithm(logs.data(), static_cast<int>(logs.size()));
+
+		for (size_t i = 0; i < values.size(); i++)
+			CHECK(logs[i] == doctest::Approx(std::log(values[i])).epsilon(1.0e-6).scale(1.0e-6));
+
+		CHECK(logs.back() == 0.0f);
+	}
+
+	SUBCASE("Silence has no coefficients")
+	{
+		std::vector<float> silence(static_cast<size_t>(numBins), 0.0f);
+		std::vector<float> coefficients(static_cast<size_t>(numCoefficients), 1.0f);
+
+		cepstrum.compute(silence.data(), 0, 1, coefficients.data(), 0);
+
+		for (const auto coefficient : coefficients)
+			CHECK(coefficient == 0.0f);
+	}
+
+	SUBCASE("Batches give the same coefficients as one spectrum at a time")
+	{
+		Palette::MelCepstrum smallBatches(sampleRate, fftSize, { 40, 13, 20.0, 20000.0, 1 });
+
+		std::vector<float> batched(static_cast<size_t>(numCoefficients * 2));
+		std::vector<float> single(batched.size());
+
+		cepstrum.compute(spectra.data(), numBins, 2, batched.data(), static_cast<size_t>(numCoefficients));
+		smallBatches.compute(spectra.data(), numBins, 2, single.data(), static_cast<size_t>(numCoefficients));
+
+		CHECK(batched == single);
+
+		// And different spectra have different coefficients.
+		CHECK(std::abs(batched[1] - batched[static_cast<size_t>(numCoefficients) + 1]) > 1.0f);
+	}
+
+	SUBCASE("Louder spectra only move the first coefficient")
+	{
+		const auto gain = 1000.0f;
+
+		std::vector<float> louder(spectra.begin(), spectra.begin() + numBins);
+		for (auto& power : louder)
+			power *= gain;
+
+		std::vector<float> quiet(static_cast<size_t>(numCoefficients));
+		std::vector<float> loud(quiet.size());
+
+		cepstrum.compute(spectra.data(), 0, 1, quiet.data(), 0);
+		cepstrum.compute(louder.data(), 0, 1, loud.data(), 0);
+
+		// An orthonormal DCT turns a constant offset in every log energy into sqrt(numFilters) times it in c0.
+		CHECK(loud[0] - quiet[0] == doctest::Approx(std::sqrt(40.0f) * std::log(gain)).epsilon(1.0e-4));
+
+		for (auto coefficient = 1; coefficient < numCoefficients; coefficient++)
+			CHECK(loud[static_cast<size_t>(coefficient)] == doctest::Approx(quiet[static_cast<size_t>(coefficient)]).epsilon(1.0e-4).scale(1.0));
+	}
+}
@@ -0,0 +1,228 @@
+/*
+  ==============================================================================
+
+    MosaicRenderer.cpp
+    Created: 16 Oct 2026 6:54:59pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#include "MosaicRenderer.h"
+
+#include "ParallelWork.h"
+
+namespace Palette
+{
+	MosaicRenderer::MosaicRenderer(const Options& renderOptions)
+		: options(renderOptions) { }
+
+	void MosaicRenderer::addCorpus(std::shared_ptr<const Corpus<float>> corpus)
+	{
+		jassert(corpus != nullptr && corpus->getDescriptors().getNumGrains() == corpus->getGrains().size());
+
+		const auto& corpusGrains = corpus->getGrains();
+		const auto& corpusDescriptors = corpus->getDescriptors();
+
+		/*
+		 * Joins only ever run within a corpus, so each one's graph is kept as it is, just renumbered.
+		 * Its costs are in that corpus's own standard deviations, but they only chose which
+		 * successors it lists; the joins themselves are measured with the combined weights.
+		 */
+		if (corpus->getSuccessors().getNumGrains() == static_cast<int>(corpusGrains.size()))
+		{
+			successors.append(corpus->getSuccessors());
+		}
+		else
+		{
+			std::array<float, numDescriptors> weights;
+			DescriptorStatistics::measure(corpusDescriptors).getStandardWeights(weights.data());
+
+			SuccessorGraph corpusSuccessors;
+			corpusSuccessors.build(corpusDescriptors, Corpus<float>::successorsPerGrain, nullptr, weights.data());
+			successors.append(corpusSuccessors);
+		}
+
+		grains.insert(grains.end(), corpusGrains.begin(), corpusGrains.end());
+		corpora.push_back(std::move(corpus));
+
+		selectionIsBuilt = false;
+	}
+
+	void MosaicRenderer::buildDescriptors()
+	{
+		// Descriptor tables are fixed size, so the combined one is only built once every corpus is in.
+		descriptors = DescriptorTable(numDescriptors, grains.size());
+		size_t firstRow = 0;
+
+		for (const auto& corpus : corpora)
+		{
+			const auto& corpusDescriptors = corpus->getDescriptors();
+
+			for (auto dimension = 0; dimension < numDescriptors; dimension++)
+				std::copy_n(corpusDescriptors.getColumn(dimension), corpusDescriptors.getNumGrains(), descriptors.getColumn(dimension) + firstRow);
+
+			firstRow += corpusDescriptors.getNumGrains();
+		}
+	}
+
+	juce::AudioBuffer<float> MosaicRenderer::render(const juce::AudioBuffer<float>& target, const double sampleRate, const int numChannels,
+		juce::ThreadPool* pool)
+	{
+		const auto placements = placeGrains(target, sampleRate, pool);
+
+		// Long enough for the target, and for the last grain to ring out past it.
+		auto length = target.getNumSamples();
+		for (const auto& placement : placements)
+			length = juce::jmax(length, placement.startSample + grains[static_cast<size_t>(placement.grain)].getNumSamples());
+
+		juce::AudioBuffer<float> output(numChannels, length);
+		output.clear();
+
+		if (placements.empty())
+			return output;
+
+		const auto chunkSamples = juce::jmax(options.blockSize, juce::roundToInt(options.chunkLength * sampleRate));
+		std::vector<Chunk> chunks(static_cast<size_t>((length + chunkSamples - 1) / chunkSamples));
+
+		// Placements are in order of their start, like the target grains they came from.
+		const auto firstStartingAtOrAfter = [&placements](const int sample) {
+			return std::lower_bound(placements.begin(), placements.end(), sample,
+				[](const Placement& placement, const int start) { return placement.startSample < start; });
+		};
+
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			auto& chunk = chunks[i];
+			chunk.start = static_cast<int>(i) * chunkSamples;
+			chunk.end = juce::jmin(length, chunk.start + chunkSamples);
+			chunk.first = firstStartingAtOrAfter(chunk.start);
+			chunk.last = firstStartingAtOrAfter(chunk.end);
+		}
+
+		std::atomic<size_t> nextChunk{ 0 };
+
+		// Taken once up front, as AudioBuffer's own write functions all update its state.
+		auto* const* outputChannels = output.getArrayOfWritePointers();
+
+		auto renderChunks = [&]()
+		{
+			GrainScheduler scheduler;
+			scheduler.prepare(options.maxVoices, options.blockSize);
+			juce::AudioBuffer<float> block(numChannels, options.blockSize);
+
+			for (auto chunk = nextChunk++; chunk < chunks.size(); chunk = nextChunk++)
+				renderChunk(chunks[chunk], scheduler, block, outputChannels);
+		};
+
+		// Chunks only write their own span of the output, so the calling thread and any helpers can render them in any order.
+		runOnPool(pool, static_cast<int>(chunks.size()) - 1, renderChunks);
+
+		// Overlap-add the tails in chunk order, so the sums are rounded the same way every time.
+		for (const auto& chunk : chunks)
+			for (auto channel = 0; channel < numChannels; channel++)
+				output.addFrom(channel, chunk.end, chunk.tail, channel, 0, chunk.tail.getNumSamples());
+
+		return output;
+	}
+
+	std::vector<MosaicRenderer::Placement> MosaicRenderer::placeGrains(const juce::AudioBuffer<float>& target, const double sampleRate,
+		juce::ThreadPool* pool)
+	{
+		if (grains.empty())
+			return {};
+
+		if (! selectionIsBuilt)
+		{
+			buildDescriptors();
+			synthesizer.setDescriptors(descriptors, pool);
+			synthesizer.setSelectionStrategy(options.selectionStrategy, pool);
+			synthesizer.setSuccessors(successors);
+			selectionIsBuilt = true;
+		}
+
+		const auto targetGrains = createGrains(target, options.grainLength, sampleRate, options.hopLength, options.windowType);
+		const auto targetDescriptors = pool != nullptr ? analyseGrains(targetGrains, sampleRate, *pool) : analyseGrains(targetGrains, sampleRate);
+
+		// Every target grain's descriptors, one row after another.
+		std::vector<float> targetRows(targetGrains.size() * static_cast<size_t>(numDescriptors));
+		for (size_t i = 0; i < targetGrains.size(); i++)
+			targetDescriptors.getRow(i, targetRows.data() + i * static_cast<size_t>(numDescriptors));
+
+		std::vector<int> selected(targetGrains.size(), -1);
+
+		if (options.selectPaths)
+		{
+			ConcatenativeSynthesizer::PathLattice lattice;
+			lattice.prepare(options.pathParameters, numDescriptors);
+			synthesizer.selectPath(targetRows.data(), static_cast<int>(targetGrains.size()), -1, lattice, selected.data());
+		}
+		else
+		{
+			for (size_t i = 0; i < targetGrains.size(); i++)
+				selected[i] = synthesizer.selectGrain(targetRows.data() + i * static_cast<size_t>(numDescriptors));
+		}
+
+		const auto rms = static_cast<size_t>(Descriptor::rms);
+		std::vector<Placement> placements;
+		placements.reserve(targetGrains.size());
+
+		for (size_t i = 0; i < targetGrains.size(); i++)
+		{
+			const auto grain = selected[i];
+
+			if (grain < 0)
+				continue;
+
+			auto gain = options.gain;
+
+			if (options.matchLoudness)
+			{
+				const auto grainLevel = descriptors.getValue(static_cast<size_t>(grain), static_cast<int>(rms));
+				const auto targetLevel = targetRows[i * static_cast<size_t>(numDescriptors) + rms];
+				gain *= grainLevel > 0.0f ? juce::jmin(options.maximumGain, targetLevel / grainLevel) : 0.0f;
+			}
+
+			placements.push_back({ targetGrains[i].startSample, grain, gain });
+		}
+
+		return placements;
+	}
+
+	void MosaicRenderer::renderChunk(Chunk& chunk, GrainScheduler& scheduler, juce::AudioBuffer<float>& block, float* const* output) const
+	{
+		scheduler.reset();
+
+		auto renderEnd = chunk.end;
+		for (auto placement = chunk.first; placement != chunk.last; ++placement)
+			renderEnd = juce::jmax(renderEnd, placement->startSample + grains[static_cast<size_t>(placement->grain)].getNumSamples());
+
+		chunk.tail.setSize(block.getNumChannels(), renderEnd - chunk.end);
+		chunk.tail.clear();
+
+		auto next = chunk.first;
+
+		for (auto blockStart = chunk.start; blockStart < renderEnd;)
+		{
+			// Blocks stop at the end of the chunk, so each one lands wholly in the output or wholly in the tail.
+			const auto inOutput = blockStart < chunk.end;
+			const auto numSamples = juce::jmin(options.blockSize, (inOutput ? chunk.end : renderEnd) - blockStart);
+
+			for (; next != chunk.last && next->startSample < blockStart + numSamples; ++next)
+				scheduler.startGrain(grains[static_cast<size_t>(next->grain)], next->startSample - blockStart, next->gain);
+
+			block.clear();
+			scheduler.renderNextBlock(block, 0, numSamples);
+
+			for (auto channel = 0; channel < block.getNumChannels(); channel++)
+			{
+				if (inOutput)
+					juce::FloatVectorOperations::copy(output[channel] + blockStart, block.getReadPointer(channel), numSamples);
+				else
+					chunk.tail.copyFrom(channel, blockStart - chunk.end, block, channel, 0, numSamples);
+			}
+
+			blockStart += numSamples;
+		}
+	}
+}
@@ -0,0 +1,270 @@
+/*
+  ==============================================================================
+
+    MosaicRenderer.h
+    Created: 16 Oct 2026 6:54:59pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+#include "Corpus.h"
+#include "ConcatenativeSynthesizer.h"
+#include "GrainScheduler.h"
+
+namespace Palette
+{
+	/*
+	 * MosaicRenderer rebuilds a target recording out of grains from one or more corpora, offline.
+	 *
+	 * The target is segmented with createGrains and analysed exactly as a corpus is. Each of its
+	 * grains is replaced by a corpus grain ConcatenativeSynthesizer selects for its descriptors,
+	 * started by a GrainScheduler on the sample the target grain started on. By default grains are
+	 * chosen as a path, so the mosaic runs on through the corpus where it can rather than jumping
+	 * to whichever grain is nearest each time. Playback runs a block at a time through the same
+	 * scheduler processBlock uses, just as fast as the CPU allows.
+	 *
+	 * The target's timeline is split into chunks which are rendered independently, each by its
+	 * own scheduler, so they can be spread across threads. Grains ringing on past the end of their
+	 * chunk are overlap-added onto the chunks after it once every chunk is done, always in the
+	 * same order, so the result is bit for bit the same however many threads render it.
+	 */
+	class MosaicRenderer
+	{
+	public:
+		struct Options
+		{
+			// Length, hop (both in miliseconds) and window of the target grains.
+			double grainLength = 100.0;
+			double hopLength = 50.0;
+			WindowType windowType = WindowType::hann;
+
+			ConcatenativeSynthesizer::SelectionStrategy selectionStrategy = ConcatenativeSynthesizer::SelectionStrategy::kdTree;
+
+			// Whether grains are chosen as a path through the target (see ConcatenativeSynthesizer::selectPath), or each on its own.
+			bool selectPaths = true;
+			ConcatenativeSynthesizer::PathParameters pathParameters;
+
+			// Whether each grain is scaled to the loudness of the target grain it replaces, by up to maximumGain.
+			bool matchLoudness = true;
+			float maximumGain = 4.0f;
+
+			// Gain applied to every grain.
+			float gain = 1.0f;
+
+			// Samples rendered at a time, and the most grains which can play at once in each chunk.
+			int blockSize = 512;
+			int maxVoices = 256;
+
+			// Seconds of the target in each chunk rendered on its own.
+			double chunkLength = 10.0;
+		};
+
+		explicit MosaicRenderer(const Options& renderOptions);
+
+		/*
+		 * Adds corpus's grains to those selected from. corpus must have been analysed, at the
+		 * same sample rate the targets are rendered at.
+		 */
+		void addCorpus(std::shared_ptr<const Corpus<float>> corpus);
+
+		int getNumGrains() const noexcept { return static_cast<int>(grains.size()); }
+
+		/*
+		 * Renders a mosaic of target, sampled at sampleRate, into numChannels channels. The
+		 * result runs on past the end of target until the last grain started has finished.
+		 * If pool is given, analysing the target, building the selection index and rendering
+		 * the chunks are shared between its threads and the calling thread.
+		 */
+		juce::AudioBuffer<float> render(const juce::AudioBuffer<float>& target, double sampleRate, int numChannels,
+			juce::ThreadPool* pool = nullptr);
+
+	private:
+		// A corpus grain to play, and where.
+		struct Placement
+		{
+			int startSample;
+			int grain;
+			float gain;
+		};
+
+		/*
+		 * A span of the output, [start, end), and the grains starting in it. Whatever they
+		 * play past end goes into tail rather than the output.
+		 */
+		struct Chunk
+		{
+			int start;
+			int end;
+			std::vector<Placement>::const_iterator first;
+			std::vector<Placement>::const_iterator last;
+			juce::AudioBuffer<float> tail;
+		};
+
+		// Gathers every corpus's descriptors into descriptors, in the same order as grains.
+		void buildDescriptors();
+
+		// Selects a corpus grain for every grain of target.
+		std::vector<Placement> placeGrains(const juce::AudioBuffer<float>& target, double sampleRate, juce::ThreadPool* pool);
+
+		// Plays a chunk's grains into the output channels and its tail, a block at a time through block.
+		void renderChunk(Chunk& chunk, GrainScheduler& scheduler, juce::AudioBuffer<float>& block, float* const* output) const;
+
+		const Options options;
+
+		std::vector<std::shared_ptr<const Corpus<float>>> corpora;
+		// Every grain of every corpus, in the same order as the rows of descriptors.
+		std::vector<Grain<float>> grains;
+		// Built along with the selection, rather than as each corpus is added.
+		DescriptorTable descriptors;
+		// Every corpus's successor graph, one after another, numbered like grains.
+		SuccessorGraph successors;
+
+		ConcatenativeSynthesizer synthesizer;
+		bool selectionIsBuilt = false;
+
+		JUCE_DECLARE_NON_COPYABLE(MosaicRenderer)
+	};
+}
+
+TEST_CASE("MosaicRenderer")
+{
+	const auto sampleRate = 44100.0;
+	const auto length = 44100;
+
+	// A corpus of four tones, each a quarter of a second long, fading in so no two grains sound the same.
+	juce::AudioBuffer<float> tones(1, length);
+	const double frequencies[] = { 220.0, 440.0, 880.0, 1760.0 };
+
+	for (auto i = 0; i < length; i++)
+	{
+		const auto level = 0.2 + 0.8 * i / length;
+		tones.setSample(0, i, static_cast<float>(level * std::sin(juce::MathConstants<double>::twoPi * frequencies[i / (length / 4)] * i / sampleRate)));
+	}
+
+	Palette::MosaicRenderer::Options options;
+
+	auto corpus = std::make_shared<Palette::Corpus<float>>(juce::AudioBuffer<float>(tones), sampleRate);
+	corpus->segment(options.grainLength, options.hopLength, options.windowType);
+	corpus->analyse();
+
+	SUBCASE("A target taken from the corpus is rebuilt from its own grains")
+	{
+		Palette::MosaicRenderer renderer(options);
+		renderer.addCorpus(corpus);
+		REQUIRE(renderer.getNumGrains() == static_cast<int>(corpus->getGrains().size()));
+
+		const auto output = renderer.render(tones, sampleRate, 1);
+		REQUIRE(output.getNumSamples() >= length);
+
+		// Hann windows half a grain apart sum to one, so away from the ends it's the target again.
+		const auto grainSamples = static_cast<int>(sampleRate * options.grainLength / 1000);
+		auto largestError = 0.0f;
+
+		for (auto i = grainSamples; i < length - grainSamples; i++)
+			largestError = juce::jmax(largestError, std::abs(output.getSample(0, i) - tones.getSample(0, i)));
+
+		CHECK(largestError < 1.0e-3f);
+	}
+
+	SUBCASE("Choosing each grain on its own rebuilds it too")
+	{
+		auto nearestOptions = options;
+		nearestOptions.selectPaths = false;
+
+		Palette::MosaicRenderer renderer(nearestOptions);
+		renderer.addCorpus(corpus);
+
+		const auto output = renderer.render(tones, sampleRate, 1);
+		const auto grainSamples = static_cast<int>(sampleRate * options.grainLength / 1000);
+		auto largestError = 0.0f;
+
+		for (auto i = grainSamples; i < length - grainSamples; i++)
+			largestError = juce::jmax(largestError, std::abs(output.getSample(0, i) - tones.getSample(0, i)));
+
+		CHECK(largestError < 1.0e-3f);
+	}
+
+	SUBCASE("Several corpora are selected from as one")
+	{
+		// A quiet corpus first, so the tones' grains come after its grains.
+		juce::AudioBuffer<float> hiss(1, length / 2);
+		juce::Random random(3);
+		for (auto i = 0; i < hiss.getNumSamples(); i++)
+			hiss.setSample(0, i, 0.01f * (random.nextFloat() * 2.0f - 1.0f));
+
+		auto hissCorpus = std::make_shared<Palette::Corpus<float>>(std::move(hiss), sampleRate);
+		hissCorpus->segment(options.grainLength, options.hopLength, options.windowType);
+		hissCorpus->analyse();
+
+		Palette::MosaicRenderer renderer(options);
+		renderer.addCorpus(hissCorpus);
+		renderer.addCorpus(corpus);
+		REQUIRE(renderer.getNumGrains() == static_cast<int>(hissCorpus->getGrains().size() + corpus->getGrains().size()));
+
+		const auto output = renderer.render(tones, sampleRate, 1);
+		const auto grainSamples = static_cast<int>(sampleRate * options.grainLength / 1000);
+		auto largestError = 0.0f;
+
+		for (auto i = grainSamples; i < length - grainSamples; i++)
+			largestError = juce::jmax(largestError, std::abs(output.getSample(0, i) - tones.getSample(0, i)));
+
+		CHECK(largestError < 1.0e-3f);
+	}
+
+	SUBCASE("Grains are repeated across extra channels")
+	{
+		Palette::MosaicRenderer renderer(options);
+		renderer.addCorpus(corpus);
+
+		const auto output = renderer.render(tones, sampleRate, 2);
+		REQUIRE(output.getNumChannels() == 2);
+
+		for (auto i = 0; i < output.getNumSamples(); i += 97)
+			CHECK(output.getSample(0, i) == output.getSample(1, i));
+	}
+
+	SUBCASE("Rendering across threads gives exactly the same mosaic")
+	{
+		auto chunkedOptions = options;
+		chunkedOptions.chunkLength = 0.1;
+
+		Palette::MosaicRenderer renderer(chunkedOptions);
+		renderer.addCorpus(corpus);
+
+		const auto serial = renderer.render(tones, sampleRate, 1);
+
+		juce::ThreadPool pool(4);
+		const auto parallel = renderer.render(tones, sampleRate, 1, &pool);
+
+		REQUIRE(parallel.getNumSamples() == serial.getNumSamples());
+		CHECK(std::memcmp(parallel.getReadPointer(0), serial.getReadPointer(0), sizeof(float) * static_cast<size_t>(serial.getNumSamples())) == 0);
+
+		// The seams between chunks are seamless: it's the same as rendering in one go, give or take rounding.
+		Palette::MosaicRenderer whole(options);
+		whole.addCorpus(corpus);
+		const auto unchunked = whole.render(tones, sampleRate, 1);
+
+		REQUIRE(unchunked.getNumSamples() == serial.getNumSamples());
+		auto largestDifference = 0.0f;
+
+		for (auto i = 0; i < serial.getNumSamples(); i++)
+			largestDifference = juce::jmax(largestDifference, std::abs(unchunked.getSample(0, i) - serial.getSample(0, i)));
+
+		CHECK(largestDifference < 1.0e-5f);
+	}
+
+	SUBCASE("Without any grains the mosaic is silent")
+	{
+		Palette::MosaicRenderer renderer(options);
+		const auto output = renderer.render(tones, sampleRate, 1);
+
+		CHECK(output.getNumSamples() == length);
+		CHECK(output.getMagnitude(0, output.getNumSamples()) == 0.0f);
+	}
+}
@@ -0,0 +1,320 @@
+/*
+  ==============================================================================
+
+    OnsetSegmenter.h
+    Created: 16 Oct 2026 6:12:03pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+#include "Grain.h"
+#include "Stft.h"
+#include "Window.h"
+
+namespace Palette
+{
+	/*
+	 * Half-wave rectified spectral flux between two magnitude spectra: the sum of every
+	 * bin's increase in magnitude since the previous frame. Decreases are ignored since
+	 * onsets are where energy arrives, not where it leaves.
+	 *
+	 * The per-bin work is done with juce::FloatVectorOperations so it runs on SIMD registers.
+	 * scratch must hold at least numBins floats.
+	 */
+	inline float spectralFlux(const float* current, const float* previous, float* scratch, const int numBins) noexcept
+	{
+		juce::FloatVectorOperations::subtract(scratch, current, previous, numBins);
+		juce::FloatVectorOperations::max(scratch, scratch, 0.0f, numBins);
+
+		// Four independent sums so the compiler is free to keep them in one vector register.
+		float sums[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		auto bin = 0;
+
+		for (; bin + 4 <= numBins; bin += 4)
+			for (auto lane = 0; lane < 4; lane++)
+				sums[lane] += scratch[bin + lane];
+
+		for (; bin < numBins; bin++)
+			sums[0] += scratch[bin];
+
+		return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+	}
+
+	/*
+	 * OnsetSegmenter finds the sample positions where new sounds start, using spectral flux
+	 * peaks above an adaptive threshold (a multiple of the recent mean flux).
+	 *
+	 * It is fed audio a block at a time and never looks back at samples it has already been
+	 * given, so a file can be segmented in a single streaming pass while it's decoded.
+	 * Everything it needs is allocated up front in the constructor.
+	 */
+	class OnsetSegmenter
+	{
+	public:
+		struct Parameters
+		{
+			// The FFT analyses 2^fftOrder samples per frame.
+			int fftOrder = 10;
+			// Samples between the start of consecutive analysis frames.
+			int hopSize = 256;
+			// How many past frames the adaptive threshold averages flux over.
+			int thresholdFrames = 16;
+			// A frame is an onset if its flux exceeds thresholdOffset + thresholdMultiplier * mean recent flux.
+			float thresholdMultiplier = 1.5f;
+			float thresholdOffset = 0.01f;
+			// Onsets closer than this (miliseconds) to the previous one are ignored.
+			double minGrainLength = 30.0;
+			// Gaps between onsets longer than this (miliseconds) are split into grains of this length.
+			double maxGrainLength = 2000.0;
+		};
+
+		OnsetSegmenter(const double sampleRate, const Parameters& params)
+			: parameters(params),
+			  numBins((1 << params.fftOrder) / 2 + 1),
+			  minOnsetSpacing(juce::jmax(1, static_cast<int>(sampleRate * params.minGrainLength / 1000))),
+			  mono(static_cast<size_t>(monoBlockSize), 0.0f),
+			  previousMagnitudes(static_cast<size_t>(numBins), 0.0f),
+			  scratch(static_cast<size_t>(numBins), 0.0f),
+			  fluxHistory(static_cast<size_t>(juce::jmax(1, params.thresholdFrames)), 0.0f)
+		{
+			Stft::Parameters stftParameters;
+			stftParameters.frameOrder = params.fftOrder;
+			stftParameters.hopSize = params.hopSize;
+			stftParameters.windowType = WindowType::hann;
+			stftParameters.spectrum = Stft::Spectrum::magnitude;
+			stft.prepare(stftParameters);
+
+			// Every file starts a grain at its first sample.
+			onsets.push_back(0);
+		}
+
+		/*
+		 * Feeds the next numSamples samples of the audio, starting at startSample of block,
+		 * to the detector. Channels are mixed to mono before analysis.
+		 */
+		template <typename SampleType>
+		void process(const juce::AudioBuffer<SampleType>& block, const int startSample, const int numSamples)
+		{
+			const auto numChannels = block.getNumChannels();
+			const auto channelGain = numChannels > 0 ? 1.0f / numChannels : 0.0f;
+
+			for (auto start = 0; start < numSamples; start += monoBlockSize)
+			{
+				const auto numToMix = juce::jmin(monoBlockSize, numSamples - start);
+
+				for (auto i = 0; i < numToMix; i++)
+				{
+					auto sum = 0.0f;
+					for (auto ch = 0; ch < numChannels; ch++)
+						sum += static_cast<float>(block.getReadPointer(ch)[startSample + start + i]);
+
+					mono[static_cast<size_t>(i)] = sum * channelGain;
+				}
+
+				stft.push(mono.data(), numToMix, [this](const float* magnitudes) { analyseFrame(magnitudes); });
+			}
+
+			samplesProcessed += numSamples;
+		}
+
+		// The sample positions of every onset found so far, in ascending order. The first is always 0.
+		const std::vector<juce::int64>& getOnsets() const noexcept { return onsets; }
+
+		// How many samples have been passed to process().
+		juce::int64 getNumSamplesProcessed() const noexcept { return samplesProcessed; }
+
+		/*
+		 * Turns the onsets found in audioData so far into grains which run from each onset to
+		 * the next, starting at onset firstOnset (so grains already handed out aren't made twice).
+		 * The grain after the last onset is only made once isFinished is true, since until then
+		 * it might still be cut short by an onset that hasn't been detected yet.
+		 */
+		template <typename SampleType>
+		void appendGrains(const juce::AudioBuffer<SampleType>& audioData, const double sampleRate, std::vector<Grain<SampleType>>& grains,
+			const size_t firstOnset, const bool isFinished) const
+		{
+			const auto maxSamples = juce::jmax(1, static_cast<int>(sampleRate * parameters.maxGrainLength / 1000));
+			const auto numChannels = audioData.getNumChannels();
+
+			for (auto i = firstOnset; i < onsets.size(); i++)
+			{
+				const auto isLast = i + 1 == onsets.size();
+				if (isLast && ! isFinished)
+					break;
+
+				const auto end = isLast ? static_cast<juce::int64>(audioData.getNumSamples()) : onsets[i + 1];
+
+				// Split long gaps between onsets so no grain is longer than maxGrainLength.
+				for (auto start = onsets[i]; start < end; start += maxSamples)
+				{
+					const auto length = static_cast<int>(juce::jmin(static_cast<juce::int64>(maxSamples), end - start));
+					grains.emplace_back(audioData, static_cast<int>(start), length, 0, numChannels);
+				}
+			}
+		}
+
+	private:
+		void analyseFrame(const float* magnitudes)
+		{
+			const auto flux = spectralFlux(magnitudes, previousMagnitudes.data(), scratch.data(), numBins) / numBins;
+			juce::FloatVectorOperations::copy(previousMagnitudes.data(), magnitudes, numBins);
+
+			/*
+			 * A frame can only be judged a peak once the frame after it has been seen,
+			 * so every decision is made one hop late about the previous frame.
+			 */
+			const auto historySize = static_cast<int>(fluxHistory.size());
+			const auto meanFlux = fluxHistorySum / juce::jmax(1, juce::jmin(framesAnalysed, historySize));
+			const auto threshold = parameters.thresholdOffset + parameters.thresholdMultiplier * meanFlux;
+
+			if (framesAnalysed > 1 && previousFlux > threshold && previousFlux > fluxBeforePrevious && previousFlux >= flux)
+			{
+				/*
+				 * The transient dominates a Hann windowed frame around its centre. The onset is
+				 * nudged back a hop from there so grains start just before attacks rather than in them.
+				 */
+				const auto frameStart = samplesProcessedAtFrame(framesAnalysed - 1);
+				const auto onset = juce::jmax<juce::int64>(0, frameStart + stft.getFrameSize() / 2 - parameters.hopSize);
+
+				if (onset - onsets.back() >= minOnsetSpacing)
+					onsets.push_back(onset);
+			}
+
+			// The threshold is built from the frames before the one being judged.
+			auto& oldest = fluxHistory[static_cast<size_t>(framesAnalysed % historySize)];
+			fluxHistorySum += previousFlux - oldest;
+			oldest = previousFlux;
+
+			fluxBeforePrevious = previousFlux;
+			previousFlux = flux;
+			framesAnalysed++;
+		}
+
+		// The position in the input of the first sample of the given frame.
+		juce::int64 samplesProcessedAtFrame(const int frameIndex) const noexcept
+		{
+			return static_cast<juce::int64>(frameIndex) * parameters.hopSize;
+		}
+
+		// Samples mixed to mono at a time before they're pushed to the Stft.
+		static constexpr int monoBlockSize = 1024;
+
+		const Parameters parameters;
+
+		const int numBins;
+		const int minOnsetSpacing;
+
+		Stft stft;
+		std::vector<float> mono;
+		std::vector<float> previousMagnitudes;
+		std::vector<float> scratch;
+
+		// Circular buffer of recent flux values for the adaptive threshold.
+		std::vector<float> fluxHistory;
+		float fluxHistorySum = 0.0f;
+		float previousFlux = 0.0f;
+		float fluxBeforePrevious = 0.0f;
+		int framesAnalysed = 0;
+
+		juce::int64 samplesProcessed = 0;
+		std::vector<juce::int64> onsets;
+
+		JUCE_DECLARE_NON_COPYABLE(OnsetSegmenter)
+	};
+
+	/*
+	 * createGrainsAtOnsets splits audioData into variable length grains which each start at
+	 * a detected onset, instead of the fixed length chunks of createGrains. Like createGrains
+	 * the grains are views into audioData, so it must outlive them.
+	 *
+	 * The audio is analysed in one pass, a block at a time, exactly as it would be while streaming.
+	 */
+	template <typename SampleType>
+	std::vector<Palette::Grain<SampleType>> createGrainsAtOnsets(const juce::AudioBuffer<SampleType>& audioData, const double sampleRate,
+		const OnsetSegmenter::Parameters& parameters = {})
+	{
+		std::vector<Grain<SampleType>> grains;
+
+		if (audioData.getNumSamples() == 0 || sampleRate <= 0)
+			return grains;
+
+		OnsetSegmenter segmenter(sampleRate, parameters);
+
+		const auto blockSize = 4096;
+		for (auto start = 0; start < audioData.getNumSamples(); start += blockSize)
+			segmenter.process(audioData, start, juce::jmin(blockSize, audioData.getNumSamples() - start));
+
+		segmenter.appendGrains(audioData, sampleRate, grains, 0, true);
+		return grains;
+	}
+}
+
+TEST_CASE("OnsetSegmenter")
+{
+	const auto sampleRate = 44100.0;
+
+	// Silence with a decaying 440hz burst starting at each of burstStarts.
+	const std::vector<int> burstStarts = { 11025, 33075, 55125 };
+	juce::AudioBuffer<float> audio(2, 88200);
+	audio.clear();
+
+	for (const auto burstStart : burstStarts)
+		for (auto i = 0; i < 8000; i++)
+		{
+			const auto sample = std::sin(juce::MathConstants<float>::twoPi * 440.0f * i / (float)sampleRate) * std::exp(-i / 1000.0f);
+			audio.setSample(0, burstStart + i, sample);
+			audio.setSample(1, burstStart + i, sample);
+		}
+
+	SUBCASE("Flux only counts increases in magnitude")
+	{
+		const float current[] = { 1.0f, 0.0f, 3.0f, 1.0f, 2.0f };
+		const float previous[] = { 0.0f, 1.0f, 1.0f, 1.0f, 0.5f };
+		float scratch[5];
+
+		CHECK(Palette::spectralFlux(current, previous, scratch, 5) == doctest::Approx(4.5f));
+	}
+
+	SUBCASE("Each burst starts a grain close to where it begins")
+	{
+		const auto grains = Palette::createGrainsAtOnsets(audio, sampleRate);
+
+		// A leading grain of silence followed by one grain per burst.
+		REQUIRE(grains.size() == burstStarts.size() + 1);
+		CHECK(grains[0].startSample == 0);
+
+		for (size_t i = 0; i < burstStarts.size(); i++)
+			CHECK(std::abs(grains[i + 1].startSample - burstStarts[i]) < 1024);
+	}
+
+	SUBCASE("Grains cover the audio end to end")
+	{
+		const auto grains = Palette::createGrainsAtOnsets(audio, sampleRate);
+
+		auto position = 0;
+		for (const auto& grain : grains)
+		{
+			CHECK(grain.startSample == position);
+			position += grain.getNumSamples();
+		}
+
+		CHECK(position == audio.getNumSamples());
+	}
+
+	SUBCASE("Long gaps are split at maxGrainLength")
+	{
+		Palette::OnsetSegmenter::Parameters parameters;
+		parameters.maxGrainLength = 100.0;
+
+		const auto grains = Palette::createGrainsAtOnsets(audio, sampleRate, parameters);
+
+		for (const auto& grain : grains)
+			CHECK(grain.getNumSamples() <= 4410);
+	}
+}
@@ -0,0 +1,76 @@
+/*
+  ==============================================================================
+
+    ParallelWork.cpp
+    Created: 16 Oct 2026 7:57:03pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#include "ParallelWork.h"
+
+namespace Palette
+{
+	namespace
+	{
+		/*
+		 * Shared between a call and the helper jobs it queues. Helpers may only start once the
+		 * call has returned, so this outlives it, but after closing no helper touches work.
+		 */
+		struct HelperState
+		{
+			juce::CriticalSection lock;
+			bool isClosed = false;
+			int numRunning = 0;
+			juce::WaitableEvent allFinished;
+		};
+	}
+
+	void runOnPool(juce::ThreadPool* pool, const int maxHelpers, const std::function<void()>& work)
+	{
+		const auto numHelpers = pool != nullptr ? juce::jmin(pool->getNumThreads(), maxHelpers) : 0;
+
+		if (numHelpers <= 0)
+		{
+			work();
+			return;
+		}
+
+		const auto state = std::make_shared<HelperState>();
+		const auto* const workToShare = &work;
+
+		for (auto i = 0; i < numHelpers; i++)
+			pool->addJob([state, workToShare]()
+			{
+				{
+					const juce::ScopedLock lock(state->lock);
+
+					if (state->isClosed)
+						return;
+
+					state->numRunning++;
+				}
+
+				(*workToShare)();
+
+				const juce::ScopedLock lock(state->lock);
+
+				if (--state->numRunning == 0 && state->isClosed)
+					state->allFinished.signal();
+			});
+
+		work();
+
+		auto mustWait = false;
+
+		{
+			const juce::ScopedLock lock(state->lock);
+			state->isClosed = true;
+			mustWait = state->numRunning > 0;
+		}
+
+		if (mustWait)
+			state->allFinished.wait();
+	}
+}
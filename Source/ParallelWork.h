@@ -0,0 +1,75 @@
+/*
+  ==============================================================================
+
+    ParallelWork.h
+    Created: 16 Oct 2026 7:57:03pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+namespace Palette
+{
+	/*
+	 * Runs work on the calling thread and on up to maxHelpers threads of pool at once, or just
+	 * the calling thread if pool is nullptr. work is expected to share its tasks out itself,
+	 * usually by claiming chunks from an atomic counter, so it's fine for any one call to
+	 * find nothing left to do.
+	 *
+	 * Returns once work has returned on the calling thread and on every helper which started
+	 * it. Helpers which haven't started by then never run it, so the calling thread never waits
+	 * on a job which is only queued. That keeps this safe to call from a job running on pool
+	 * itself, even when every thread is busy.
+	 */
+	void runOnPool(juce::ThreadPool* pool, int maxHelpers, const std::function<void()>& work);
+}
+
+TEST_CASE("runOnPool")
+{
+	const auto numChunks = 1000;
+
+	std::vector<int> counts(numChunks, 0);
+	std::atomic<int> nextChunk{ 0 };
+
+	const auto countChunks = [&]()
+	{
+		for (auto chunk = nextChunk++; chunk < numChunks; chunk = nextChunk++)
+			counts[static_cast<size_t>(chunk)]++;
+	};
+
+	SUBCASE("Every chunk is done exactly once")
+	{
+		juce::ThreadPool pool(4);
+		Palette::runOnPool(&pool, 4, countChunks);
+
+		CHECK(std::all_of(counts.begin(), counts.end(), [](const int count) { return count == 1; }));
+	}
+
+	SUBCASE("Without a pool the calling thread does it all")
+	{
+		Palette::runOnPool(nullptr, 4, countChunks);
+
+		CHECK(std::all_of(counts.begin(), counts.end(), [](const int count) { return count == 1; }));
+	}
+
+	SUBCASE("Running from a job on a busy pool doesn't wait for helpers which can't start")
+	{
+		juce::ThreadPool pool(1);
+		juce::WaitableEvent finished;
+
+		// The pool's only thread runs this job, so the helper it asks for can't start until it's done.
+		pool.addJob([&]()
+		{
+			Palette::runOnPool(&pool, 1, countChunks);
+			finished.signal();
+		});
+
+		REQUIRE(finished.wait(10000));
+		CHECK(std::all_of(counts.begin(), counts.end(), [](const int count) { return count == 1; }));
+	}
+}
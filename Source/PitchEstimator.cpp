@@ -0,0 +1,147 @@
+/*
+  ==============================================================================
+
+    PitchEstimator.cpp
+    Created: 16 Oct 2026 7:25:48pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#include "PitchEstimator.h"
+
+namespace Palette
+{
+	namespace
+	{
+		Stft::Parameters getStftParameters(const int frameOrder)
+		{
+			Stft::Parameters parameters;
+			parameters.frameOrder = frameOrder;
+			parameters.paddingOrder = 1;
+			parameters.hopSize = 1 << frameOrder;
+			parameters.windowType = WindowType::rectangular;
+			return parameters;
+		}
+	}
+
+	PitchEstimator::PitchEstimator(const double estimatorSampleRate, const int frameOrder, const double minimumPitch, const double maximumPitch)
+		: sampleRate(estimatorSampleRate),
+		  minimumLag(juce::jmax(2, static_cast<int>(estimatorSampleRate / maximumPitch))),
+		  // At least a quarter of the frame always overlaps its delayed copy, so long lags aren't judged on a handful of samples.
+		  maximumLag(juce::jmin((1 << frameOrder) * 3 / 4, static_cast<int>(estimatorSampleRate / minimumPitch))),
+		  overlapEnergy(static_cast<size_t>(maximumLag + 2), 0.0),
+		  prefix(static_cast<size_t>((1 << frameOrder) + 1), 0.0),
+		  difference(static_cast<size_t>(maximumLag + 2), 0.0f)
+	{
+		jassert(minimumLag < maximumLag);
+
+		stft.prepare(getStftParameters(frameOrder));
+		power.resize(static_cast<size_t>(stft.getNumBins()), 0.0f);
+	}
+
+	void PitchEstimator::addFrame(const float* samples) noexcept
+	{
+		const auto frameSize = stft.getFrameSize();
+		juce::FloatVectorOperations::copy(stft.getFrame(numPending++), samples, frameSize);
+
+		for (auto i = 0; i < frameSize; i++)
+			prefix[static_cast<size_t>(i + 1)] = prefix[static_cast<size_t>(i)] + static_cast<double>(samples[i]) * samples[i];
+
+		// The energy of the samples overlapping their delayed copy: x[0, frameSize - lag) and x[lag, frameSize).
+		const auto total = prefix[static_cast<size_t>(frameSize)];
+
+		for (auto lag = 0; lag <= maximumLag + 1; lag++)
+			overlapEnergy[static_cast<size_t>(lag)] += prefix[static_cast<size_t>(frameSize - lag)] + total - prefix[static_cast<size_t>(lag)];
+
+		if (numPending == stft.getMaxBatchSize())
+			accumulatePending();
+	}
+
+	void PitchEstimator::accumulatePending() noexcept
+	{
+		if (numPending == 0)
+			return;
+
+		stft.transform(numPending);
+
+		for (auto frame = 0; frame < numPending; frame++)
+			juce::FloatVectorOperations::add(power.data(), stft.getSpectrum(frame), stft.getNumBins());
+
+		numFrames += numPending;
+		numPending = 0;
+	}
+
+	PitchEstimator::Estimate PitchEstimator::estimate() noexcept
+	{
+		accumulatePending();
+
+		Estimate result;
+		const auto frameSize = stft.getFrameSize();
+
+		// Quieter than this isn't worth calling pitched.
+		const auto isAudible = numFrames > 0 && overlapEnergy[0] / (2.0 * numFrames) > 1.0e-9;
+
+		if (isAudible)
+		{
+			const auto* autocorrelation = stft.autocorrelate(power.data());
+
+			/*
+			 * The difference function, divided by how many samples overlap at each lag so
+			 * longer lags aren't favoured just for summing fewer differences. Then the cumulative
+			 * mean normalised difference, which starts at 1 and only dips near the period.
+			 */
+			auto runningSum = 0.0;
+
+			for (auto lag = 1; lag <= maximumLag + 1; lag++)
+			{
+				const auto squaredDifference = overlapEnergy[static_cast<size_t>(lag)] - 2.0 * autocorrelation[lag];
+				const auto meanSquaredDifference = juce::jmax(0.0, squaredDifference) / (frameSize - lag);
+
+				runningSum += meanSquaredDifference;
+				difference[static_cast<size_t>(lag)] = runningSum > 0.0 ? static_cast<float>(meanSquaredDifference * lag / runningSum) : 1.0f;
+			}
+
+			// The first dip below the threshold, followed down to its bottom, is the period.
+			auto period = -1;
+
+			for (auto lag = minimumLag; lag <= maximumLag; lag++)
+			{
+				if (difference[static_cast<size_t>(lag)] < threshold)
+				{
+					while (lag < maximumLag && difference[static_cast<size_t>(lag + 1)] < difference[static_cast<size_t>(lag)])
+						lag++;
+
+					period = lag;
+					break;
+				}
+			}
+
+			if (period < 0)
+			{
+				// Nothing periodic enough for a pitch, but the best match still says how close it came.
+				const auto best = *std::min_element(difference.begin() + minimumLag, difference.begin() + maximumLag + 1);
+				result.confidence = juce::jlimit(0.0f, 1.0f, 1.0f - best);
+			}
+			else
+			{
+				// Parabolic interpolation between the neighbouring lags for sub-sample accuracy.
+				const auto left = difference[static_cast<size_t>(period - 1)];
+				const auto centre = difference[static_cast<size_t>(period)];
+				const auto right = difference[static_cast<size_t>(period + 1)];
+				const auto denominator = left - 2.0f * centre + right;
+				const auto offset = denominator > 0.0f ? juce::jlimit(-0.5f, 0.5f, 0.5f * (left - right) / denominator) : 0.0f;
+
+				const auto frequency = sampleRate / (period + offset);
+				result.pitch = static_cast<float>(69.0 + 12.0 * std::log2(frequency / 440.0));
+				result.confidence = juce::jlimit(0.0f, 1.0f, 1.0f - centre);
+			}
+		}
+
+		juce::FloatVectorOperations::clear(power.data(), stft.getNumBins());
+		std::fill(overlapEnergy.begin(), overlapEnergy.end(), 0.0);
+		numFrames = 0;
+
+		return result;
+	}
+}
@@ -0,0 +1,171 @@
+/*
+  ==============================================================================
+
+    PitchEstimator.h
+    Created: 16 Oct 2026 7:25:48pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+#include "Stft.h"
+
+namespace Palette
+{
+	/*
+	 * PitchEstimator finds the fundamental frequency of monophonic audio with YIN
+	 * (de Cheveigné and Kawahara, 2002), and how confident it is there is one.
+	 *
+	 * YIN looks for the lag at which the signal best matches itself, using the squared
+	 * difference between the signal and a delayed copy. Summed directly that costs
+	 * O(frameSize^2) per frame, so here it is built from parts an FFT gives cheaply:
+	 *
+	 *     d(lag) = sum of x[j]^2 over the overlap      (prefix sums of x^2)
+	 *            + sum of x[j + lag]^2 over the overlap (prefix sums of x^2)
+	 *            - 2 * autocorrelation(lag)             (inverse FFT of the power spectrum)
+	 *
+	 * Frames are transformed without a window and zero padded to twice their length, so the
+	 * autocorrelation doesn't wrap around. Every frame added before estimate() is averaged into
+	 * one difference function, so a whole grain gets one estimate. The cost per frame is fixed,
+	 * which keeps it bounded on the audio thread.
+	 *
+	 * Everything is allocated in the constructor. Not thread safe, so use one per thread.
+	 */
+	class PitchEstimator
+	{
+	public:
+		struct Estimate
+		{
+			// The fundamental as a (fractional) midi note number, or 0 if there isn't one.
+			float pitch = 0.0f;
+			// From 0 for aperiodic sound to 1 for a perfectly periodic one.
+			float confidence = 0.0f;
+		};
+
+		PitchEstimator(double sampleRate, int frameOrder, double minimumPitch, double maximumPitch);
+
+		// Adds a frame of 2^frameOrder samples to the next estimate.
+		void addFrame(const float* samples) noexcept;
+
+		// Estimates the pitch of every frame added since the last estimate, and starts over.
+		Estimate estimate() noexcept;
+
+		/*
+		 * The cumulative mean normalised difference a lag must dip below to be taken as the
+		 * period. Lower is stricter.
+		 */
+		static constexpr float threshold = 0.15f;
+
+	private:
+		// Transforms the frames waiting in the Stft's batch and adds them to the running sums.
+		void accumulatePending() noexcept;
+
+		const double sampleRate;
+		Stft stft;
+
+		const int minimumLag;
+		const int maximumLag;
+
+		// The power spectra and overlap energies of the frames so far, summed.
+		std::vector<float> power;
+		std::vector<double> overlapEnergy;
+		int numFrames = 0;
+		int numPending = 0;
+
+		// Scratch for prefix sums of x^2, then the difference function.
+		std::vector<double> prefix;
+		std::vector<float> difference;
+
+		JUCE_DECLARE_NON_COPYABLE(PitchEstimator)
+	};
+}
+
+TEST_CASE("PitchEstimator")
+{
+	const auto sampleRate = 44100.0;
+	const auto frameSize = 1024;
+
+	Palette::PitchEstimator estimator(sampleRate, 10, 50.0, 2000.0);
+	std::vector<float> frame(static_cast<size_t>(frameSize));
+
+	const auto addTone = [&](const double frequency, const int numFrames, const bool withHarmonics) {
+		for (auto f = 0; f < numFrames; f++)
+		{
+			for (auto i = 0; i < frameSize; i++)
+			{
+				const auto phase = juce::MathConstants<double>::twoPi * frequency * (f * frameSize + i) / sampleRate;
+				auto sample = std::sin(phase);
+
+				if (withHarmonics)
+					sample += 0.6 * std::sin(2.0 * phase) + 0.4 * std::sin(3.0 * phase);
+
+				frame[static_cast<size_t>(i)] = static_cast<float>(0.3 * sample);
+			}
+
+			estimator.addFrame(frame.data());
+		}
+	};
+
+	SUBCASE("Pure and harmonic tones are found to within a few cents")
+	{
+		for (const auto frequency : { 82.41, 220.0, 440.0, 1046.5 })
+		{
+			const auto expected = static_cast<float>(69.0 + 12.0 * std::log2(frequency / 440.0));
+
+			addTone(frequency, 3, false);
+			const auto pure = estimator.estimate();
+			CHECK(pure.pitch == doctest::Approx(expected).epsilon(0.0005));
+			CHECK(pure.confidence > 0.9f);
+
+			addTone(frequency, 3, true);
+			const auto harmonic = estimator.estimate();
+			CHECK(harmonic.pitch == doctest::Approx(expected).epsilon(0.0005));
+			CHECK(harmonic.confidence > 0.9f);
+		}
+	}
+
+	SUBCASE("Noise has no pitch and little confidence")
+	{
+		juce::Random random(7);
+
+		for (auto f = 0; f < 4; f++)
+		{
+			for (auto& sample : frame)
+				sample = random.nextFloat() - 0.5f;
+
+			estimator.addFrame(frame.data());
+		}
+
+		const auto noise = estimator.estimate();
+		CHECK(noise.pitch == 0.0f);
+		CHECK(noise.confidence < 0.5f);
+	}
+
+	SUBCASE("Silence, or nothing at all, has no pitch")
+	{
+		std::fill(frame.begin(), frame.end(), 0.0f);
+		estimator.addFrame(frame.data());
+
+		const auto silence = estimator.estimate();
+		CHECK(silence.pitch == 0.0f);
+		CHECK(silence.confidence == 0.0f);
+
+		const auto nothing = estimator.estimate();
+		CHECK(nothing.pitch == 0.0f);
+		CHECK(nothing.confidence == 0.0f);
+	}
+
+	SUBCASE("Each estimate only hears the frames added since the last")
+	{
+		addTone(220.0, 2, false);
+		estimator.estimate();
+
+		addTone(440.0, 2, false);
+		CHECK(estimator.estimate().pitch == doctest::Approx(69.0f).epsilon(0.0005));
+	}
+}
@@ -9,8 +9,12 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
-#define DOCTEST_CONFIG_IMPLEMENT
-#include "doctest.h"
+namespace
+{
+    // Identifies state saved by getStateInformation(), and which layout it has.
+    constexpr int stateMagic = 0x506c7453; // "PltS"
+    constexpr int stateVersion = 3;
+}
 
 //==============================================================================
 PaletteAudioProcessor::PaletteAudioProcessor()
@@ -25,6 +29,19 @@ PaletteAudioProcessor::PaletteAudioProcessor()
                        )
 #endif
 {
+    addParameter (grainInterval = new juce::AudioParameterFloat ("interval", "Grain Interval", 5.0f, 1000.0f, 50.0f));
+    addParameter (grainGain = new juce::AudioParameterFloat ("gain", "Grain Gain", 0.0f, 1.0f, 0.5f));
+    addParameter (followInput = new juce::AudioParameterBool ("follow", "Follow Input", true));
+
+    // How much each group of descriptors counts when matching grains to the input.
+    addParameter (loudnessWeight = new juce::AudioParameterFloat ("loudnessWeight", "Loudness Weight", 0.0f, 4.0f, 1.0f));
+    addParameter (brightnessWeight = new juce::AudioParameterFloat ("brightnessWeight", "Brightness Weight", 0.0f, 4.0f, 1.0f));
+    addParameter (pitchWeight = new juce::AudioParameterFloat ("pitchWeight", "Pitch Weight", 0.0f, 4.0f, 1.0f));
+    addParameter (timbreWeight = new juce::AudioParameterFloat ("timbreWeight", "Timbre Weight", 0.0f, 4.0f, 1.0f));
+
+    loaderOptions.cacheDirectory = juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
+                                       .getChildFile ("Palette")
+                                       .getChildFile ("Corpus Cache");
 }
 
 PaletteAudioProcessor::~PaletteAudioProcessor()
@@ -96,14 +113,34 @@ void PaletteAudioProcessor::changeProgramName (int index, const juce::String& ne
 //==============================================================================
 void PaletteAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    // Use this method as the place to do any pre-playback
-    // initialisation that you need..
+    // Everything the audio thread needs is allocated here, so processBlock never has to.
+    scheduler.prepare (maxVoices, samplesPerBlock);
+    scheduler.setGain (grainGain->get());
+    scheduler.reset();
+
+    nextGrain = 0;
+    samplesUntilNextGrain = 0;
+
+    // Input is analysed in frames as long as the corpus grains, so they're described alike.
+    const auto frameLength = juce::jmax (1, juce::roundToInt (loaderOptions.grainLength * sampleRate / 1000.0));
+    const auto hopLength = juce::jlimit (1, frameLength, juce::roundToInt (analysisHopLength * sampleRate / 1000.0));
+
+    inputAnalyser.prepare (sampleRate, getTotalNumInputChannels(), frameLength, hopLength);
+    setLatencySamples (inputAnalyser.getLatencySamples());
+
+    ConcatenativeSynthesizer::PathParameters pathParameters;
+    pathParameters.windowLength = 1;
+    matchLattice.prepare (pathParameters, Palette::numDescriptors);
+    lastMatchedGrain = -1;
+
+    corpora.startPlayback();
 }
 
 void PaletteAudioProcessor::releaseResources()
 {
-    // When playback stops, you can use this as an opportunity to free up any
-    // spare memory, etc.
+    scheduler.reset();
+    inputAnalyser.reset();
+    corpora.stopPlayback();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -133,30 +170,128 @@ bool PaletteAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts)
 void PaletteAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
     juce::ScopedNoDenormals noDenormals;
-    auto totalNumInputChannels  = getTotalNumInputChannels();
-    auto totalNumOutputChannels = getTotalNumOutputChannels();
-
-    // In case we have more outputs than inputs, this code clears any output
-    // channels that didn't contain input data, (because these aren't
-    // guaranteed to be empty - they may contain garbage).
-    // This is here to avoid people getting screaming feedback
-    // when they first compile a plugin, but obviously you don't need to keep
-    // this code if your algorithm always overwrites all the output channels.
-    for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
-        buffer.clear (i, 0, buffer.getNumSamples());
-
-    // This is the place where you'd normally do the guts of your plugin's
-    // audio processing...
-    // Make sure to reset the state if your inner loop is processing
-    // the samples and the outer loop is handling the channels.
-    // Alternatively, you can process the samples with the channels
-    // interleaved by keeping the same state.
-    for (int channel = 0; channel < totalNumInputChannels; ++channel)
+    const auto numSamples = buffer.getNumSamples();
+
+    const auto* version = corpora.acquire();
+
+    // Grains follow the input once there are descriptors to choose them by, and until then play in order.
+    const auto following = followInput->get() && version != nullptr && version->corpus != nullptr
+                        && version->corpus->getSelection().getNumGrains() > 0;
+
+    if (following)
+        updateSelectionWeights (version->corpus->getSelection());
+
+    // The input is analysed even when it isn't followed, so following it starts from a full frame.
+    inputAnalyser.process (buffer, numSamples, [this, version, following] (int offset, const Palette::GrainAnalyser::DescriptorVector& input)
     {
-        auto* channelData = buffer.getWritePointer (channel);
+        if (following)
+            startMatchingGrain (*version, offset, input);
+    });
+
+    // The output is made entirely of grains, so the input is replaced rather than mixed with.
+    buffer.clear();
+
+    scheduler.setGain (grainGain->get());
+
+    if (version != nullptr && ! following)
+        scheduleGrains (*version, numSamples);
+
+    scheduler.renderNextBlock (buffer, 0, numSamples);
+
+    // Let corpora older than any grain still playing be freed. Until a corpus has been acquired
+    // nothing may be, as the first one published could be picked up during the next block.
+    corpora.releaseOlderThan (scheduler.getOldestGeneration (version != nullptr ? version->generation : 0));
+}
 
-        // ..do something to the data...
+void PaletteAudioProcessor::scheduleGrains (const Palette::CorpusExchange::Version& version, int numSamples) noexcept
+{
+    // Publishing nullptr clears the corpus.
+    if (version.corpus == nullptr || version.corpus->getGrains().empty())
+    {
+        samplesUntilNextGrain = juce::jmax (0, samplesUntilNextGrain - numSamples);
+        return;
+    }
+
+    // Carry on from the same place in a new corpus, so snapshots of one still loading play smoothly.
+    const auto& grains = version.corpus->getGrains();
+    nextGrain %= grains.size();
+
+    const auto interval = juce::jmax (1, juce::roundToInt (grainInterval->get() * getSampleRate() / 1000.0));
+
+    while (samplesUntilNextGrain < numSamples)
+    {
+        scheduler.startGrain (grains[nextGrain], samplesUntilNextGrain, 1.0f, version.generation);
+
+        nextGrain = (nextGrain + 1) % grains.size();
+        samplesUntilNextGrain += interval;
     }
+
+    samplesUntilNextGrain -= numSamples;
+}
+
+void PaletteAudioProcessor::startMatchingGrain (const Palette::CorpusExchange::Version& version, int offset,
+                                                const Palette::GrainAnalyser::DescriptorVector& input) noexcept
+{
+    const auto rms = (size_t) Palette::Descriptor::rms;
+
+    if (input[rms] < inputSilenceLevel)
+    {
+        lastMatchedGrain = -1;
+        return;
+    }
+
+    // Grain numbers from an older corpus mean nothing in this one.
+    const auto previousGrain = version.generation == lastMatchedGeneration ? lastMatchedGrain : -1;
+
+    const auto& corpus = *version.corpus;
+    auto grain = -1;
+
+    if (corpus.getSelection().selectPath (input.data(), 1, previousGrain, matchLattice, &grain, selectionWeights.data()) == 0)
+        return;
+
+    lastMatchedGrain = grain;
+    lastMatchedGeneration = version.generation;
+
+    const auto grainLevel = corpus.getDescriptors().getValue ((size_t) grain, (int) rms);
+    const auto gain = grainLevel > 0.0f ? juce::jmin (maximumMatchGain, input[rms] / grainLevel) : 0.0f;
+
+    scheduler.startGrain (corpus.getGrains()[(size_t) grain], offset, gain, version.generation);
+}
+
+void PaletteAudioProcessor::updateSelectionWeights (const ConcatenativeSynthesizer& selection) noexcept
+{
+    // A group's weight is shared between its descriptors, so the thirteen of timbre don't drown out loudness.
+    const auto setGroupWeight = [this] (Palette::Descriptor first, int size, float weight)
+    {
+        for (auto i = 0; i < size; ++i)
+            descriptorWeights[(size_t) first + (size_t) i] = weight / (float) size;
+    };
+
+    setGroupWeight (Palette::Descriptor::rms, 1, loudnessWeight->get());
+    setGroupWeight (Palette::Descriptor::spectralCentroid, 3, brightnessWeight->get());
+    setGroupWeight (Palette::Descriptor::pitch, 2, pitchWeight->get());
+    setGroupWeight (Palette::Descriptor::mfcc, Palette::numMfccs, timbreWeight->get());
+
+    selection.getSelectionWeights (descriptorWeights.data(), selectionWeights.data());
+}
+
+void PaletteAudioProcessor::setCorpus (std::shared_ptr<const Palette::Corpus<float>> newCorpus)
+{
+    loader.cancel();
+    corpora.publish (std::move (newCorpus));
+}
+
+bool PaletteAudioProcessor::loadCorpus (const juce::File& file)
+{
+    return loader.load (file, loaderOptions, getLoaderCallback());
+}
+
+Palette::CorpusLoader::Callback PaletteAudioProcessor::getLoaderCallback()
+{
+    return [this] (std::shared_ptr<const Palette::Corpus<float>> corpus, bool)
+    {
+        corpora.publish (std::move (corpus));
+    };
 }
 
 //==============================================================================
@@ -173,40 +308,71 @@ juce::AudioProcessorEditor* PaletteAudioProcessor::createEditor()
 //==============================================================================
 void PaletteAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    // The corpus is saved as where it came from and the key it's cached under, never its audio,
+    // so saving is quick and the state stays a few dozen bytes.
+    const auto source = loader.getSource();
+
+    juce::MemoryOutputStream stream (destData, false);
+    stream.writeInt (stateMagic);
+    stream.writeInt (stateVersion);
+    stream.writeFloat (grainInterval->get());
+    stream.writeFloat (grainGain->get());
+    stream.writeBool (followInput->get());
+    stream.writeFloat (loudnessWeight->get());
+    stream.writeFloat (brightnessWeight->get());
+    stream.writeFloat (pitchWeight->get());
+    stream.writeFloat (timbreWeight->get());
+    stream.writeString (source.file.getFullPathName());
+    stream.writeInt64 ((juce::int64) source.key.source);
+    stream.writeInt64 ((juce::int64) source.key.settings);
 }
 
 void PaletteAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
-}
+    juce::MemoryInputStream stream (data, (size_t) sizeInBytes, false);
 
-/*
- * Boilerplate function which contains any necessary code to bootstrap testing.
- */
-int runTests()
-{
-    doctest::Context context;
+    if (sizeInBytes < 2 * (int) sizeof (int) || stream.readInt() != stateMagic)
+        return;
+
+    const auto version = stream.readInt();
 
-    int res = context.run(); // run
+    if (version < 1 || version > stateVersion)
+        return;
 
-    // important - query flags (and --exit) rely on the user doing this
-    if (context.shouldExit())
-        // propagate the result of the tests
-        return res;
+    // Parameters are restored straight away, but the corpus is reattached in the background
+    // so the host isn't held up loading a session.
+    *grainInterval = stream.readFloat();
+    *grainGain = stream.readFloat();
 
-    return res;
+    // Sessions from before grains could follow the input didn't follow it.
+    *followInput = version >= 2 ? stream.readBool() : false;
+
+    // Nor could they weight the descriptors, so every one counted alike.
+    *loudnessWeight = version >= 3 ? stream.readFloat() : 1.0f;
+    *brightnessWeight = version >= 3 ? stream.readFloat() : 1.0f;
+    *pitchWeight = version >= 3 ? stream.readFloat() : 1.0f;
+    *timbreWeight = version >= 3 ? stream.readFloat() : 1.0f;
+
+    const auto path = stream.readString();
+
+    Palette::CorpusLoader::Source source;
+    source.key.source = (juce::uint64) stream.readInt64();
+    source.key.settings = (juce::uint64) stream.readInt64();
+
+    if (! juce::File::isAbsolutePath (path))
+    {
+        setCorpus (nullptr);
+        return;
+    }
+
+    source.file = juce::File (path);
+    loader.restore (source, loaderOptions, getLoaderCallback());
 }
 
 //==============================================================================
 // This creates new instances of the plugin..
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
 {
-    runTests();
-
     return new PaletteAudioProcessor();
 }
 
@@ -11,6 +11,13 @@
 #include "JuceHeader.h"
 
 #include "Grain.h"
+#include "Corpus.h"
+#include "OnsetSegmenter.h"
+#include "Descriptors.h"
+#include "GrainScheduler.h"
+#include "CorpusExchange.h"
+#include "CorpusLoader.h"
+#include "LiveAnalyser.h"
 
 //==============================================================================
 /**
@@ -57,7 +64,88 @@ public:
 
 	bool keyPressed(const juce::KeyPress& key, juce::Component* originatingComponent) override;
 
+    /*
+     * Replaces the corpus grains are played from, abandoning any corpus still loading. Grains already playing
+     * from the old corpus carry on until they finish, and nullptr stops new grains. Safe to call from any thread
+     * except the audio thread, and never blocks playback.
+     */
+    void setCorpus (std::shared_ptr<const Palette::Corpus<float>> newCorpus);
+
+    /*
+     * Starts loading file as the corpus in the background. Grains start playing from it as soon
+     * as the first of them are decoded. Returns false if the file can't be read.
+     *
+     * Loaded corpora are cached, so loading the same file again, or restoring a session which
+     * uses it, skips segmenting and analysing it.
+     */
+    bool loadCorpus (const juce::File& file);
+
 private:
-    //==============================================================================    
+    //==============================================================================
+    // Starts every grain due to begin within the next numSamples samples on its exact sample.
+    void scheduleGrains (const Palette::CorpusExchange::Version& version, int numSamples) noexcept;
+
+    /*
+     * Starts a grain matching a frame of input, offset samples into the block, scaled to the
+     * input's loudness. Grains are chosen as a one frame path on from the last grain matched,
+     * so they carry on through the corpus where they can. Nothing is started for silent input.
+     */
+    void startMatchingGrain (const Palette::CorpusExchange::Version& version, int offset,
+                             const Palette::GrainAnalyser::DescriptorVector& input) noexcept;
+
+    /*
+     * Turns the weight parameters into weights for selection from the corpus, once a block,
+     * so they can be automated without rebuilding its index. They weigh the join from the
+     * last grain matched just as they weigh the match to the input.
+     */
+    void updateSelectionWeights (const ConcatenativeSynthesizer& selection) noexcept;
+
+    // Hands corpora from the loader to the audio thread.
+    Palette::CorpusLoader::Callback getLoaderCallback();
+
+    // The most grains that can play at once. Grains started beyond this are dropped.
+    static constexpr int maxVoices = 256;
+
+    // Miliseconds between frames of input analysed. This is the latency reported to the host.
+    static constexpr double analysisHopLength = 25.0;
+    // Input quieter than this (as rms) isn't answered with grains.
+    static constexpr float inputSilenceLevel = 1.0e-4f;
+    // The most a grain is boosted to match the loudness of the input.
+    static constexpr float maximumMatchGain = 4.0f;
+
+    juce::AudioParameterFloat* grainInterval;
+    juce::AudioParameterFloat* grainGain;
+    juce::AudioParameterBool* followInput;
+    juce::AudioParameterFloat* loudnessWeight;
+    juce::AudioParameterFloat* brightnessWeight;
+    juce::AudioParameterFloat* pitchWeight;
+    juce::AudioParameterFloat* timbreWeight;
+
+    Palette::GrainScheduler scheduler;
+    Palette::LiveAnalyser inputAnalyser;
+
+    /*
+     * Live input has no future frames to look ahead to, so each frame is its own window. The
+     * lattice only ever holds one column, which keeps the cost per frame small and fixed.
+     */
+    ConcatenativeSynthesizer::PathLattice matchLattice;
+    // The last grain matched to the input, and the generation of the corpus it's from, or -1 after silence.
+    int lastMatchedGrain = -1;
+    juce::uint64 lastMatchedGeneration = 0;
+
+    // How much each descriptor counts, from the weight parameters, and those combined with the corpus's standard weights.
+    std::array<float, Palette::numDescriptors> descriptorWeights {};
+    std::array<float, Palette::numDescriptors> selectionWeights {};
+
+    Palette::CorpusExchange corpora;
+    // Declared after corpora, so it stops before there's nowhere to hand corpora to.
+    Palette::CorpusLoader loader;
+    Palette::CorpusLoader::Options loaderOptions;
+
+    // Grains are played in order, and this is the next one.
+    size_t nextGrain = 0;
+    // How far into the next block the next grain starts.
+    int samplesUntilNextGrain = 0;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PaletteAudioProcessor)
 };
@@ -0,0 +1,120 @@
+/*
+  ==============================================================================
+
+    Stft.cpp
+    Created: 16 Oct 2026 7:14:59pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#include "Stft.h"
+
+namespace Palette
+{
+	namespace
+	{
+		// Buffers start this many floats apart: a 64 byte cache line, which suits any SIMD width.
+		constexpr size_t alignment = 16;
+
+		constexpr size_t alignUp(const size_t numFloats) noexcept
+		{
+			return (numFloats + alignment - 1) / alignment * alignment;
+		}
+	}
+
+	void Stft::prepare(const Parameters& newParameters)
+	{
+		jassert(newParameters.frameOrder > 0 && newParameters.paddingOrder >= 0 && newParameters.maxBatchSize > 0);
+		jassert(newParameters.hopSize > 0 && newParameters.hopSize <= (1 << newParameters.frameOrder));
+
+		parameters = newParameters;
+		frameSize = 1 << parameters.frameOrder;
+		fftSize = frameSize << parameters.paddingOrder;
+		numBins = fftSize / 2 + 1;
+
+		fft = std::make_unique<juce::dsp::FFT>(parameters.frameOrder + parameters.paddingOrder);
+		window = getWindowTable<float>(parameters.windowType, frameSize);
+
+		frameStride = alignUp(static_cast<size_t>(frameSize));
+		spectrumStride = alignUp(static_cast<size_t>(numBins));
+
+		const auto historySize = alignUp(static_cast<size_t>(frameSize));
+		const auto framesSize = frameStride * static_cast<size_t>(parameters.maxBatchSize);
+		const auto workspaceSize = alignUp(static_cast<size_t>(fftSize) * 2);
+		const auto spectraSize = spectrumStride * static_cast<size_t>(parameters.maxBatchSize);
+
+		// Room to slide the first buffer up to a cache line boundary.
+		storage.assign(historySize + framesSize + workspaceSize + spectraSize + alignment, 0.0f);
+
+		const auto misalignment = reinterpret_cast<std::uintptr_t>(storage.data()) % (alignment * sizeof(float));
+		auto* next = storage.data() + (misalignment == 0 ? 0 : (alignment * sizeof(float) - misalignment) / sizeof(float));
+
+		history = next;
+		next += historySize;
+		frames = next;
+		next += framesSize;
+		workspace = next;
+		next += workspaceSize;
+		spectra = next;
+
+		reset();
+	}
+
+	void Stft::reset() noexcept
+	{
+		historyLength = 0;
+	}
+
+	void Stft::transform(const int numFrames) noexcept
+	{
+		jassert(numFrames <= parameters.maxBatchSize);
+
+		for (auto frame = 0; frame < numFrames; frame++)
+		{
+			const auto* samples = getFrame(frame);
+
+			if (window != nullptr)
+				juce::FloatVectorOperations::multiply(workspace, samples, window, frameSize);
+			else
+				juce::FloatVectorOperations::copy(workspace, samples, frameSize);
+
+			juce::FloatVectorOperations::clear(workspace + frameSize, fftSize * 2 - frameSize);
+			fft->performRealOnlyForwardTransform(workspace, true);
+
+			// The bins are interleaved real and imaginary parts.
+			auto* spectrum = spectra + static_cast<size_t>(frame) * spectrumStride;
+
+			for (auto bin = 0; bin < numBins; bin++)
+			{
+				const auto re = workspace[bin * 2];
+				const auto im = workspace[bin * 2 + 1];
+				spectrum[bin] = re * re + im * im;
+			}
+		}
+
+		if (parameters.spectrum == Spectrum::magnitude)
+			for (auto frame = 0; frame < numFrames; frame++)
+			{
+				auto* spectrum = spectra + static_cast<size_t>(frame) * spectrumStride;
+
+				for (auto bin = 0; bin < numBins; bin++)
+					spectrum[bin] = std::sqrt(spectrum[bin]);
+			}
+	}
+
+	const float* Stft::autocorrelate(const float* power) noexcept
+	{
+		for (auto bin = 0; bin < fftSize; bin++)
+		{
+			// The power spectrum of a real signal is symmetric, so mirror it for the upper half.
+			const auto mirroredBin = bin < numBins ? bin : fftSize - bin;
+			workspace[bin * 2] = power[mirroredBin];
+			workspace[bin * 2 + 1] = 0.0f;
+		}
+
+		fft->performRealOnlyInverseTransform(workspace);
+
+		return workspace;
+	}
+}
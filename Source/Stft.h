@@ -0,0 +1,289 @@
+/*
+  ==============================================================================
+
+    Stft.h
+    Created: 16 Oct 2026 7:14:59pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+#include "Window.h"
+
+namespace Palette
+{
+	/*
+	 * Stft turns audio into short-time spectra without allocating once it's prepared.
+	 *
+	 * Frames of 2^frameOrder samples are windowed, zero padded to 2^paddingOrder times their
+	 * length and transformed into spectra of getNumBins() bins, from DC to Nyquist. Frames can
+	 * be written directly and transformed a batch at a time (getFrame() and transform()), or
+	 * pushed as a stream of samples which is cut into a frame every hopSize samples.
+	 *
+	 * Every buffer lives in the one allocation prepare() makes, each starting on its own cache
+	 * line. juce::dsp::FFT only transforms one frame per call, so a batch is transformed back to
+	 * back while its plan is warm in cache, then turned into spectra in one pass.
+	 *
+	 * An Stft is not thread safe, so use one per thread.
+	 */
+	class Stft
+	{
+	public:
+		enum class Spectrum
+		{
+			power,
+			magnitude
+		};
+
+		struct Parameters
+		{
+			// Each frame is 2^frameOrder samples.
+			int frameOrder = 10;
+			// Frames are zero padded to 2^paddingOrder times their length before the FFT.
+			int paddingOrder = 0;
+			// Samples between the starts of consecutive frames pushed.
+			int hopSize = 256;
+			WindowType windowType = WindowType::hann;
+			// What each bin of a spectrum holds.
+			Spectrum spectrum = Spectrum::power;
+			// The most frames transformed at once.
+			int maxBatchSize = 8;
+		};
+
+		Stft() = default;
+
+		// Allocates everything for transforming frames with parameters. Not real time safe.
+		void prepare(const Parameters& newParameters);
+
+		// Forgets any pushed samples which haven't made a whole frame yet.
+		void reset() noexcept;
+
+		int getFrameSize() const noexcept { return frameSize; }
+		int getFftSize() const noexcept { return fftSize; }
+		int getNumBins() const noexcept { return numBins; }
+		int getHopSize() const noexcept { return parameters.hopSize; }
+		int getMaxBatchSize() const noexcept { return parameters.maxBatchSize; }
+
+		// Where to write the getFrameSize() samples of frame index of the next batch.
+		float* getFrame(const int index) noexcept
+		{
+			jassert(juce::isPositiveAndBelow(index, parameters.maxBatchSize));
+			return frames + static_cast<size_t>(index) * frameStride;
+		}
+
+		// Windows and transforms the first numFrames frames of the batch.
+		void transform(int numFrames) noexcept;
+
+		// The spectrum of frame index of the last batch transformed.
+		const float* getSpectrum(const int index) const noexcept
+		{
+			jassert(juce::isPositiveAndBelow(index, parameters.maxBatchSize));
+			return spectra + static_cast<size_t>(index) * spectrumStride;
+		}
+
+		/*
+		 * Adds numSamples more samples of a stream. Every hopSize samples, once a whole frame
+		 * has arrived, onFrame is called with that frame's spectrum, in order. Frames completed
+		 * by one call are transformed in batches, so they're all reported before it returns.
+		 */
+		template <typename Callback>
+		void push(const float* samples, const int numSamples, Callback&& onFrame) noexcept
+		{
+			auto numPending = 0;
+
+			for (auto position = 0; position < numSamples;)
+			{
+				const auto numToCopy = juce::jmin(numSamples - position, frameSize - historyLength);
+				juce::FloatVectorOperations::copy(history + historyLength, samples + position, numToCopy);
+				historyLength += numToCopy;
+				position += numToCopy;
+
+				if (historyLength < frameSize)
+					break;
+
+				juce::FloatVectorOperations::copy(getFrame(numPending++), history, frameSize);
+
+				// Keep the overlapping part of the frame for the next one.
+				std::memmove(history, history + parameters.hopSize, sizeof(float) * static_cast<size_t>(frameSize - parameters.hopSize));
+				historyLength = frameSize - parameters.hopSize;
+
+				if (numPending == parameters.maxBatchSize)
+				{
+					transformAndReport(numPending, onFrame);
+					numPending = 0;
+				}
+			}
+
+			transformAndReport(numPending, onFrame);
+		}
+
+		/*
+		 * By Wiener-Khinchin the inverse FFT of a power spectrum is the autocorrelation of the
+		 * signal it came from. Returns getFftSize() lags, starting at 0. With paddingOrder of at
+		 * least 1 the first getFrameSize() lags are free of circular wrap-around.
+		 */
+		const float* autocorrelate(const float* power) noexcept;
+
+	private:
+		template <typename Callback>
+		void transformAndReport(const int numFrames, Callback& onFrame) noexcept
+		{
+			if (numFrames == 0)
+				return;
+
+			transform(numFrames);
+
+			for (auto frame = 0; frame < numFrames; frame++)
+				onFrame(getSpectrum(frame));
+		}
+
+		Parameters parameters;
+		int frameSize = 0;
+		int fftSize = 0;
+		int numBins = 0;
+
+		std::unique_ptr<juce::dsp::FFT> fft;
+		const float* window = nullptr;
+
+		// Backs every buffer below.
+		std::vector<float> storage;
+
+		// The last samples pushed, and how many of them there are.
+		float* history = nullptr;
+		int historyLength = 0;
+
+		float* frames = nullptr;
+		size_t frameStride = 0;
+
+		// The FFT's in place working space, 2 * fftSize floats.
+		float* workspace = nullptr;
+
+		float* spectra = nullptr;
+		size_t spectrumStride = 0;
+
+		JUCE_DECLARE_NON_COPYABLE(Stft)
+	};
+}
+
+TEST_CASE("Stft")
+{
+	const auto sampleRate = 8192.0;
+
+	Palette::Stft::Parameters parameters;
+	parameters.frameOrder = 8;
+	parameters.hopSize = 64;
+	parameters.maxBatchSize = 3;
+
+	// A sine exactly on bin 16 of a 256 point frame.
+	std::vector<float> sine(2048);
+	for (size_t i = 0; i < sine.size(); i++)
+		sine[i] = static_cast<float>(std::sin(juce::MathConstants<double>::twoPi * 512.0 * static_cast<double>(i) / sampleRate));
+
+	Palette::Stft stft;
+	stft.prepare(parameters);
+
+	REQUIRE(stft.getFrameSize() == 256);
+	REQUIRE(stft.getFftSize() == 256);
+	REQUIRE(stft.getNumBins() == 129);
+
+	SUBCASE("A sine's power peaks in its bin")
+	{
+		std::copy_n(sine.data(), stft.getFrameSize(), stft.getFrame(0));
+		stft.transform(1);
+
+		const auto* power = stft.getSpectrum(0);
+		CHECK(std::max_element(power, power + stft.getNumBins()) - power == 16);
+
+		// Hann leaks into the neighbouring bins, and hardly any further.
+		CHECK(power[17] > 0.1f * power[16]);
+		CHECK(power[20] < 1.0e-6f * power[16]);
+	}
+
+	SUBCASE("Every batch slot is transformed the same way")
+	{
+		for (auto frame = 0; frame < 3; frame++)
+			std::copy_n(sine.data() + frame * 64, stft.getFrameSize(), stft.getFrame(frame));
+
+		stft.transform(3);
+
+		// Shifting a sine changes its phase, not its power.
+		for (auto bin = 0; bin < stft.getNumBins(); bin++)
+			CHECK(stft.getSpectrum(2)[bin] == doctest::Approx(stft.getSpectrum(0)[bin]).epsilon(1.0e-3).scale(1.0));
+	}
+
+	SUBCASE("Pushed samples are cut into a frame every hop, however they arrive")
+	{
+		std::vector<std::vector<float>> whole;
+		stft.push(sine.data(), static_cast<int>(sine.size()), [&](const float* spectrum) {
+			whole.emplace_back(spectrum, spectrum + stft.getNumBins());
+		});
+
+		CHECK(whole.size() == (sine.size() - 256) / 64 + 1);
+
+		// Pieces of awkward sizes, so frames and batches straddle them.
+		stft.reset();
+		std::vector<std::vector<float>> pieces;
+		const int pieceSizes[] = { 1, 100, 37, 300, 5 };
+
+		for (auto start = 0, piece = 0; start < static_cast<int>(sine.size()); piece++)
+		{
+			const auto numSamples = juce::jmin(pieceSizes[piece % 5], static_cast<int>(sine.size()) - start);
+			stft.push(sine.data() + start, numSamples, [&](const float* spectrum) {
+				pieces.emplace_back(spectrum, spectrum + stft.getNumBins());
+			});
+			start += numSamples;
+		}
+
+		REQUIRE(pieces.size() == whole.size());
+		for (size_t frame = 0; frame < whole.size(); frame++)
+			CHECK(pieces[frame] == whole[frame]);
+	}
+
+	SUBCASE("Magnitude spectra are the square root of power spectra")
+	{
+		auto magnitudeParameters = parameters;
+		magnitudeParameters.spectrum = Palette::Stft::Spectrum::magnitude;
+
+		Palette::Stft magnitudes;
+		magnitudes.prepare(magnitudeParameters);
+
+		std::copy_n(sine.data(), 256, stft.getFrame(0));
+		std::copy_n(sine.data(), 256, magnitudes.getFrame(0));
+		stft.transform(1);
+		magnitudes.transform(1);
+
+		for (auto bin = 0; bin < stft.getNumBins(); bin++)
+			CHECK(magnitudes.getSpectrum(0)[bin] == doctest::Approx(std::sqrt(stft.getSpectrum(0)[bin])));
+	}
+
+	SUBCASE("Padded frames autocorrelate without wrapping around")
+	{
+		auto paddedParameters = parameters;
+		paddedParameters.paddingOrder = 1;
+		paddedParameters.windowType = Palette::WindowType::rectangular;
+
+		Palette::Stft padded;
+		padded.prepare(paddedParameters);
+		REQUIRE(padded.getFftSize() == 512);
+
+		auto* frame = padded.getFrame(0);
+		std::copy_n(sine.data(), 256, frame);
+		padded.transform(1);
+
+		const auto* autocorrelation = padded.autocorrelate(padded.getSpectrum(0));
+
+		for (auto lag : { 0, 8, 16, 100 })
+		{
+			auto expected = 0.0f;
+			for (auto i = 0; i + lag < 256; i++)
+				expected += frame[i] * frame[i + lag];
+
+			CHECK(autocorrelation[lag] == doctest::Approx(expected).epsilon(1.0e-3).scale(1.0));
+		}
+	}
+}
@@ -0,0 +1,145 @@
+/*
+  ==============================================================================
+
+    SuccessorGraph.cpp
+    Created: 16 Oct 2026 7:36:02pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#include "SuccessorGraph.h"
+
+#include "KDTree.h"
+#include "ParallelWork.h"
+
+namespace Palette
+{
+	void SuccessorGraph::build(const DescriptorTable& descriptors, const int maxSuccessors, juce::ThreadPool* pool, const float* weights,
+		const std::function<bool()>& shouldStop)
+	{
+		clear();
+
+		const auto numGrains = static_cast<int>(descriptors.getNumGrains());
+
+		if (numGrains == 0 || descriptors.getNumDimensions() == 0)
+			return;
+
+		// Every grain gets the same number of successors, so each one's place in the arrays is known up front.
+		const auto numSuccessors = juce::jlimit(0, numGrains - 1, maxSuccessors);
+
+		offsets.resize(static_cast<size_t>(numGrains + 1));
+		for (auto grain = 0; grain <= numGrains; grain++)
+			offsets[static_cast<size_t>(grain)] = grain * numSuccessors;
+
+		successors.resize(static_cast<size_t>(numGrains * numSuccessors));
+		costs.resize(successors.size());
+
+		if (numSuccessors == 0)
+			return;
+
+		KDTree tree;
+		tree.build(descriptors, weights);
+
+		// Grains are given to the threads in chunks, each written to its own span of the arrays.
+		const auto chunkSize = 256;
+		const auto numChunks = (numGrains + chunkSize - 1) / chunkSize;
+		std::atomic<int> nextChunk{ 0 };
+
+		auto findSuccessors = [&]()
+		{
+			// One more than needed, as the grain itself may be among the nearest.
+			std::vector<Neighbour> nearest(static_cast<size_t>(numSuccessors + 1));
+			std::vector<float> row(static_cast<size_t>(descriptors.getNumDimensions()));
+
+			for (auto chunk = nextChunk++; chunk < numChunks; chunk = nextChunk++)
+			{
+				if (shouldStop != nullptr && shouldStop())
+					return;
+
+				const auto end = juce::jmin(numGrains, (chunk + 1) * chunkSize);
+
+				for (auto grain = chunk * chunkSize; grain < end; grain++)
+				{
+					descriptors.getRow(static_cast<size_t>(juce::jmin(grain + 1, numGrains - 1)), row.data());
+					const auto numFound = tree.findNearest(row.data(), numSuccessors + 1, nearest.data(), weights);
+
+					auto written = offsets[static_cast<size_t>(grain)];
+
+					for (auto i = 0; i < numFound && written < offsets[static_cast<size_t>(grain + 1)]; i++)
+					{
+						if (nearest[static_cast<size_t>(i)].grain == grain)
+							continue;
+
+						successors[static_cast<size_t>(written)] = nearest[static_cast<size_t>(i)].grain;
+						costs[static_cast<size_t>(written)] = nearest[static_cast<size_t>(i)].distanceSquared;
+						written++;
+					}
+				}
+			}
+		};
+
+		runOnPool(pool, numChunks - 1, findSuccessors);
+
+		if (shouldStop != nullptr && shouldStop())
+			clear();
+	}
+
+	bool SuccessorGraph::assign(const int numGrains, std::vector<int> newOffsets, std::vector<int> newSuccessors, std::vector<float> newCosts)
+	{
+		clear();
+
+		const auto numEdges = static_cast<int>(newSuccessors.size());
+
+		if (numGrains < 0 || newOffsets.size() != static_cast<size_t>(numGrains + 1) || newCosts.size() != newSuccessors.size()
+			|| newOffsets.front() != 0 || newOffsets.back() != numEdges
+			|| ! std::is_sorted(newOffsets.begin(), newOffsets.end())
+			|| ! std::all_of(newSuccessors.begin(), newSuccessors.end(), [numGrains](const int grain) { return juce::isPositiveAndBelow(grain, numGrains); }))
+			return false;
+
+		offsets = std::move(newOffsets);
+		successors = std::move(newSuccessors);
+		costs = std::move(newCosts);
+
+		return true;
+	}
+
+	void SuccessorGraph::append(const SuccessorGraph& other)
+	{
+		if (offsets.empty())
+			offsets.push_back(0);
+
+		const auto grainOffset = getNumGrains();
+		const auto edgeOffset = getNumEdges();
+
+		for (auto grain = 0; grain < other.getNumGrains(); grain++)
+			offsets.push_back(edgeOffset + other.offsets[static_cast<size_t>(grain + 1)]);
+
+		for (const auto successor : other.successors)
+			successors.push_back(grainOffset + successor);
+
+		costs.insert(costs.end(), other.costs.begin(), other.costs.end());
+	}
+
+	void SuccessorGraph::clear()
+	{
+		offsets.clear();
+		successors.clear();
+		costs.clear();
+	}
+
+	bool SuccessorGraph::findJoinCost(const int grain, const int next, float& cost) const noexcept
+	{
+		const auto numSuccessors = getNumSuccessors(grain);
+		const auto* grainSuccessors = getSuccessors(grain);
+
+		for (auto i = 0; i < numSuccessors; i++)
+			if (grainSuccessors[i] == next)
+			{
+				cost = getCosts(grain)[i];
+				return true;
+			}
+
+		return false;
+	}
+}
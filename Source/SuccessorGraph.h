@@ -0,0 +1,172 @@
+/*
+  ==============================================================================
+
+    SuccessorGraph.h
+    Created: 16 Oct 2026 7:36:02pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+#include "Descriptors.h"
+
+namespace Palette
+{
+	/*
+	 * SuccessorGraph lists, for every grain, the grains which follow it most smoothly, with
+	 * what each join costs. It is built once, offline, so choosing a path through a corpus
+	 * can try each grain's smoothest successors without searching for them.
+	 *
+	 * A join from grain a to grain b costs the squared distance between b's descriptors and
+	 * those of the grain after a, the one which followed it in the recording. Carrying on
+	 * through the corpus is free, and b is as good a successor as it sounds like what would
+	 * have come next. The grain after the last is taken to be the last itself. A grain is
+	 * never listed as its own successor, since playing it twice over is a stutter rather
+	 * than a join.
+	 *
+	 * The graph is stored in compressed sparse row form: grain g's successors are
+	 * successors[offsets[g]] up to successors[offsets[g + 1]], cheapest first, alongside their
+	 * costs. That's three flat arrays, which are cheap to scan and to store in a cache.
+	 */
+	class SuccessorGraph
+	{
+	public:
+		SuccessorGraph() = default;
+
+		/*
+		 * Rebuilds the graph with up to maxSuccessors successors for every row of descriptors,
+		 * with distances weighted by weights, one per dimension, unless it's nullptr.
+		 * The nearest neighbour queries are shared between the threads of pool, if given, and
+		 * the calling thread. shouldStop, if given, is polled as they go, and if it returns true
+		 * the graph is left empty. Not real-time safe.
+		 */
+		void build(const DescriptorTable& descriptors, int maxSuccessors, juce::ThreadPool* pool = nullptr, const float* weights = nullptr,
+			const std::function<bool()>& shouldStop = nullptr);
+
+		/*
+		 * Replaces the graph with one built elsewhere, such as one loaded from a CorpusCache.
+		 * Returns false, leaving the graph empty, unless the arrays form a valid graph over
+		 * numGrains grains.
+		 */
+		bool assign(int numGrains, std::vector<int> offsets, std::vector<int> successors, std::vector<float> costs);
+
+		// Adds other's grains after this graph's, keeping other's joins among themselves.
+		void append(const SuccessorGraph& other);
+
+		void clear();
+
+		bool isEmpty() const noexcept { return successors.empty(); }
+		int getNumGrains() const noexcept { return offsets.empty() ? 0 : static_cast<int>(offsets.size()) - 1; }
+		int getNumEdges() const noexcept { return static_cast<int>(successors.size()); }
+
+		int getNumSuccessors(const int grain) const noexcept { return offsets[static_cast<size_t>(grain + 1)] - offsets[static_cast<size_t>(grain)]; }
+		const int* getSuccessors(const int grain) const noexcept { return successors.data() + offsets[static_cast<size_t>(grain)]; }
+		const float* getCosts(const int grain) const noexcept { return costs.data() + offsets[static_cast<size_t>(grain)]; }
+
+		/*
+		 * Looks up the cost of joining grain to next into cost. Returns false if next isn't one
+		 * of grain's listed successors, in which case the join costs more than any that are,
+		 * but by how much has to be measured.
+		 */
+		bool findJoinCost(int grain, int next, float& cost) const noexcept;
+
+		// The arrays themselves, for storing. offsets has getNumGrains() + 1 entries, the others getNumEdges().
+		const std::vector<int>& getOffsets() const noexcept { return offsets; }
+		const std::vector<int>& getSuccessorArray() const noexcept { return successors; }
+		const std::vector<float>& getCostArray() const noexcept { return costs; }
+
+	private:
+		std::vector<int> offsets;
+		std::vector<int> successors;
+		std::vector<float> costs;
+	};
+}
+
+TEST_CASE("SuccessorGraph")
+{
+	// Two rising lines in one dimension, the second a hair above the first.
+	const auto numSteps = 20;
+	Palette::DescriptorTable table(1, numSteps * 2);
+
+	for (auto step = 0; step < numSteps; step++)
+	{
+		table.setValue(static_cast<size_t>(step), 0, static_cast<float>(step));
+		table.setValue(static_cast<size_t>(numSteps + step), 0, step + 0.1f);
+	}
+
+	Palette::SuccessorGraph graph;
+	graph.build(table, 3);
+
+	REQUIRE(graph.getNumGrains() == numSteps * 2);
+	CHECK(graph.getNumEdges() == numSteps * 2 * 3);
+
+	SUBCASE("The grain after each is its free, first successor, then the nearest to it")
+	{
+		for (auto step = 0; step + 1 < numSteps; step++)
+		{
+			REQUIRE(graph.getNumSuccessors(step) == 3);
+			CHECK(graph.getSuccessors(step)[0] == step + 1);
+			CHECK(graph.getCosts(step)[0] == 0.0f);
+
+			CHECK(graph.getSuccessors(step)[1] == numSteps + step + 1);
+			CHECK(graph.getCosts(step)[1] == doctest::Approx(0.01f));
+		}
+	}
+
+	SUBCASE("No grain succeeds itself")
+	{
+		for (auto grain = 0; grain < graph.getNumGrains(); grain++)
+			for (auto successor = 0; successor < graph.getNumSuccessors(grain); successor++)
+				CHECK(graph.getSuccessors(grain)[successor] != grain);
+	}
+
+	SUBCASE("Only listed joins can be looked up")
+	{
+		auto cost = -1.0f;
+		CHECK(graph.findJoinCost(4, 5, cost));
+		CHECK(cost == 0.0f);
+
+		CHECK_FALSE(graph.findJoinCost(4, 15, cost));
+	}
+
+	SUBCASE("Building across threads gives the same graph")
+	{
+		juce::ThreadPool pool(4);
+		Palette::SuccessorGraph parallel;
+		parallel.build(table, 3, &pool);
+
+		CHECK(parallel.getOffsets() == graph.getOffsets());
+		CHECK(parallel.getSuccessorArray() == graph.getSuccessorArray());
+		CHECK(parallel.getCostArray() == graph.getCostArray());
+	}
+
+	SUBCASE("Appending offsets the other graph's grains")
+	{
+		Palette::SuccessorGraph combined;
+		combined.append(graph);
+		combined.append(graph);
+
+		REQUIRE(combined.getNumGrains() == numSteps * 4);
+		CHECK(combined.getSuccessors(numSteps * 2 + 3)[0] == numSteps * 2 + 4);
+	}
+
+	SUBCASE("Only valid graphs can be assigned")
+	{
+		Palette::SuccessorGraph assigned;
+
+		CHECK(assigned.assign(2, { 0, 1, 2 }, { 1, 0 }, { 0.5f, 0.5f }));
+		auto cost = 0.0f;
+		CHECK(assigned.findJoinCost(0, 1, cost));
+		CHECK(cost == 0.5f);
+
+		CHECK_FALSE(assigned.assign(2, { 0, 1, 2 }, { 1, 2 }, { 0.5f, 0.5f }));
+		CHECK_FALSE(assigned.assign(2, { 0, 2, 1 }, { 1, 0 }, { 0.5f, 0.5f }));
+		CHECK_FALSE(assigned.assign(2, { 0, 1, 2 }, { 1, 0 }, { 0.5f }));
+		CHECK(assigned.isEmpty());
+	}
+}
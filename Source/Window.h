@@ -0,0 +1,190 @@
+/*
+  ==============================================================================
+
+    Window.h
+    Created: 16 Oct 2026 6:10:10pm
+    Author:  bennet
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "doctest.h"
+#include "JuceHeader.h"
+
+#include <map>
+
+namespace Palette
+{
+	/*
+	 * The shape a grain is faded in and out with. Rectangular means no windowing at all.
+	 */
+	enum class WindowType
+	{
+		rectangular,
+		hann,
+		blackman,
+		tukey
+	};
+
+	/*
+	 * Fills table with numSamples values of the given window.
+	 *
+	 * The windows are periodic rather than symmetric so that, e.g., Hann windows
+	 * with a hop of half the window length sum to exactly one when overlap-added.
+	 * tukeyRatio is the fraction of the window spent tapering and only affects tukey windows.
+	 */
+	template <typename SampleType>
+	void fillWindow(SampleType* table, const int numSamples, const WindowType type, const double tukeyRatio = 0.5)
+	{
+		const auto twoPi = juce::MathConstants<double>::twoPi;
+
+		for (auto i = 0; i < numSamples; i++)
+		{
+			const auto phase = i / (double)numSamples;
+			auto value = 1.0;
+
+			switch (type)
+			{
+			case WindowType::rectangular:
+				break;
+			case WindowType::hann:
+				value = 0.5 - 0.5 * std::cos(twoPi * phase);
+				break;
+			case WindowType::blackman:
+				value = 0.42 - 0.5 * std::cos(twoPi * phase) + 0.08 * std::cos(2.0 * twoPi * phase);
+				break;
+			case WindowType::tukey:
+				// Cosine tapers over the first and last tukeyRatio / 2 of the window, flat in between.
+				if (tukeyRatio > 0 && phase < tukeyRatio / 2)
+					value = 0.5 - 0.5 * std::cos(twoPi * phase / tukeyRatio);
+				else if (tukeyRatio > 0 && phase > 1.0 - tukeyRatio / 2)
+					value = 0.5 - 0.5 * std::cos(twoPi * (1.0 - phase) / tukeyRatio);
+				break;
+			}
+
+			table[i] = static_cast<SampleType>(value);
+		}
+	}
+
+	namespace detail
+	{
+		// Every window table handed out so far, with the lock guarding them.
+		template <typename SampleType>
+		struct WindowTables
+		{
+			juce::CriticalSection lock;
+			std::map<std::pair<WindowType, int>, std::unique_ptr<std::vector<SampleType>>> tables;
+		};
+
+		template <typename SampleType>
+		WindowTables<SampleType>& getWindowTables()
+		{
+			static WindowTables<SampleType> windowTables;
+			return windowTables;
+		}
+	}
+
+	/*
+	 * getWindowTable returns a window of numSamples samples which is computed the first time
+	 * it is asked for and shared by every later caller, so grains of the same length all point at
+	 * one table. Tables are never freed, so the returned pointer stays valid for the lifetime
+	 * of the program and can be read on the audio thread. Looking a table up takes a lock
+	 * however, so only do that off the audio thread.
+	 *
+	 * Returns nullptr for rectangular windows, which callers treat as "don't window".
+	 */
+	template <typename SampleType>
+	const SampleType* getWindowTable(const WindowType type, const int numSamples)
+	{
+		if (type == WindowType::rectangular || numSamples <= 0)
+			return nullptr;
+
+		auto& windowTables = detail::getWindowTables<SampleType>();
+		const juce::ScopedLock scopedLock(windowTables.lock);
+
+		auto& table = windowTables.tables[{ type, numSamples }];
+
+		if (table == nullptr)
+		{
+			table = std::make_unique<std::vector<SampleType>>(static_cast<size_t>(numSamples));
+			fillWindow(table->data(), numSamples, type);
+		}
+
+		return table->data();
+	}
+
+	/*
+	 * The reverse of getWindowTable: finds the type and length of a table it returned, so the
+	 * window can be described somewhere a pointer means nothing, such as a file. nullptr is
+	 * a rectangular window of no particular length. Returns false for any other pointer.
+	 */
+	template <typename SampleType>
+	bool findWindowTable(const SampleType* table, WindowType& type, int& numSamples)
+	{
+		if (table == nullptr)
+		{
+			type = WindowType::rectangular;
+			numSamples = 0;
+			return true;
+		}
+
+		auto& windowTables = detail::getWindowTables<SampleType>();
+		const juce::ScopedLock scopedLock(windowTables.lock);
+
+		for (const auto& entry : windowTables.tables)
+		{
+			if (entry.second->data() == table)
+			{
+				type = entry.first.first;
+				numSamples = entry.first.second;
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
+
+TEST_CASE("Window")
+{
+	SUBCASE("Tables are computed once and shared")
+	{
+		const auto* hann = Palette::getWindowTable<float>(Palette::WindowType::hann, 1024);
+
+		CHECK(hann != nullptr);
+		CHECK(hann == Palette::getWindowTable<float>(Palette::WindowType::hann, 1024));
+		CHECK(hann != Palette::getWindowTable<float>(Palette::WindowType::hann, 512));
+		CHECK(hann != Palette::getWindowTable<float>(Palette::WindowType::blackman, 1024));
+		CHECK(Palette::getWindowTable<float>(Palette::WindowType::rectangular, 1024) == nullptr);
+
+		auto type = Palette::WindowType::rectangular;
+		auto length = 0;
+		REQUIRE(Palette::findWindowTable(hann, type, length));
+		CHECK(type == Palette::WindowType::hann);
+		CHECK(length == 1024);
+
+		const float notATable[4] = {};
+		CHECK_FALSE(Palette::findWindowTable(notATable, type, length));
+	}
+
+	SUBCASE("Hann windows at half overlap sum to one")
+	{
+		const auto length = 256;
+		const auto* hann = Palette::getWindowTable<float>(Palette::WindowType::hann, length);
+
+		for (auto i = 0; i < length / 2; i++)
+			CHECK(hann[i] + hann[i + length / 2] == doctest::Approx(1.0f));
+	}
+
+	SUBCASE("Tukey windows are flat in the middle and taper to zero")
+	{
+		const auto* tukey = Palette::getWindowTable<float>(Palette::WindowType::tukey, 100);
+
+		CHECK(tukey[0] == doctest::Approx(0.0f));
+		CHECK(tukey[50] == doctest::Approx(1.0f));
+		CHECK(tukey[25] == doctest::Approx(1.0f));
+		CHECK(tukey[10] < 1.0f);
+	}
+}
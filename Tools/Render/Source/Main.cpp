@@ -0,0 +1,205 @@
+/*
+  ==============================================================================
+
+    This file contains the basic startup code for a JUCE application.
+
+    PaletteRender renders a mosaic of a target file out of a directory of
+    corpus files, without a host:
+
+        PaletteRender <corpus directory> <target file> <output file> [options]
+
+    Every option takes a value, as --option=value:
+
+        --grain       target and corpus grain length in miliseconds
+        --hop         miliseconds between the starts of consecutive grains
+        --selection   kdtree, approximate or bruteforce
+        --window      targets whose grains are chosen together as one path;
+                      0 picks the nearest grain to each target on its own
+        --gain        gain applied to every grain
+        --chunk       seconds of the target rendered by each job; chunks are
+                      spread across every CPU and stitched back seamlessly
+
+  ==============================================================================
+*/
+
+#include "JuceHeader.h"
+
+#include "CorpusLoader.h"
+#include "MosaicRenderer.h"
+
+#include <iostream>
+
+//==============================================================================
+namespace
+{
+    const char* const usage = "Usage: PaletteRender <corpus directory> <target file> <output file> "
+                              "[--grain=ms] [--hop=ms] [--selection=kdtree|approximate|bruteforce] [--window=targets] [--gain=gain] [--chunk=seconds]";
+
+    std::unique_ptr<juce::AudioFormatReader> createReader (juce::AudioFormatManager& formatManager, const juce::File& file)
+    {
+        return std::unique_ptr<juce::AudioFormatReader> (formatManager.createReaderFor (file));
+    }
+
+    /*
+     * Loads, segments and analyses every audio file in directory at sampleRate into renderer,
+     * the same way the plugin loads a corpus. Returns how many files were loaded.
+     */
+    int loadCorpora (Palette::MosaicRenderer& renderer, const juce::File& directory, double sampleRate,
+                     const Palette::MosaicRenderer::Options& renderOptions, juce::AudioFormatManager& formatManager)
+    {
+        Palette::CorpusLoader::Options loadOptions;
+        loadOptions.segmentation = Palette::CorpusLoader::Segmentation::fixedLength;
+        loadOptions.grainLength = renderOptions.grainLength;
+        loadOptions.hopLength = renderOptions.hopLength;
+        loadOptions.windowType = renderOptions.windowType;
+
+        auto numLoaded = 0;
+
+        for (const auto& entry : juce::RangedDirectoryIterator (directory, true, formatManager.getWildcardForAllFormats()))
+        {
+            const auto file = entry.getFile();
+            auto reader = createReader (formatManager, file);
+
+            if (reader == nullptr)
+                continue;
+
+            if (reader->sampleRate != sampleRate)
+            {
+                std::cerr << "Skipping " << file.getFullPathName() << ": it isn't at the target's sample rate" << std::endl;
+                continue;
+            }
+
+            Palette::CorpusLoader::loadFromReader (*reader, loadOptions,
+                                                   [&renderer] (std::shared_ptr<const Palette::Corpus<float>> corpus, bool isComplete)
+                                                   {
+                                                       if (isComplete)
+                                                           renderer.addCorpus (std::move (corpus));
+                                                   },
+                                                   [] { return false; });
+            numLoaded++;
+        }
+
+        return numLoaded;
+    }
+
+    bool parseSelection (const juce::String& name, ConcatenativeSynthesizer::SelectionStrategy& strategy)
+    {
+        if (name == "kdtree")           strategy = ConcatenativeSynthesizer::SelectionStrategy::kdTree;
+        else if (name == "approximate") strategy = ConcatenativeSynthesizer::SelectionStrategy::approximate;
+        else if (name == "bruteforce")  strategy = ConcatenativeSynthesizer::SelectionStrategy::bruteForce;
+        else                            return false;
+
+        return true;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    const juce::ArgumentList arguments (argc, argv);
+
+    juce::StringArray paths;
+    for (const auto& argument : arguments.arguments)
+        if (! argument.isOption())
+            paths.add (argument.text);
+
+    if (paths.size() != 3)
+    {
+        std::cerr << usage << std::endl;
+        return 1;
+    }
+
+    const auto corpusDirectory = juce::File::getCurrentWorkingDirectory().getChildFile (paths[0]);
+    const auto targetFile = juce::File::getCurrentWorkingDirectory().getChildFile (paths[1]);
+    const auto outputFile = juce::File::getCurrentWorkingDirectory().getChildFile (paths[2]);
+
+    Palette::MosaicRenderer::Options options;
+
+    if (arguments.containsOption ("--grain"))
+        options.grainLength = arguments.getValueForOption ("--grain").getDoubleValue();
+
+    options.hopLength = arguments.containsOption ("--hop") ? arguments.getValueForOption ("--hop").getDoubleValue()
+                                                           : options.grainLength / 2;
+
+    if (arguments.containsOption ("--window"))
+    {
+        options.pathParameters.windowLength = arguments.getValueForOption ("--window").getIntValue();
+        options.selectPaths = options.pathParameters.windowLength > 0;
+    }
+
+    if (arguments.containsOption ("--gain"))
+        options.gain = arguments.getValueForOption ("--gain").getFloatValue();
+
+    if (arguments.containsOption ("--chunk"))
+        options.chunkLength = arguments.getValueForOption ("--chunk").getDoubleValue();
+
+    if (arguments.containsOption ("--selection") && ! parseSelection (arguments.getValueForOption ("--selection"), options.selectionStrategy))
+    {
+        std::cerr << usage << std::endl;
+        return 1;
+    }
+
+    if (options.grainLength <= 0.0 || options.hopLength <= 0.0 || options.chunkLength <= 0.0)
+    {
+        std::cerr << "Grain, hop and chunk lengths must be positive" << std::endl;
+        return 1;
+    }
+
+    if (options.pathParameters.windowLength < 0)
+    {
+        std::cerr << "The path window can't be negative" << std::endl;
+        return 1;
+    }
+
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    auto targetReader = createReader (formatManager, targetFile);
+
+    if (targetReader == nullptr)
+    {
+        std::cerr << "Couldn't read " << targetFile.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    const auto sampleRate = targetReader->sampleRate;
+    juce::AudioBuffer<float> target ((int) targetReader->numChannels, (int) targetReader->lengthInSamples);
+    targetReader->read (&target, 0, target.getNumSamples(), 0, true, true);
+
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+    Palette::MosaicRenderer renderer (options);
+    const auto numCorpusFiles = loadCorpora (renderer, corpusDirectory, sampleRate, options, formatManager);
+
+    if (renderer.getNumGrains() == 0)
+    {
+        std::cerr << "Found no corpus audio in " << corpusDirectory.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    juce::ThreadPool pool (juce::SystemStats::getNumCpus());
+    const auto mosaic = renderer.render (target, sampleRate, target.getNumChannels(), &pool);
+
+    outputFile.deleteFile();
+    auto stream = std::make_unique<juce::FileOutputStream> (outputFile);
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+
+    // The writer only takes ownership of the stream if it's created.
+    if (stream->openedOk())
+        writer.reset (juce::WavAudioFormat().createWriterFor (stream.get(), sampleRate, (unsigned int) mosaic.getNumChannels(), 24, {}, 0));
+
+    if (writer != nullptr)
+        stream.release();
+
+    if (writer == nullptr || ! writer->writeFromAudioSampleBuffer (mosaic, 0, mosaic.getNumSamples()))
+    {
+        std::cerr << "Couldn't write " << outputFile.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    const auto seconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+    std::cout << "Rendered " << mosaic.getNumSamples() / sampleRate << " s from " << renderer.getNumGrains() << " grains of "
+              << numCorpusFiles << " files in " << seconds << " s" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,25 @@
+/*
+  ==============================================================================
+
+    This file contains the basic startup code for a JUCE application.
+
+    Palette's tests live next to the code they test, in TEST_CASEs at the end
+    of each header. This runs all of them; the plugin itself is built with
+    DOCTEST_CONFIG_DISABLE, so none of them are compiled into it.
+
+  ==============================================================================
+*/
+
+#define DOCTEST_CONFIG_IMPLEMENT
+#include "doctest.h"
+
+#include "JuceHeader.h"
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    doctest::Context context;
+    context.applyCommandLine (argc, argv);
+
+    return context.run();
+}